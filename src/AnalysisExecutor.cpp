@@ -0,0 +1,217 @@
+#include "AnalysisExecutor.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+AnalysisExecutor::Client::Client(std::shared_ptr<AnalysisExecutor> _executor,
+	unsigned int _priority, unsigned int _maxConcurrency)
+	:	executor{_executor}
+	,	priority{std::max(_priority, 1U)}
+	,	maxConcurrency{_maxConcurrency}
+	,	running{0}
+	,	turn{0}
+	,	completed{0}
+	,	detached{false} {
+}
+
+AnalysisExecutor::Client::~Client() {
+	detach();
+}
+
+void AnalysisExecutor::Client::post(Task task) {
+	{
+		std::unique_lock<std::mutex> lock(executor->mutex);
+
+		if(detached) {
+			return;
+		}
+
+		tasks.push_back(std::move(task));
+	}
+
+	executor->workCondition.notify_one();
+}
+
+void AnalysisExecutor::Client::detach() {
+	std::unique_lock<std::mutex> lock(executor->mutex);
+
+	if(detached) {
+		return;
+	}
+
+	detached = true;
+
+	//Queued tasks still run, the owner may be waiting on their results
+	executor->idleCondition.wait(lock, [this]() {
+			return tasks.empty() && running == 0;
+		});
+
+	auto& clients = executor->clients;
+	auto itr = std::find(clients.begin(), clients.end(), this);
+	size_t index = itr - clients.begin();
+
+	clients.erase(itr);
+
+	//Keep the round robin on the client that was next
+	if(executor->cursor > index) {
+		--executor->cursor;
+	}
+	if(executor->cursor >= clients.size()) {
+		executor->cursor = 0;
+	}
+}
+
+void AnalysisExecutor::Client::setPriority(unsigned int _priority) {
+	std::unique_lock<std::mutex> lock(executor->mutex);
+
+	priority = std::max(_priority, 1U);
+}
+
+unsigned int AnalysisExecutor::Client::getPriority() const {
+	std::unique_lock<std::mutex> lock(executor->mutex);
+
+	return priority;
+}
+
+unsigned int AnalysisExecutor::Client::getMaxConcurrency() const {
+	return maxConcurrency;
+}
+
+size_t AnalysisExecutor::Client::getQueuedCount() const {
+	std::unique_lock<std::mutex> lock(executor->mutex);
+
+	return tasks.size();
+}
+
+uint64_t AnalysisExecutor::Client::getCompletedCount() const {
+	std::unique_lock<std::mutex> lock(executor->mutex);
+
+	return completed;
+}
+
+bool AnalysisExecutor::Client::isRunnable() const {
+	return !tasks.empty() && (maxConcurrency == 0 || running < maxConcurrency);
+}
+
+AnalysisExecutor::AnalysisExecutor(unsigned int threadCount)
+	:	cursor{0}
+	,	stopping{false} {
+
+	if(threadCount == 0) {
+		threadCount = std::max(std::thread::hardware_concurrency(), 1U);
+	}
+
+	for(unsigned int i = 0; i < threadCount; ++i) {
+		threads.emplace_back(&AnalysisExecutor::workerRoutine, this);
+	}
+}
+
+AnalysisExecutor::~AnalysisExecutor() {
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		stopping = true;
+	}
+
+	workCondition.notify_all();
+
+	for(auto& thread : threads) {
+		thread.join();
+	}
+}
+
+std::shared_ptr<AnalysisExecutor> AnalysisExecutor::getShared() {
+	//Thread safe static initialization
+	static std::shared_ptr<AnalysisExecutor> executor =
+		std::make_shared<AnalysisExecutor>();
+
+	return executor;
+}
+
+std::shared_ptr<AnalysisExecutor::Client> AnalysisExecutor::attach(
+	unsigned int priority, unsigned int maxConcurrency) {
+
+	std::shared_ptr<Client> client(new Client(shared_from_this(), priority,
+		maxConcurrency));
+
+	std::unique_lock<std::mutex> lock(mutex);
+
+	clients.push_back(client.get());
+
+	return client;
+}
+
+unsigned int AnalysisExecutor::getThreadCount() const {
+	return threads.size();
+}
+
+size_t AnalysisExecutor::getClientCount() const {
+	std::unique_lock<std::mutex> lock(mutex);
+
+	return clients.size();
+}
+
+void AnalysisExecutor::workerRoutine() {
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while(true) {
+		Client *client = nullptr;
+
+		workCondition.wait(lock, [this, &client]() {
+				return stopping || (client = pickClient()) != nullptr;
+			});
+
+		if(!client) {
+			break;
+		}
+
+		Task task = std::move(client->tasks.front());
+		client->tasks.pop_front();
+		++client->running;
+
+		lock.unlock();
+
+		task();
+
+		lock.lock();
+
+		--client->running;
+		++client->completed;
+
+		if(client->tasks.empty() && client->running == 0) {
+			//For detach
+			idleCondition.notify_all();
+		}
+		else if(client->isRunnable()) {
+			//Was held back by its concurrency limit
+			workCondition.notify_one();
+		}
+	}
+
+	std::cout << "[Info] AnalysisExecutor::workerRoutine: thread returning"
+		<< std::endl;
+}
+
+AnalysisExecutor::Client* AnalysisExecutor::pickClient() {
+	if(clients.empty()) {
+		return nullptr;
+	}
+
+	//Weighted round robin: the client at the cursor keeps the turn for up
+	//to priority tasks. One extra step comes back to the first client with
+	//a fresh turn when every other client is idle
+	for(size_t step = 0; step <= clients.size(); ++step) {
+		Client *client = clients[cursor];
+
+		if(client->isRunnable() && client->turn < client->priority) {
+			++client->turn;
+
+			return client;
+		}
+
+		client->turn = 0;
+		cursor = (cursor + 1) % clients.size();
+	}
+
+	return nullptr;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Pool of worker threads shared by any number of SpectrumAnalyzers, so
+//running many analyzers in one process doesn't oversubscribe the CPU.
+//Each analyzer attaches as a client with its own task queue. Workers serve
+//clients round robin, taking up to priority tasks from a client per turn,
+//so a busy analyzer can't starve the others. A client may also cap how many
+//of its tasks run at once.
+
+class AnalysisExecutor : public std::enable_shared_from_this<AnalysisExecutor>
+{
+public:
+	typedef std::function<void()> Task;
+
+	//Handle of one attached analyzer
+	class Client
+	{
+	public:
+		~Client();
+
+		Client(const Client&) = delete;
+		Client& operator=(const Client&) = delete;
+
+		//Queue a task, ignored once detached
+		void post(Task task);
+
+		//Stop accepting tasks and wait for queued and running ones to finish
+		//Must not be called from one of this client's tasks
+		void detach();
+
+		//Tasks taken per round robin turn, at least 1
+		void setPriority(unsigned int priority);
+		unsigned int getPriority() const;
+
+		unsigned int getMaxConcurrency() const;
+
+		//Tasks queued and not yet started
+		size_t getQueuedCount() const;
+
+		uint64_t getCompletedCount() const;
+
+	private:
+		friend class AnalysisExecutor;
+
+		Client(std::shared_ptr<AnalysisExecutor> executor,
+			unsigned int priority, unsigned int maxConcurrency);
+
+		bool isRunnable() const;
+
+		//Keeps the workers alive while attached
+		std::shared_ptr<AnalysisExecutor> executor;
+
+		//Guarded by the executor's mutex
+		std::deque<Task> tasks;
+		unsigned int priority, maxConcurrency;
+		unsigned int running, turn;
+		uint64_t completed;
+		bool detached;
+	};
+
+	//threadCount 0 for one thread per hardware thread
+	explicit AnalysisExecutor(unsigned int threadCount = 0);
+	~AnalysisExecutor();
+
+	AnalysisExecutor(const AnalysisExecutor&) = delete;
+	AnalysisExecutor& operator=(const AnalysisExecutor&) = delete;
+
+	//Process wide executor sized to the hardware, created on first use
+	static std::shared_ptr<AnalysisExecutor> getShared();
+
+	//maxConcurrency 0 for no limit beyond the thread count
+	std::shared_ptr<Client> attach(unsigned int priority = 1,
+		unsigned int maxConcurrency = 0);
+
+	unsigned int getThreadCount() const;
+	size_t getClientCount() const;
+
+private:
+	void workerRoutine();
+
+	//Next client with a task it may start, nullptr if there is none
+	//Called with mutex held
+	Client* pickClient();
+
+	std::vector<std::thread> threads;
+
+	mutable std::mutex mutex;
+	std::condition_variable workCondition, idleCondition;
+	std::vector<Client*> clients;
+	size_t cursor;
+	bool stopping;
+};
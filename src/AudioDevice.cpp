@@ -1,13 +1,19 @@
 #include "AudioDevice.hpp"
 
 #include <iostream>
+#include <chrono>
 
 const int AudioDevice::DEFAULT_DEVICE;
+const unsigned int AudioDevice::DEFAULT_RING_SIZE;
 
 AudioDevice::AudioDevice(int _deviceID, unsigned int _sampleRate,
-	unsigned int _blockSize) 
-	:	sampleRate{_sampleRate}
+	unsigned int _blockSize, unsigned int ringSize, unsigned int _channelCount)
+	:	inputOverflows{0}
+	,	ring(_blockSize, ringSize, _channelCount)
+	,	nextCallbackID{0}
+	,	sampleRate{_sampleRate}
 	,	blockSize{_blockSize}
+	,	channelCount{_channelCount}
 	,	running{false} {
 	
 	//Initialize PortAudio
@@ -34,7 +40,7 @@ AudioDevice::AudioDevice(int _deviceID, unsigned int _sampleRate,
 	PaStreamParameters inputParams;
 
 	inputParams.device = _deviceID;
-	inputParams.channelCount = 2; //Stereo
+	inputParams.channelCount = channelCount;
 	inputParams.sampleFormat = paInt16; //16bit audio
 	inputParams.suggestedLatency = STREAM_LATENCY;
 	inputParams.hostApiSpecificStreamInfo = NULL;
@@ -52,66 +58,90 @@ AudioDevice::AudioDevice(int _deviceID, unsigned int _sampleRate,
 		throw Exception(ERROR_PORTAUDIO_STREAM_OPEN, "AudioDevice::AudioDevice: "
 			"Failed to open stream: " + std::string(Pa_GetErrorText(retval)));
 	}
-
-	//Allocate memory for left/right audio samples
-	leftSamples = new int16_t[blockSize];
-	rightSamples = new int16_t[blockSize];
 }
 
 AudioDevice::~AudioDevice() {
 	if(running) {
 		//Stop the stream
-		Pa_StopStream(&inputStream);
+		Pa_StopStream(inputStream);
 	}
 
+	Pa_CloseStream(inputStream);
+
 	//Terminate PortAudio
 	Pa_Terminate();
 
-	//Free left/right audio sample buffers
-	delete[] leftSamples;
-	delete[] rightSamples;
+	//Stop any remaining consumer threads
+	for(auto& consumer : consumers) {
+		consumer.second->running = false;
+		consumer.second->thread.join();
+	}
 }
 
-unsigned int AudioDevice::addCallback(std::function<void(const int16_t*,
-	const int16_t*)> cb) {
-	static unsigned int id = 0;
-	
+unsigned int AudioDevice::addCallback(Callback cb) {
+	//Lock the callback map mutex
+	std::unique_lock<std::mutex> consumerLock(consumerMutex);
+
+	unsigned int id = nextCallbackID++;
+
+	auto consumer = std::make_unique<Consumer>();
+	consumer->cb = cb;
+	consumer->running = true;
+	consumer->overruns = 0;
+
+	//Start reading from the next chunk the audio thread writes
+	consumer->thread = std::thread(&AudioDevice::consumerRoutine, this,
+		consumer.get(), ring.getWriteIndex());
+
 	//Insert the callback into the map
-	auto cbPair = std::pair<unsigned int,
-		std::function<void(const int16_t*, const int16_t*)>>(id, cb);
-	callbacks.insert(cbPair);
+	consumers.emplace(id, std::move(consumer));
 
-	return id++;
+	return id;
 }
 
 
 void AudioDevice::removeCallback(unsigned int id) {
-	//Lock the callback vector mutex
-	std::unique_lock<std::mutex> callbackLock(callbackMutex);
+	std::unique_ptr<Consumer> consumer;
 
-	//Find callback with given id
-	auto cbItr = callbacks.find(id);
+	{
+		//Lock the callback map mutex
+		std::unique_lock<std::mutex> consumerLock(consumerMutex);
 
-	if(cbItr == callbacks.end()) {
-		throw Exception(ERROR_CALLBACK_INVALID_ID, "AudioDevice::removeCallback: "
-			"Invalid callback ID");
-	}
+		//Find callback with given id
+		auto cbItr = consumers.find(id);
+
+		if(cbItr == consumers.end()) {
+			throw Exception(ERROR_CALLBACK_INVALID_ID, "AudioDevice::removeCallback: "
+				"Invalid callback ID");
+		}
 
-	//Remove callback
-	callbacks.erase(cbItr);
+		//Remove callback
+		consumer = std::move(cbItr->second);
+		consumers.erase(cbItr);
 
-//mutex is released here
+		//mutex is released here
+	}
+
+	//Stop the consumer thread
+	consumer->running = false;
+	consumer->thread.join();
 }
 
 int AudioDevice::startStream() {
 	PaError retval = Pa_StartStream(inputStream);
 
+	if(retval == paNoError) {
+		running = true;
+	}
+
 	return (int)retval;
 }
 
 int AudioDevice::stopStream() {
 	PaError retval = Pa_StopStream(inputStream);
 
+	running = false;
+
 	return (int)retval;
 }
 
@@ -123,29 +153,102 @@ unsigned int AudioDevice::getBlockSize() {
 	return blockSize;
 }
 
+unsigned int AudioDevice::getChannelCount() {
+	return channelCount;
+}
+
+bool AudioDevice::isRunning() {
+	return running;
+}
+
+uint64_t AudioDevice::getOverrunCount(unsigned int id) {
+	//Lock the callback map mutex
+	std::unique_lock<std::mutex> consumerLock(consumerMutex);
+
+	auto cbItr = consumers.find(id);
+
+	if(cbItr == consumers.end()) {
+		throw Exception(ERROR_CALLBACK_INVALID_ID, "AudioDevice::getOverrunCount: "
+			"Invalid callback ID");
+	}
+
+	return cbItr->second->overruns.load(std::memory_order_relaxed);
+}
+
+uint64_t AudioDevice::getInputOverflowCount() {
+	return inputOverflows.load(std::memory_order_relaxed);
+}
+
 int AudioDevice::paCallback(const void* input, void*,
-	unsigned long frameCount, const PaStreamCallbackTimeInfo*,
-	PaStreamCallbackFlags, void* userData) {
+	unsigned long frameCount, const PaStreamCallbackTimeInfo* timeInfo,
+	PaStreamCallbackFlags statusFlags, void* userData) {
 
 	AudioDevice *pDev = (AudioDevice*)userData;
 
-	//Unstrip the left/right audio samples
-	//By default, they come packed l0/r0/l1/r1...
-	const int16_t* samples = (const int16_t*)input;
-	for(unsigned int i = 0; i < frameCount; i++) {
-		int sampleIndex = 2*i;
+	//Move the ADC time of the first sample from the stream clock to the
+	//steady clock, then on to the last sample of the chunk. Some host APIs
+	//leave the ADC time at 0, in which case the chunk counts as captured now
+	Timestamp captureTime = getTimestamp();
+
+	if(timeInfo && timeInfo->inputBufferAdcTime > 0. &&
+		timeInfo->currentTime >= timeInfo->inputBufferAdcTime) {
+
+		double age = timeInfo->currentTime - timeInfo->inputBufferAdcTime -
+			(double)frameCount / pDev->sampleRate;
+
+		if(age > 0.) {
+			captureTime -= (Timestamp)(age * 1e9);
+		}
+	}
 
-		pDev->leftSamples[i] = samples[sampleIndex];
-		pDev->rightSamples[i] = samples[sampleIndex + 1];
+	if(statusFlags & paInputOverflow) {
+		pDev->inputOverflows.fetch_add(1, std::memory_order_relaxed);
 	}
 
-	//Lock the callback vector mutex
-	std::unique_lock<std::mutex> callbackLock(pDev->callbackMutex);
+	//Deinterleave into the ring, consumer threads take it from there
+	pDev->ring.write((const int16_t*)input, frameCount, captureTime);
 
-	//Call each callback
-	for(auto& cb : pDev->callbacks) {
-		cb.second(pDev->leftSamples, pDev->rightSamples);
+	return paContinue;
+}
+
+void AudioDevice::consumerRoutine(Consumer* consumer, uint64_t readIndex) {
+	std::vector<int16_t> samples(blockSize * channelCount);
+	std::vector<int16_t*> channels(channelCount);
+	Timestamp captureTime;
+
+	for(unsigned int channel = 0; channel < channelCount; ++channel) {
+		channels[channel] = &samples[channel * blockSize];
 	}
 
-	return paContinue; //mutex is released here
+	//Poll several times per chunk period
+	auto pollInterval = std::chrono::microseconds(
+		(uint64_t)1000000 * blockSize / sampleRate / 4);
+
+	while(consumer->running) {
+		uint64_t writeIndex = ring.getWriteIndex();
+
+		if(readIndex == writeIndex) {
+			std::this_thread::sleep_for(pollInterval);
+			continue;
+		}
+
+		if(writeIndex - readIndex > ring.getChunkCount()) {
+			//Fell behind far enough that chunks were overwritten,
+			//skip ahead to the newest chunk
+			consumer->overruns.fetch_add(writeIndex - 1 - readIndex,
+				std::memory_order_relaxed);
+			readIndex = writeIndex - 1;
+		}
+
+		if(!ring.read(readIndex, channels.data(), captureTime)) {
+			//Overwritten while copying
+			consumer->overruns.fetch_add(1, std::memory_order_relaxed);
+			++readIndex;
+			continue;
+		}
+
+		++readIndex;
+
+		consumer->cb(channels.data(), captureTime);
+	}
 }
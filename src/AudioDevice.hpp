@@ -2,60 +2,93 @@
 
 #include <functional>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <atomic>
+#include <vector>
 
 #include <portaudio.h>
 
+#include "AudioRing.hpp"
+#include "AudioSource.hpp"
 #include "Exception.hpp"
 
 
 #define STREAM_LATENCY	0.010
 
-//Stereo audio input class
+//Multichannel audio input class
+//The PortAudio callback only deinterleaves into a preallocated ring, each
+//registered callback is run on its own consumer thread that drains the ring
 
-class AudioDevice
+class AudioDevice : public AudioSource
 {
 public:
 	static const int DEFAULT_DEVICE = -1;
 
+	//Chunks buffered between the audio thread and consumers
+	static const unsigned int DEFAULT_RING_SIZE = 64;
+
 	//Error codes
 	static const int ERROR_PORTAUDIO_INITIALIZE = 0x00002000;
 	static const int ERROR_PORTAUDIO_STREAM_OPEN = 0x00002001;
 	static const int ERROR_CALLBACK_INVALID_ID = 0x00002002;
 
 	
-	AudioDevice(int deviceID, unsigned int sampleRate, unsigned int blockSize);
+	AudioDevice(int deviceID, unsigned int sampleRate, unsigned int blockSize,
+		unsigned int ringSize = DEFAULT_RING_SIZE, unsigned int channelCount = 2);
 	~AudioDevice();
 
-	unsigned int addCallback(std::function<void(const int16_t*,
-		const int16_t*)> cb);
-	void removeCallback(unsigned int id);
+	//The callback runs on a consumer thread owned by this device
+	//removeCallback joins that thread, so it must not be called from
+	//inside the callback itself
+	unsigned int addCallback(Callback cb) override;
+	void removeCallback(unsigned int id) override;
+
+	int startStream() override;
+	int stopStream() override;
+
+	unsigned int getSampleRate() override;
+	unsigned int getBlockSize() override;
+	unsigned int getChannelCount() override;
 
-	int startStream();
-	int stopStream();
+	bool isRunning() override;
 
-	unsigned int getSampleRate();
-	unsigned int getBlockSize();
+	//Chunks a consumer missed because it fell more than the ring size behind
+	uint64_t getOverrunCount(unsigned int id) override;
 
-	bool isRunning();
+	//Input overflows reported by PortAudio
+	uint64_t getInputOverflowCount();
 
 private:
+	struct Consumer {
+		Callback cb;
+		std::thread thread;
+		std::atomic<bool> running;
+		std::atomic<uint64_t> overruns;
+	};
+
 	//PortAudio callback
 	static int paCallback(const void* input, void* output,
 		unsigned long frameCount, const PaStreamCallbackTimeInfo* timeInfo,
 		PaStreamCallbackFlags statusFlags, void* userData);
 
+	void consumerRoutine(Consumer* consumer, uint64_t readIndex);
+
 	//PortAudio stuff
 	PaStream *inputStream;
+	std::atomic<uint64_t> inputOverflows;
+
+	//Samples from the audio thread
+	AudioRing ring;
 
-	//Callbacks
-	std::map<unsigned int,
-		std::function<void(const int16_t* left, const int16_t* right)>> callbacks;
-	std::mutex callbackMutex;
+	//Callbacks, only touched by non real-time threads
+	std::map<unsigned int, std::unique_ptr<Consumer>> consumers;
+	std::mutex consumerMutex;
+	unsigned int nextCallbackID;
 
 	//Audio stuff
-	int16_t *leftSamples, *rightSamples;
-	unsigned int sampleRate, blockSize;
+	unsigned int sampleRate, blockSize, channelCount;
 
 	bool running;
 };
@@ -0,0 +1,98 @@
+#include "AudioRing.hpp"
+
+#include <cstring>
+
+#include "SampleKernels.hpp"
+
+AudioRing::AudioRing(unsigned int _chunkSize, unsigned int _chunkCount,
+	unsigned int _channelCount)
+	:	chunkSize{_chunkSize}
+	,	chunkCount{_chunkCount}
+	,	channelCount{_channelCount}
+	,	deinterleave{SampleKernels::get().deinterleave}
+	,	samples(_chunkSize * _chunkCount * _channelCount)
+	,	captureTimes(_chunkCount)
+	,	writeStart{0}
+	,	writeIndex{0} {
+
+}
+
+void AudioRing::write(const int16_t* interleaved, unsigned long frameCount,
+	Timestamp captureTime) {
+
+	uint64_t index = writeIndex.load(std::memory_order_relaxed);
+
+	//Mark the oldest chunk as being overwritten before touching it
+	writeStart.store(index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	int16_t *slot = &samples[(index % chunkCount) * chunkSize * channelCount];
+
+	if(frameCount > chunkSize) {
+		frameCount = chunkSize;
+	}
+
+	//Unstrip the audio samples, they come packed c0/c1/.../cN-1 per frame
+	if(channelCount == 2) {
+		deinterleave(interleaved, slot, slot + chunkSize, frameCount);
+	}
+	else {
+		for(unsigned int channel = 0; channel < channelCount; ++channel) {
+			int16_t *out = slot + channel*chunkSize;
+			const int16_t *in = interleaved + channel;
+
+			for(unsigned long i = 0; i < frameCount; ++i) {
+				out[i] = in[i*channelCount];
+			}
+		}
+	}
+
+	for(unsigned int channel = 0; channel < channelCount; ++channel) {
+		std::memset(slot + channel*chunkSize + frameCount, 0,
+			sizeof(int16_t) * (chunkSize - frameCount));
+	}
+
+	captureTimes[index % chunkCount] = captureTime;
+
+	writeIndex.store(index + 1, std::memory_order_release);
+}
+
+uint64_t AudioRing::getWriteIndex() const {
+	return writeIndex.load(std::memory_order_acquire);
+}
+
+bool AudioRing::read(uint64_t index, int16_t* const* channels,
+	Timestamp& captureTime) const {
+
+	if(index >= getWriteIndex()) {
+		//Not written yet
+		return false;
+	}
+
+	const int16_t *slot = &samples[(index % chunkCount) * chunkSize *
+		channelCount];
+
+	for(unsigned int channel = 0; channel < channelCount; ++channel) {
+		std::memcpy(channels[channel], slot + channel*chunkSize,
+			sizeof(int16_t) * chunkSize);
+	}
+	captureTime = captureTimes[index % chunkCount];
+
+	//If the producer started writing the chunk that reuses this slot,
+	//the copy may be torn
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	return writeStart.load(std::memory_order_relaxed) - index <= chunkCount;
+}
+
+unsigned int AudioRing::getChunkSize() const {
+	return chunkSize;
+}
+
+unsigned int AudioRing::getChunkCount() const {
+	return chunkCount;
+}
+
+unsigned int AudioRing::getChannelCount() const {
+	return channelCount;
+}
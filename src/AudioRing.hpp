@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "LatencyHistogram.hpp"
+#include "SampleKernels.hpp"
+
+//Single-producer ring of multichannel audio chunks, stored planar.
+//The producer never waits: when the ring is full it overwrites the oldest
+//chunk. Any number of readers keep their own chunk index and detect chunks
+//that were overwritten before or while they were being copied.
+
+class AudioRing
+{
+public:
+	AudioRing(unsigned int chunkSize, unsigned int chunkCount,
+		unsigned int channelCount = 2);
+
+	//Producer side, real-time safe (no locks, no allocation)
+	//Deinterleaves one chunk of frames (one sample per channel each),
+	//frameCount may not exceed the chunk size (shorter chunks are zero
+	//padded)
+	void write(const int16_t* interleaved, unsigned long frameCount,
+		Timestamp captureTime);
+
+	//Number of chunks written so far, chunk n is readable for
+	//getWriteIndex() - getChunkCount() <= n < getWriteIndex()
+	uint64_t getWriteIndex() const;
+
+	//Copy chunk index into channels (chunkSize samples each)
+	//Returns false if the chunk was overwritten before the copy completed
+	bool read(uint64_t index, int16_t* const* channels,
+		Timestamp& captureTime) const;
+
+	unsigned int getChunkSize() const;
+	unsigned int getChunkCount() const;
+	unsigned int getChannelCount() const;
+
+private:
+	unsigned int chunkSize, chunkCount, channelCount;
+
+	//Resolved before the stream starts, the audio thread only calls it
+	SampleKernels::Deinterleave deinterleave;
+
+	//Chunk slot by slot, each slot holding chunkSize samples per channel
+	std::vector<int16_t> samples;
+	std::vector<Timestamp> captureTimes;
+
+	//writeStart is bumped before a chunk is written, writeIndex after
+	std::atomic<uint64_t> writeStart, writeIndex;
+};
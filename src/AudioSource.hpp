@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+#include "LatencyHistogram.hpp"
+
+//Source of multichannel audio for SpectrumAnalyzer
+//Audio is delivered to callbacks in chunks of getBlockSize() samples per
+//channel, as getChannelCount() planar buffers that are only valid for the
+//call, along with the time the last sample of the chunk was captured
+
+class AudioSource
+{
+public:
+	typedef std::function<void(const int16_t* const* channels,
+		Timestamp captureTime)> Callback;
+
+	virtual ~AudioSource() = default;
+
+	//Returns an id for removeCallback. Callbacks run on a thread owned by
+	//the source, removeCallback waits for a running call to return, so it
+	//must not be called from inside the callback itself
+	virtual unsigned int addCallback(Callback cb) = 0;
+	virtual void removeCallback(unsigned int id) = 0;
+
+	virtual int startStream() = 0;
+	virtual int stopStream() = 0;
+
+	virtual unsigned int getSampleRate() = 0;
+	virtual unsigned int getBlockSize() = 0;
+	virtual unsigned int getChannelCount() = 0;
+
+	virtual bool isRunning() = 0;
+
+	//Chunks the callback missed because it could not keep up
+	virtual uint64_t getOverrunCount(unsigned int id) = 0;
+};
@@ -0,0 +1,223 @@
+#include "FftEngine.hpp"
+
+#include <cmath>
+#include <climits>
+
+const int FftEngineBase::ERROR_FFTW_ALLOC;
+
+template<typename T>
+BasicFftEngine<T>::BasicFftEngine(unsigned int _size, Mode _mode,
+	unsigned int _channelCount)
+	:	size{_size}
+	,	mode{_mode}
+	,	channelCount{_channelCount}
+	,	batch{(mode == Mode::RealToComplex) ? channelCount : (channelCount + 1)/2}
+	,	kernels(SampleKernels::get())
+	,	realIn{nullptr}
+	,	complexIn{nullptr}
+	,	complexOut{nullptr}
+	,	inputs(_channelCount)
+	,	magnitudes{nullptr} {
+
+	bool allocated;
+
+	if(mode == Mode::RealToComplex) {
+		realIn = Fftw::allocReal(batch * size);
+		complexOut = Fftw::allocComplex(batch * (size/2 + 1));
+
+		allocated = realIn && complexOut;
+	}
+	else {
+		complexIn = Fftw::allocComplex(batch * size);
+		complexOut = Fftw::allocComplex(batch * size);
+
+		allocated = complexIn && complexOut;
+
+		if(channelCount % 2) {
+			silence.resize(size);
+		}
+	}
+
+	magnitudes = Fftw::allocReal(channelCount * (size/2));
+
+	if(!allocated || !magnitudes) {
+		release();
+
+		throw Exception(ERROR_FFTW_ALLOC, "BasicFftEngine::BasicFftEngine: "
+			"Failed to allocate FFT buffers");
+	}
+
+	//Plans come from the shared cache, one batched plan covers every channel
+	try {
+		plan = PlanCache::get().acquire(size, (mode == Mode::RealToComplex) ?
+			PlanCache::Transform::RealToComplex : PlanCache::Transform::Complex,
+			batch);
+	}
+	catch(...) {
+		release();
+
+		throw;
+	}
+}
+
+template<typename T>
+BasicFftEngine<T>::~BasicFftEngine() {
+	release();
+}
+
+template<typename T>
+void BasicFftEngine<T>::release() {
+	//Fftw::free accepts null pointers
+	Fftw::free(realIn);
+	Fftw::free(complexIn);
+	Fftw::free(complexOut);
+	Fftw::free(magnitudes);
+
+	realIn = nullptr;
+	complexIn = nullptr;
+	complexOut = nullptr;
+	magnitudes = nullptr;
+}
+
+template<typename T>
+void BasicFftEngine<T>::execute(const int16_t* const* channels,
+	const T* window) {
+
+	if(mode == Mode::RealToComplex) {
+		executeReal(channels, window);
+	}
+	else {
+		executePacked(channels, window);
+	}
+}
+
+template<typename T>
+void BasicFftEngine<T>::execute(const int16_t* samples, size_t channelStride,
+	const T* window) {
+
+	for(unsigned int channel = 0; channel < channelCount; ++channel) {
+		inputs[channel] = samples + channel*channelStride;
+	}
+
+	execute(inputs.data(), window);
+}
+
+template<typename T>
+void BasicFftEngine<T>::execute(const int16_t* left, const int16_t* right,
+	const T* window) {
+
+	const int16_t* channels[2] = {left, right};
+
+	execute(channels, window);
+}
+
+template<typename T>
+const T* BasicFftEngine<T>::getMagnitudes(unsigned int channel) const {
+	return magnitudes + channel*(size/2);
+}
+
+template<typename T>
+const T* BasicFftEngine<T>::getLeftMagnitudes() const {
+	return getMagnitudes(0);
+}
+
+template<typename T>
+const T* BasicFftEngine<T>::getRightMagnitudes() const {
+	return getMagnitudes(1);
+}
+
+template<typename T>
+unsigned int BasicFftEngine<T>::getSize() const {
+	return size;
+}
+
+template<typename T>
+FftEngineBase::Mode BasicFftEngine<T>::getMode() const {
+	return mode;
+}
+
+template<typename T>
+unsigned int BasicFftEngine<T>::getChannelCount() const {
+	return channelCount;
+}
+
+template<typename T>
+std::vector<T> BasicFftEngine<T>::makeWindow(unsigned int size) {
+	std::vector<T> window(size);
+
+	//Hanning window, computed in double precision
+	for(unsigned int i = 0; i < size; i++) {
+		double w = 0.5 * (1. - std::cos((2*3.141592654*i)/(size - 1)));
+
+		//Scale to [-1., 1.] and normalize by block size
+		window[i] = w / ((double)INT16_MAX * size);
+	}
+
+	return window;
+}
+
+template<typename T>
+void BasicFftEngine<T>::executeReal(const int16_t* const* channels,
+	const T* window) {
+
+	unsigned int bins = size/2 + 1;
+
+	for(unsigned int channel = 0; channel < channelCount; ++channel) {
+		kernels.applyWindow(channels[channel], window, realIn + channel*size,
+			size);
+	}
+
+	Fftw::executeDftR2C(plan->get(), realIn, complexOut);
+
+	for(unsigned int channel = 0; channel < channelCount; ++channel) {
+		const typename Fftw::Complex *out = complexOut + channel*bins;
+		T *mag = magnitudes + channel*(size/2);
+
+		for(unsigned int i = 0; i < size/2; ++i) {
+			mag[i] = std::sqrt(out[i][0]*out[i][0] + out[i][1]*out[i][1]);
+		}
+	}
+}
+
+template<typename T>
+void BasicFftEngine<T>::executePacked(const int16_t* const* channels,
+	const T* window) {
+
+	//z[n] = a[n] + j*b[n] for each pair of channels a, b
+	for(unsigned int pair = 0; pair < batch; ++pair) {
+		unsigned int a = 2*pair, b = a + 1;
+
+		kernels.applyWindowPacked(channels[a],
+			(b < channelCount) ? channels[b] : silence.data(), window,
+			&complexIn[pair*size][0], size);
+	}
+
+	Fftw::executeDft(plan->get(), complexIn, complexOut);
+
+	//Split by conjugate symmetry:
+	//A[k] = (Z[k] + conj(Z[N-k])) / 2
+	//B[k] = (Z[k] - conj(Z[N-k])) / 2j
+	for(unsigned int pair = 0; pair < batch; ++pair) {
+		const typename Fftw::Complex *out = complexOut + pair*size;
+		T *magA = magnitudes + 2*pair*(size/2);
+		bool hasB = (2*pair + 1 < channelCount);
+
+		for(unsigned int k = 0; k < size/2; ++k) {
+			const T *zk = out[k], *zn = out[(size - k) % size];
+
+			T aRe = zk[0] + zn[0], aIm = zk[1] - zn[1];
+
+			magA[k] = T(0.5) * std::sqrt(aRe*aRe + aIm*aIm);
+
+			if(hasB) {
+				T bRe = zk[1] + zn[1], bIm = zk[0] - zn[0];
+
+				magA[size/2 + k] = T(0.5) * std::sqrt(bRe*bRe + bIm*bIm);
+			}
+		}
+	}
+}
+
+//Both precisions are always built, the analyzer uses AnalysisSample
+template class BasicFftEngine<float>;
+template class BasicFftEngine<double>;
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Exception.hpp"
+#include "FftPlanCache.hpp"
+#include "FftwTraits.hpp"
+#include "SampleKernels.hpp"
+
+//Settings shared by every sample type
+class FftEngineBase
+{
+public:
+	enum class Mode {
+		RealToComplex,	//One r2c transform per channel
+		PackedStereo		//Channel pairs in the real and imaginary part of one c2c
+	};
+
+	//Error codes
+	static const int ERROR_FFTW_ALLOC = 0x3000;
+};
+
+//Forward FFT of a block of multichannel audio, producing the magnitude
+//spectrum of each channel. Both modes exploit the input being real, so two
+//channels cost roughly one complex FFT of the block size instead of two.
+//Channels are kept planar (one contiguous block after another) and all of
+//them go through a single batched plan per execute.
+//Instantiated for float and double
+
+template<typename T>
+class BasicFftEngine : public FftEngineBase
+{
+public:
+	typedef T Sample;
+
+	BasicFftEngine(unsigned int size, Mode mode, unsigned int channelCount = 2);
+	~BasicFftEngine();
+
+	//Owns FFTW buffers and plans
+	BasicFftEngine(const BasicFftEngine&) = delete;
+	BasicFftEngine& operator=(const BasicFftEngine&) = delete;
+
+	//Window and transform one block of samples per channel, then compute
+	//the magnitude of bins [0, size/2) for every channel. The window
+	//includes the sample scaling (see makeWindow)
+	void execute(const int16_t* const* channels, const T* window);
+
+	//Channels channelStride samples apart in one buffer
+	void execute(const int16_t* samples, size_t channelStride, const T* window);
+
+	//Stereo engines only
+	void execute(const int16_t* left, const int16_t* right, const T* window);
+
+	//Magnitudes of one channel, size/2 values
+	const T* getMagnitudes(unsigned int channel) const;
+
+	//Channels 0 and 1
+	const T* getLeftMagnitudes() const;
+	const T* getRightMagnitudes() const;
+
+	unsigned int getSize() const;
+	Mode getMode() const;
+	unsigned int getChannelCount() const;
+
+	//Hann window with int16 to [-1, 1] scaling and normalization by the
+	//block size folded in
+	static std::vector<T> makeWindow(unsigned int size);
+
+private:
+	typedef FftwTraits<T> Fftw;
+	typedef BasicFftPlanCache<T> PlanCache;
+
+	void release();
+
+	void executeReal(const int16_t* const* channels, const T* window);
+	void executePacked(const int16_t* const* channels, const T* window);
+
+	unsigned int size;
+	Mode mode;
+	unsigned int channelCount;
+
+	//Transforms per execute: channels for RealToComplex, channel pairs for
+	//PackedStereo
+	unsigned int batch;
+
+	const SampleKernels& kernels;
+
+	//RealToComplex: size real inputs and size/2+1 complex outputs per channel
+	//PackedStereo: size complex inputs and outputs per channel pair
+	T *realIn;
+	typename Fftw::Complex *complexIn, *complexOut;
+
+	//Zeros paired with the last channel when the count is odd
+	std::vector<int16_t> silence;
+
+	//Channel pointers for strided execute
+	std::vector<const int16_t*> inputs;
+
+	//Shared with every engine of the same shape, see FftPlanCache
+	std::shared_ptr<typename PlanCache::SharedPlan> plan;
+
+	//Magnitudes of bins [0, size/2), size/2 per channel
+	T *magnitudes;
+};
+
+typedef BasicFftEngine<AnalysisSample> FftEngine;
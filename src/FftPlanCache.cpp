@@ -0,0 +1,377 @@
+#include "FftPlanCache.hpp"
+
+#include <iostream>
+
+const int FftPlanCacheBase::ERROR_FFTW_ALLOC;
+const int FftPlanCacheBase::ERROR_FFTW_PLAN;
+
+std::mutex FftPlanCacheBase::plannerMutex;
+
+template<typename T>
+BasicFftPlanCache<T>::SharedPlan::SharedPlan(unsigned int _size,
+	Transform _transform, unsigned int _batch, typename Fftw::Plan _plan,
+	bool _final)
+	:	size{_size}
+	,	transform{_transform}
+	,	batch{_batch}
+	,	plan{_plan}
+	,	final{_final} {
+}
+
+template<typename T>
+BasicFftPlanCache<T>::SharedPlan::~SharedPlan() {
+	std::unique_lock<std::mutex> plannerLock(plannerMutex);
+
+	Fftw::destroyPlan(plan.load());
+
+	for(auto retiredPlan : retired) {
+		Fftw::destroyPlan(retiredPlan);
+	}
+}
+
+template<typename T>
+typename BasicFftPlanCache<T>::Fftw::Plan
+BasicFftPlanCache<T>::SharedPlan::get() const {
+	return plan.load(std::memory_order_acquire);
+}
+
+template<typename T>
+bool BasicFftPlanCache<T>::SharedPlan::isFinal() const {
+	return final.load(std::memory_order_acquire);
+}
+
+template<typename T>
+unsigned int BasicFftPlanCache<T>::SharedPlan::getSize() const {
+	return size;
+}
+
+template<typename T>
+FftPlanCacheBase::Transform
+BasicFftPlanCache<T>::SharedPlan::getTransform() const {
+	return transform;
+}
+
+template<typename T>
+unsigned int BasicFftPlanCache<T>::SharedPlan::getBatch() const {
+	return batch;
+}
+
+template<typename T>
+void BasicFftPlanCache<T>::SharedPlan::replace(typename Fftw::Plan newPlan) {
+	//Only the refine thread replaces plans
+	retired.push_back(plan.exchange(newPlan, std::memory_order_acq_rel));
+
+	final.store(true, std::memory_order_release);
+}
+
+template<typename T>
+BasicFftPlanCache<T>& BasicFftPlanCache<T>::get() {
+	//Thread safe static initialization
+	static BasicFftPlanCache cache;
+
+	return cache;
+}
+
+template<typename T>
+BasicFftPlanCache<T>::BasicFftPlanCache()
+	:	strategy{Strategy::Measure}
+	,	refining{false}
+	,	stopRefining{false} {
+}
+
+template<typename T>
+BasicFftPlanCache<T>::~BasicFftPlanCache() {
+	{
+		std::unique_lock<std::mutex> cacheLock(cacheMutex);
+
+		stopRefining = true;
+	}
+
+	refineCondition.notify_all();
+
+	//Lets a re-plan in progress finish so its wisdom is saved
+	if(refineThread.joinable()) {
+		refineThread.join();
+	}
+}
+
+template<typename T>
+bool BasicFftPlanCache<T>::setWisdomFile(const std::string& path) {
+	{
+		std::unique_lock<std::mutex> cacheLock(cacheMutex);
+
+		wisdomFile = path;
+	}
+
+	if(path.empty()) {
+		return false;
+	}
+
+	std::unique_lock<std::mutex> plannerLock(plannerMutex);
+
+	bool loaded = Fftw::importWisdom(path.c_str());
+
+	if(loaded) {
+		std::cout << "[Info] BasicFftPlanCache::setWisdomFile: Loaded wisdom from "
+			<< path << std::endl;
+	}
+	else {
+		std::cout << "[Info] BasicFftPlanCache::setWisdomFile: No wisdom in "
+			<< path << std::endl;
+	}
+
+	return loaded;
+}
+
+template<typename T>
+std::string BasicFftPlanCache<T>::getWisdomFile() const {
+	std::unique_lock<std::mutex> cacheLock(cacheMutex);
+
+	return wisdomFile;
+}
+
+template<typename T>
+bool BasicFftPlanCache<T>::saveWisdom() {
+	std::string path = getWisdomFile();
+
+	if(path.empty()) {
+		return false;
+	}
+
+	std::unique_lock<std::mutex> plannerLock(plannerMutex);
+
+	if(!Fftw::exportWisdom(path.c_str())) {
+		std::cout << "[Warning] BasicFftPlanCache::saveWisdom: Failed to write "
+			<< path << std::endl;
+
+		return false;
+	}
+
+	return true;
+}
+
+template<typename T>
+void BasicFftPlanCache<T>::setStrategy(Strategy _strategy) {
+	std::unique_lock<std::mutex> cacheLock(cacheMutex);
+
+	strategy = _strategy;
+}
+
+template<typename T>
+FftPlanCacheBase::Strategy BasicFftPlanCache<T>::getStrategy() const {
+	std::unique_lock<std::mutex> cacheLock(cacheMutex);
+
+	return strategy;
+}
+
+template<typename T>
+std::shared_ptr<typename BasicFftPlanCache<T>::SharedPlan>
+BasicFftPlanCache<T>::acquire(unsigned int size, Transform transform,
+	unsigned int batch) {
+
+	std::unique_lock<std::mutex> cacheLock(cacheMutex);
+
+	PlanKey key = std::make_tuple(size, transform, batch);
+
+	//Analyzers asking for the same size concurrently wait for one plan
+	//instead of racing
+	planCondition.wait(cacheLock, [this, &key]() {
+			return planning.count(key) == 0;
+		});
+
+	auto found = plans.find(key);
+
+	if(found != plans.end()) {
+		return found->second;
+	}
+
+	//Plan without cacheMutex, so other sizes can be acquired meanwhile
+	Strategy planStrategy = strategy;
+
+	planning.insert(key);
+	cacheLock.unlock();
+
+	typename Fftw::Plan plan = nullptr;
+	bool final = true, measured = false;
+
+	try {
+		switch(planStrategy) {
+			case Strategy::Measure:
+				plan = createPlan(size, transform, batch, FFTW_MEASURE);
+				measured = true;
+			break;
+
+			case Strategy::Patient:
+				plan = createPlan(size, transform, batch, FFTW_PATIENT);
+				measured = true;
+			break;
+
+			case Strategy::Background:
+				plan = createPlan(size, transform, batch,
+					FFTW_PATIENT | FFTW_WISDOM_ONLY);
+
+				if(!plan) {
+					plan = createPlan(size, transform, batch, FFTW_ESTIMATE);
+					final = false;
+				}
+			break;
+		}
+	}
+	catch(...) {
+		cacheLock.lock();
+		planning.erase(key);
+		planCondition.notify_all();
+
+		throw;
+	}
+
+	cacheLock.lock();
+	planning.erase(key);
+	planCondition.notify_all();
+
+	if(!plan) {
+		throw Exception(ERROR_FFTW_PLAN, "BasicFftPlanCache::acquire: "
+			"Failed to create FFT plan");
+	}
+
+	std::shared_ptr<SharedPlan> sharedPlan(
+		new SharedPlan(size, transform, batch, plan, final));
+
+	plans.emplace(key, sharedPlan);
+
+	if(!final) {
+		refineQueue.push_back(sharedPlan);
+
+		if(!refineThread.joinable()) {
+			refineThread = std::thread(&BasicFftPlanCache::refineRoutine, this);
+		}
+
+		refineCondition.notify_all();
+	}
+
+	cacheLock.unlock();
+
+	//Not under cacheMutex, the planner may be busy re-planning
+	if(measured) {
+		saveWisdom();
+	}
+
+	return sharedPlan;
+}
+
+template<typename T>
+void BasicFftPlanCache<T>::waitForRefinement() {
+	std::unique_lock<std::mutex> cacheLock(cacheMutex);
+
+	refineCondition.wait(cacheLock, [this]() {
+			return refineQueue.empty() && !refining;
+		});
+}
+
+template<typename T>
+size_t BasicFftPlanCache<T>::getPlanCount() const {
+	std::unique_lock<std::mutex> cacheLock(cacheMutex);
+
+	return plans.size();
+}
+
+template<typename T>
+typename BasicFftPlanCache<T>::Fftw::Plan
+BasicFftPlanCache<T>::createPlan(unsigned int size, Transform transform,
+	unsigned int batch, unsigned int flags) {
+
+	std::unique_lock<std::mutex> plannerLock(plannerMutex);
+
+	//Buffers come from fftw_malloc like the engine buffers, so the plan's
+	//alignment assumptions hold for the new-array execute
+	typename Fftw::Plan plan;
+
+	if(transform == Transform::RealToComplex) {
+		T *in = Fftw::allocReal(batch * size);
+		typename Fftw::Complex *out = Fftw::allocComplex(batch * (size/2 + 1));
+
+		if(!in || !out) {
+			Fftw::free(in);
+			Fftw::free(out);
+
+			throw Exception(ERROR_FFTW_ALLOC, "BasicFftPlanCache::createPlan: "
+				"Failed to allocate planning buffers");
+		}
+
+		plan = Fftw::planDftR2C(size, batch, in, out, flags);
+
+		Fftw::free(in);
+		Fftw::free(out);
+	}
+	else {
+		typename Fftw::Complex *in = Fftw::allocComplex(batch * size),
+			*out = Fftw::allocComplex(batch * size);
+
+		if(!in || !out) {
+			Fftw::free(in);
+			Fftw::free(out);
+
+			throw Exception(ERROR_FFTW_ALLOC, "BasicFftPlanCache::createPlan: "
+				"Failed to allocate planning buffers");
+		}
+
+		plan = Fftw::planDft(size, batch, in, out, flags);
+
+		Fftw::free(in);
+		Fftw::free(out);
+	}
+
+	return plan;
+}
+
+template<typename T>
+void BasicFftPlanCache<T>::refineRoutine() {
+	std::unique_lock<std::mutex> cacheLock(cacheMutex);
+
+	while(true) {
+		refineCondition.wait(cacheLock, [this]() {
+				return stopRefining || !refineQueue.empty();
+			});
+
+		if(stopRefining) {
+			break;
+		}
+
+		auto sharedPlan = refineQueue.front();
+		refineQueue.pop_front();
+		refining = true;
+
+		//Plan without cacheMutex, so planned sizes can still be acquired.
+		//New sizes wait for plannerMutex, for as long as this plan takes
+		cacheLock.unlock();
+
+		typename Fftw::Plan plan = nullptr;
+
+		try {
+			plan = createPlan(sharedPlan->getSize(), sharedPlan->getTransform(),
+				sharedPlan->getBatch(), FFTW_PATIENT);
+		}
+		catch(const Exception& e) {
+			std::cout << "[Warning] BasicFftPlanCache::refineRoutine: "
+				<< e.what() << std::endl;
+		}
+
+		if(plan) {
+			sharedPlan->replace(plan);
+
+			std::cout << "[Info] BasicFftPlanCache::refineRoutine: Replaced "
+				"estimated plan of size " << sharedPlan->getSize() << std::endl;
+
+			saveWisdom();
+		}
+
+		cacheLock.lock();
+		refining = false;
+
+		refineCondition.notify_all();
+	}
+}
+
+//Both precisions are always built, the analyzer uses AnalysisSample
+template class BasicFftPlanCache<float>;
+template class BasicFftPlanCache<double>;
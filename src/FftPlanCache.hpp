@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "Exception.hpp"
+#include "FftwTraits.hpp"
+
+//Settings shared by every sample type
+class FftPlanCacheBase
+{
+public:
+	enum class Transform {
+		Complex,				//Forward c2c of size complex points
+		RealToComplex		//r2c of size real points
+	};
+
+	enum class Strategy {
+		Measure,		//FFTW_MEASURE on first use of a size
+		Patient,		//FFTW_PATIENT on first use, instant once wisdom has the size
+		Background	//Wisdom if it has the size, otherwise FFTW_ESTIMATE now
+								//and FFTW_PATIENT on a background thread. The planner
+								//is not thread safe, so a size first used while a
+								//re-plan runs waits for that one plan to finish
+	};
+
+	//Error codes
+	static const int ERROR_FFTW_ALLOC = 0x3100;
+	static const int ERROR_FFTW_PLAN = 0x3101;
+
+protected:
+	//The FFTW planner is not thread safe, so every call that creates or
+	//destroys a plan or touches wisdom is serialized on this
+	static std::mutex plannerMutex;
+};
+
+//Process wide cache of FFTW plans, one per size, transform and batch count
+//(transforms per execute), shared by every FftEngine (and so every
+//SpectrumAnalyzer) of that shape. Plans are executed with the new-array
+//interface, which is thread safe, so a single plan serves any number of
+//engines concurrently.
+//Wisdom is loaded from and saved to an optional file so that plans found
+//with FFTW_PATIENT survive restarts
+
+template<typename T>
+class BasicFftPlanCache : public FftPlanCacheBase
+{
+public:
+	typedef FftwTraits<T> Fftw;
+
+	//Plan for one size, transform and batch. With Strategy::Background it
+	//starts as an estimate and is replaced once the patient plan is ready, so
+	//callers fetch it with get() for every execute
+	class SharedPlan
+	{
+	public:
+		~SharedPlan();
+
+		SharedPlan(const SharedPlan&) = delete;
+		SharedPlan& operator=(const SharedPlan&) = delete;
+
+		typename Fftw::Plan get() const;
+
+		//False while an estimated plan waits for re-planning
+		bool isFinal() const;
+
+		unsigned int getSize() const;
+		Transform getTransform() const;
+		unsigned int getBatch() const;
+
+	private:
+		friend class BasicFftPlanCache;
+
+		SharedPlan(unsigned int size, Transform transform, unsigned int batch,
+			typename Fftw::Plan plan, bool final);
+
+		void replace(typename Fftw::Plan newPlan);
+
+		unsigned int size;
+		Transform transform;
+		unsigned int batch;
+
+		std::atomic<typename Fftw::Plan> plan;
+		std::atomic<bool> final;
+
+		//Replaced plans may still be executing on another thread, so they
+		//are destroyed with this object rather than on replacement
+		std::vector<typename Fftw::Plan> retired;
+	};
+
+	static BasicFftPlanCache& get();
+
+	~BasicFftPlanCache();
+
+	BasicFftPlanCache(const BasicFftPlanCache&) = delete;
+	BasicFftPlanCache& operator=(const BasicFftPlanCache&) = delete;
+
+	//Import wisdom from path (if it exists) and save to it whenever new
+	//plans are measured. An empty path disables persistence
+	//Returns true if wisdom was loaded
+	bool setWisdomFile(const std::string& path);
+	std::string getWisdomFile() const;
+
+	//Export the accumulated wisdom now, returns false on failure or when no
+	//wisdom file is set
+	bool saveWisdom();
+
+	//Applies to sizes planned after the call, Measure by default
+	void setStrategy(Strategy strategy);
+	Strategy getStrategy() const;
+
+	//Plan for batch transforms of size, stored back to back in memory
+	//(planar channels), created on first use. Planning a new size does not
+	//hold up callers of sizes already planned
+	std::shared_ptr<SharedPlan> acquire(unsigned int size, Transform transform,
+		unsigned int batch = 1);
+
+	//Blocks until every queued background re-plan has been swapped in
+	void waitForRefinement();
+
+	size_t getPlanCount() const;
+
+private:
+	BasicFftPlanCache();
+
+	//Plan on scratch buffers, the planner may overwrite its arrays
+	//Takes plannerMutex, returns nullptr if FFTW finds no plan
+	typename Fftw::Plan createPlan(unsigned int size, Transform transform,
+		unsigned int batch, unsigned int flags);
+
+	void refineRoutine();
+
+	typedef std::tuple<unsigned int, Transform, unsigned int> PlanKey;
+
+	mutable std::mutex cacheMutex;
+	std::map<PlanKey, std::shared_ptr<SharedPlan>> plans;
+
+	//Keys being planned without cacheMutex, callers of the same key wait on
+	//planCondition for that plan rather than create another
+	std::set<PlanKey> planning;
+	std::condition_variable planCondition;
+	std::string wisdomFile;
+	Strategy strategy;
+
+	//Background re-planning, started on first use
+	std::thread refineThread;
+	std::condition_variable refineCondition;
+	std::deque<std::shared_ptr<SharedPlan>> refineQueue;
+	bool refining, stopRefining;
+};
+
+typedef BasicFftPlanCache<AnalysisSample> FftPlanCache;
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <fftw3.h>
+
+//Sample type of the analysis pipeline
+//Build with -DSPECTRUM_SINGLE_PRECISION for float (fftwf) instead of double
+#ifdef SPECTRUM_SINGLE_PRECISION
+typedef float AnalysisSample;
+#else
+typedef double AnalysisSample;
+#endif
+
+//Maps a sample type to the matching FFTW API: fftw_* for double,
+//fftwf_* for float
+
+template<typename T>
+struct FftwTraits;
+
+template<>
+struct FftwTraits<double>
+{
+	typedef fftw_complex Complex;
+	typedef fftw_plan Plan;
+
+	static double* allocReal(size_t n) {
+		return fftw_alloc_real(n);
+	}
+	static Complex* allocComplex(size_t n) {
+		return fftw_alloc_complex(n);
+	}
+	static void free(void* p) {
+		fftw_free(p);
+	}
+
+	//howmany transforms of size n, stored back to back
+	static Plan planDft(int n, int howmany, Complex* in, Complex* out,
+		unsigned flags) {
+		return fftw_plan_many_dft(1, &n, howmany, in, nullptr, 1, n,
+			out, nullptr, 1, n, FFTW_FORWARD, flags);
+	}
+	static Plan planDftR2C(int n, int howmany, double* in, Complex* out,
+		unsigned flags) {
+		return fftw_plan_many_dft_r2c(1, &n, howmany, in, nullptr, 1, n,
+			out, nullptr, 1, n/2 + 1, flags);
+	}
+	static void destroyPlan(Plan plan) {
+		fftw_destroy_plan(plan);
+	}
+
+	static void executeDft(const Plan plan, Complex* in, Complex* out) {
+		fftw_execute_dft(plan, in, out);
+	}
+	static void executeDftR2C(const Plan plan, double* in, Complex* out) {
+		fftw_execute_dft_r2c(plan, in, out);
+	}
+
+	static bool importWisdom(const char* path) {
+		return fftw_import_wisdom_from_filename(path) != 0;
+	}
+	static bool exportWisdom(const char* path) {
+		return fftw_export_wisdom_to_filename(path) != 0;
+	}
+};
+
+template<>
+struct FftwTraits<float>
+{
+	typedef fftwf_complex Complex;
+	typedef fftwf_plan Plan;
+
+	static float* allocReal(size_t n) {
+		return fftwf_alloc_real(n);
+	}
+	static Complex* allocComplex(size_t n) {
+		return fftwf_alloc_complex(n);
+	}
+	static void free(void* p) {
+		fftwf_free(p);
+	}
+
+	//howmany transforms of size n, stored back to back
+	static Plan planDft(int n, int howmany, Complex* in, Complex* out,
+		unsigned flags) {
+		return fftwf_plan_many_dft(1, &n, howmany, in, nullptr, 1, n,
+			out, nullptr, 1, n, FFTW_FORWARD, flags);
+	}
+	static Plan planDftR2C(int n, int howmany, float* in, Complex* out,
+		unsigned flags) {
+		return fftwf_plan_many_dft_r2c(1, &n, howmany, in, nullptr, 1, n,
+			out, nullptr, 1, n/2 + 1, flags);
+	}
+	static void destroyPlan(Plan plan) {
+		fftwf_destroy_plan(plan);
+	}
+
+	static void executeDft(const Plan plan, Complex* in, Complex* out) {
+		fftwf_execute_dft(plan, in, out);
+	}
+	static void executeDftR2C(const Plan plan, float* in, Complex* out) {
+		fftwf_execute_dft_r2c(plan, in, out);
+	}
+
+	static bool importWisdom(const char* path) {
+		return fftwf_import_wisdom_from_filename(path) != 0;
+	}
+	static bool exportWisdom(const char* path) {
+		return fftwf_export_wisdom_to_filename(path) != 0;
+	}
+};
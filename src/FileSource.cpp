@@ -0,0 +1,250 @@
+#include "FileSource.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "SampleKernels.hpp"
+
+const int FileSource::ERROR_FILE_OPEN;
+const int FileSource::ERROR_FILE_FORMAT;
+
+//Little endian fields, the mapping has no alignment guarantees past the
+//start of the file
+static uint16_t readLE16(const uint8_t* p) {
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t readLE32(const uint8_t* p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+FileSource::FileSource(const std::string& path, unsigned int _blockSize,
+	Pacing _pacing)
+	:	ThreadedSource(0, _blockSize, 0, _pacing)
+	,	fd{-1}
+	,	mapping{nullptr}
+	,	mappingSize{0}
+	,	samples{nullptr}
+	,	length{0}
+	,	position{0} {
+
+	map(path);
+
+	try {
+		parseWav();
+	}
+	catch(...) {
+		if(mapping) {
+			munmap((void*)mapping, mappingSize);
+		}
+
+		close(fd);
+
+		throw;
+	}
+
+	std::cout << "[Info] FileSource::FileSource: " << path << ": "
+		<< channelCount << " channels at " << sampleRate << "Hz, "
+		<< getDuration() << "s" << std::endl;
+}
+
+FileSource::FileSource(const std::string& path, unsigned int _blockSize,
+	unsigned int _sampleRate, unsigned int _channelCount, Pacing _pacing)
+	:	ThreadedSource(_sampleRate, _blockSize, _channelCount, _pacing)
+	,	fd{-1}
+	,	mapping{nullptr}
+	,	mappingSize{0}
+	,	samples{nullptr}
+	,	length{0}
+	,	position{0} {
+
+	if(channelCount == 0) {
+		throw Exception(ERROR_FILE_FORMAT, "FileSource::FileSource: "
+			"Raw input needs at least one channel");
+	}
+
+	map(path);
+
+	samples = (const int16_t*)mapping;
+	length = mappingSize / (sizeof(int16_t) * channelCount);
+}
+
+FileSource::~FileSource() {
+	stopThread();
+
+	if(mapping) {
+		munmap((void*)mapping, mappingSize);
+	}
+
+	close(fd);
+}
+
+uint64_t FileSource::getPosition() const {
+	return position.load(std::memory_order_relaxed);
+}
+
+uint64_t FileSource::getLength() const {
+	return length;
+}
+
+double FileSource::getDuration() const {
+	return (double)length / sampleRate;
+}
+
+void FileSource::map(const std::string& path) {
+	fd = open(path.c_str(), O_RDONLY);
+
+	if(fd < 0) {
+		throw Exception(ERROR_FILE_OPEN, "FileSource::map: "
+			"Failed to open " + path + ": " + std::strerror(errno));
+	}
+
+	struct stat fileStat;
+
+	if(fstat(fd, &fileStat) < 0) {
+		close(fd);
+
+		throw Exception(ERROR_FILE_OPEN, "FileSource::map: "
+			"Failed to stat " + path + ": " + std::strerror(errno));
+	}
+
+	mappingSize = fileStat.st_size;
+
+	if(mappingSize == 0) {
+		//Nothing to map, the file just has no samples
+		return;
+	}
+
+	void *address = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	if(address == MAP_FAILED) {
+		close(fd);
+
+		throw Exception(ERROR_FILE_OPEN, "FileSource::map: "
+			"Failed to map " + path + ": " + std::strerror(errno));
+	}
+
+	//Read once front to back, let the kernel read ahead aggressively
+	madvise(address, mappingSize, MADV_SEQUENTIAL);
+
+	mapping = (const uint8_t*)address;
+}
+
+void FileSource::parseWav() {
+	if(mappingSize < 12 || std::memcmp(mapping, "RIFF", 4) ||
+		std::memcmp(mapping + 8, "WAVE", 4)) {
+
+		throw Exception(ERROR_FILE_FORMAT, "FileSource::parseWav: "
+			"Not a RIFF/WAVE file");
+	}
+
+	bool haveFormat = false;
+	size_t offset = 12;
+
+	while(offset + 8 <= mappingSize) {
+		const uint8_t *chunk = mapping + offset;
+		size_t chunkSize = readLE32(chunk + 4);
+		size_t available = mappingSize - (offset + 8);
+
+		if(!std::memcmp(chunk, "fmt ", 4)) {
+			if(chunkSize < 16 || available < 16) {
+				throw Exception(ERROR_FILE_FORMAT, "FileSource::parseWav: "
+					"Truncated fmt chunk");
+			}
+
+			uint16_t formatTag = readLE16(chunk + 8);
+			uint16_t bitsPerSample = readLE16(chunk + 22);
+
+			//WAVE_FORMAT_EXTENSIBLE keeps the real format in its sub-format GUID
+			if(formatTag == 0xFFFE && chunkSize >= 40 && available >= 40) {
+				formatTag = readLE16(chunk + 32);
+			}
+
+			if(formatTag != 1 || bitsPerSample != 16) {
+				throw Exception(ERROR_FILE_FORMAT, "FileSource::parseWav: "
+					"Only 16 bit PCM is supported");
+			}
+
+			channelCount = readLE16(chunk + 10);
+			sampleRate = readLE32(chunk + 12);
+
+			if(channelCount == 0 || sampleRate == 0) {
+				throw Exception(ERROR_FILE_FORMAT, "FileSource::parseWav: "
+					"Invalid channel count or sample rate");
+			}
+
+			haveFormat = true;
+		}
+		else if(!std::memcmp(chunk, "data", 4)) {
+			if(!haveFormat) {
+				throw Exception(ERROR_FILE_FORMAT, "FileSource::parseWav: "
+					"data chunk before fmt chunk");
+			}
+
+			if((offset + 8) % sizeof(int16_t)) {
+				throw Exception(ERROR_FILE_FORMAT, "FileSource::parseWav: "
+					"Misaligned data chunk");
+			}
+
+			//Recorders that never finalized the header leave the size at 0 or
+			//0xFFFFFFFF, take whatever is in the file
+			if(chunkSize == 0 || chunkSize > available) {
+				chunkSize = available;
+			}
+
+			samples = (const int16_t*)(chunk + 8);
+			length = chunkSize / (sizeof(int16_t) * channelCount);
+
+			return;
+		}
+
+		//Chunks are padded to an even size
+		offset += 8 + chunkSize + (chunkSize & 1);
+	}
+
+	throw Exception(ERROR_FILE_FORMAT, "FileSource::parseWav: "
+		"No data chunk");
+}
+
+bool FileSource::generate(int16_t* const* channels) {
+	uint64_t frame = position.load(std::memory_order_relaxed);
+
+	if(frame >= length) {
+		return false;
+	}
+
+	size_t count = std::min<uint64_t>(blockSize, length - frame);
+	const int16_t *in = samples + frame * channelCount;
+
+	if(channelCount == 2) {
+		SampleKernels::get().deinterleave(in, channels[0], channels[1], count);
+	}
+	else if(channelCount == 1) {
+		std::memcpy(channels[0], in, sizeof(int16_t) * count);
+	}
+	else {
+		for(unsigned int channel = 0; channel < channelCount; ++channel) {
+			int16_t *out = channels[channel];
+
+			for(size_t i = 0; i < count; ++i) {
+				out[i] = in[i*channelCount + channel];
+			}
+		}
+	}
+
+	//Last chunk of the file
+	for(unsigned int channel = 0; channel < channelCount; ++channel) {
+		std::fill(channels[channel] + count, channels[channel] + blockSize, 0);
+	}
+
+	position.store(frame + count, std::memory_order_relaxed);
+
+	return true;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include "Exception.hpp"
+#include "ThreadedSource.hpp"
+
+//16 bit PCM audio from a WAV or raw file, for offline analysis
+//The file is memory mapped. With Free pacing it is fed as fast as the
+//callbacks return, so a slow callback slows the source down instead of
+//losing audio (see SpectrumAnalyzer::OverloadPolicy::Block)
+//Every channel of the file is fed, planar
+
+class FileSource : public ThreadedSource
+{
+public:
+	//Error codes
+	static const int ERROR_FILE_OPEN = 0x4000;
+	static const int ERROR_FILE_FORMAT = 0x4001;
+
+	//WAV file, format from the header
+	FileSource(const std::string& path, unsigned int blockSize,
+		Pacing pacing = Pacing::Free);
+
+	//Headerless little endian interleaved samples
+	FileSource(const std::string& path, unsigned int blockSize,
+		unsigned int sampleRate, unsigned int channelCount,
+		Pacing pacing = Pacing::Free);
+
+	~FileSource();
+
+	//Samples per channel, fed so far and in total
+	uint64_t getPosition() const;
+	uint64_t getLength() const;
+
+	//Length in seconds
+	double getDuration() const;
+
+protected:
+	bool generate(int16_t* const* channels) override;
+
+private:
+	void map(const std::string& path);
+	void parseWav();
+
+	//Memory mapped file
+	int fd;
+	const uint8_t* mapping;
+	size_t mappingSize;
+
+	//Interleaved samples inside the mapping
+	const int16_t* samples;
+	uint64_t length;
+
+	std::atomic<uint64_t> position;
+};
@@ -0,0 +1,90 @@
+#include "FramePool.hpp"
+
+const size_t FramePool::NONE;
+
+SpectrumFrame::SpectrumFrame(const Spectrum& layout,
+	unsigned int channelCount, size_t _index)
+	:	channels(channelCount, layout)
+	,	left(channels[0])
+	,	right(channels[(channelCount > 1) ? 1 : 0])
+	,	sequence{0}
+	,	times{}
+	,	index{_index} {
+
+}
+
+FramePool::FramePool(const Spectrum& layout, size_t frameCount,
+	unsigned int channelCount)
+	:	claimed(new std::atomic<bool>[frameCount])
+	,	published{NONE} {
+
+	for(size_t i = 0; i < frameCount; ++i) {
+		frames.push_back(std::make_shared<SpectrumFrame>(layout, channelCount, i));
+		claimed[i] = false;
+	}
+}
+
+SpectrumFrame* FramePool::acquire() {
+	for(size_t i = 0; i < frames.size(); ++i) {
+		if(claimed[i].exchange(true, std::memory_order_acquire)) {
+			//Another writer has it
+			continue;
+		}
+
+		//Pairs with the fence in getPublished: either the reader sees this
+		//frame is no longer published and drops it, or we see its reference
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if(published.load(std::memory_order_relaxed) == i ||
+			frames[i].use_count() != 1) {
+			
+			//Current snapshot, or still held by a reader
+			claimed[i].store(false, std::memory_order_release);
+			continue;
+		}
+
+		return frames[i].get();
+	}
+
+	return nullptr;
+}
+
+void FramePool::publish(SpectrumFrame* frame) {
+	published.store(frame->index, std::memory_order_seq_cst);
+
+	//Once published, the frame is protected from writers by being the current
+	//snapshot, and afterwards by the references readers take to it
+	claimed[frame->index].store(false, std::memory_order_release);
+}
+
+void FramePool::release(SpectrumFrame* frame) {
+	claimed[frame->index].store(false, std::memory_order_release);
+}
+
+std::shared_ptr<SpectrumFrame> FramePool::share(SpectrumFrame* frame) const {
+	return frames[frame->index];
+}
+
+std::shared_ptr<SpectrumFrame> FramePool::getPublished() const {
+	for(;;) {
+		size_t index = published.load(std::memory_order_acquire);
+
+		if(index == NONE) {
+			return nullptr;
+		}
+
+		std::shared_ptr<SpectrumFrame> frame = frames[index];
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		//If a newer frame was published in between, this one may already have
+		//been reclaimed by a writer before our reference was taken
+		if(published.load(std::memory_order_acquire) == index) {
+			return frame;
+		}
+	}
+}
+
+size_t FramePool::getFrameCount() const {
+	return frames.size();
+}
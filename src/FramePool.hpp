@@ -0,0 +1,84 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+#include "LatencyHistogram.hpp"
+#include "Spectrum.hpp"
+
+//When a frame's block reached each stage of the pipeline
+struct FrameTimes
+{
+	Timestamp capture;	//Newest sample of the block captured
+	Timestamp enqueue;	//Block queued for a worker
+	Timestamp dequeue;	//Worker took the block
+	Timestamp fftDone;	//FFT and binning finished
+	Timestamp publish;	//Frame published to readers and listeners
+};
+
+//Spectrums of every channel produced from one FFT block
+struct SpectrumFrame
+{
+	SpectrumFrame(const Spectrum& layout, unsigned int channelCount,
+		size_t index);
+
+	//Not copyable, left and right refer into channels
+	SpectrumFrame(const SpectrumFrame&) = delete;
+	SpectrumFrame& operator=(const SpectrumFrame&) = delete;
+
+	std::vector<Spectrum> channels;
+
+	//Channels 0 and 1, both channel 0 for mono sources
+	Spectrum &left, &right;
+
+	uint64_t sequence;
+	FrameTimes times;
+
+private:
+	friend class FramePool;
+
+	size_t index;
+};
+
+//Fixed set of preallocated frames with lock-free snapshot publication.
+//Writers claim a frame that is neither published nor held by any reader,
+//fill it, then publish it. Readers copy the published frame's shared_ptr,
+//which keeps it from being reclaimed, so a snapshot is never modified
+//while a reader holds it. Neither side allocates or takes a lock.
+
+class FramePool
+{
+public:
+	FramePool(const Spectrum& layout, size_t frameCount,
+		unsigned int channelCount = 2);
+
+	//Claim a frame for writing
+	//Returns nullptr if every frame is published or held by a reader
+	SpectrumFrame* acquire();
+
+	//Make a claimed frame the current snapshot
+	void publish(SpectrumFrame* frame);
+
+	//Give up a claimed frame without publishing it
+	void release(SpectrumFrame* frame);
+
+	//Shared handle to a claimed or published frame
+	std::shared_ptr<SpectrumFrame> share(SpectrumFrame* frame) const;
+
+	//Most recently published frame, nullptr if nothing was published yet
+	std::shared_ptr<SpectrumFrame> getPublished() const;
+
+	size_t getFrameCount() const;
+
+private:
+	static const size_t NONE = static_cast<size_t>(-1);
+
+	//Owned for the lifetime of the pool, the use count of each pointer
+	//tells whether a reader still holds that frame
+	std::vector<std::shared_ptr<SpectrumFrame>> frames;
+	std::unique_ptr<std::atomic<bool>[]> claimed;
+
+	std::atomic<size_t> published;
+};
@@ -0,0 +1,104 @@
+#include "LatencyHistogram.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+const unsigned int LatencyHistogram::BUCKET_COUNT;
+
+Timestamp getTimestamp() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+LatencyHistogram::LatencyHistogram() {
+	reset();
+}
+
+void LatencyHistogram::record(uint64_t duration) {
+	unsigned int bucket = duration ? 64 - __builtin_clzll(duration) : 0;
+
+	if(bucket >= BUCKET_COUNT) {
+		bucket = BUCKET_COUNT - 1;
+	}
+
+	buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(duration, std::memory_order_relaxed);
+
+	uint64_t previous = max.load(std::memory_order_relaxed);
+
+	while(duration > previous && !max.compare_exchange_weak(previous, duration,
+		std::memory_order_relaxed)) {
+	}
+}
+
+void LatencyHistogram::record(Timestamp start, Timestamp end) {
+	if(start && end >= start) {
+		record(end - start);
+	}
+}
+
+LatencyHistogram::Summary LatencyHistogram::getSummary() const {
+	uint64_t snapshot[BUCKET_COUNT], total = 0;
+
+	for(unsigned int i = 0; i < BUCKET_COUNT; ++i) {
+		snapshot[i] = buckets[i].load(std::memory_order_relaxed);
+		total += snapshot[i];
+	}
+
+	Summary summary{};
+
+	summary.count = total;
+
+	if(total == 0) {
+		return summary;
+	}
+
+	summary.mean = (double)sum.load(std::memory_order_relaxed) /
+		count.load(std::memory_order_relaxed);
+	summary.max = max.load(std::memory_order_relaxed);
+
+	//Interpolation can overshoot inside the top bucket
+	summary.p50 = std::min(summary.max, getPercentile(snapshot, total, 0.50));
+	summary.p90 = std::min(summary.max, getPercentile(snapshot, total, 0.90));
+	summary.p99 = std::min(summary.max, getPercentile(snapshot, total, 0.99));
+
+	return summary;
+}
+
+uint64_t LatencyHistogram::getBucket(unsigned int bucket) const {
+	return buckets[bucket].load(std::memory_order_relaxed);
+}
+
+void LatencyHistogram::reset() {
+	for(auto& bucket : buckets) {
+		bucket.store(0, std::memory_order_relaxed);
+	}
+
+	count.store(0, std::memory_order_relaxed);
+	sum.store(0, std::memory_order_relaxed);
+	max.store(0, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::getPercentile(const uint64_t* snapshot,
+	uint64_t total, double fraction) const {
+
+	double target = fraction * total, seen = 0;
+
+	for(unsigned int i = 0; i < BUCKET_COUNT; ++i) {
+		if(seen + snapshot[i] >= target && snapshot[i] > 0) {
+			if(i == 0) {
+				return 0.;
+			}
+
+			//Bucket i spans [2^(i-1), 2^i)
+			double low = (double)(1ULL << (i - 1)), high = 2. * low;
+
+			return low + (high - low) * (target - seen) / snapshot[i];
+		}
+
+		seen += snapshot[i];
+	}
+
+	return max.load(std::memory_order_relaxed);
+}
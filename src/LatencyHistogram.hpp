@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+//Nanoseconds on std::chrono::steady_clock, shared by every timestamp in
+//the pipeline so stages can be subtracted
+typedef uint64_t Timestamp;
+
+Timestamp getTimestamp();
+
+//Lock-free histogram of durations in nanoseconds, one bucket per power of
+//two. record() is a few relaxed atomic adds, so it can be called from any
+//thread, including the audio thread
+
+class LatencyHistogram
+{
+public:
+	//Bucket n counts durations in [2^(n-1), 2^n), bucket 0 counts zero
+	static const unsigned int BUCKET_COUNT = 64;
+
+	struct Summary {
+		uint64_t count;
+		double mean, max;
+
+		//Estimated by interpolating inside the power of two bucket
+		double p50, p90, p99;
+	};
+
+	LatencyHistogram();
+
+	LatencyHistogram(const LatencyHistogram&) = delete;
+	LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+	void record(uint64_t duration);
+
+	//Duration between two timestamps, ignores end < start
+	void record(Timestamp start, Timestamp end);
+
+	//Not atomic as a whole, a summary taken while recording may be off
+	//by the samples being recorded
+	Summary getSummary() const;
+
+	uint64_t getBucket(unsigned int bucket) const;
+
+	void reset();
+
+private:
+	double getPercentile(const uint64_t* buckets, uint64_t count,
+		double fraction) const;
+
+	std::atomic<uint64_t> buckets[BUCKET_COUNT];
+	std::atomic<uint64_t> count, sum, max;
+};
@@ -0,0 +1,144 @@
+#include "OctaveDecimator.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+const unsigned int OctaveDecimator::TAP_COUNT;
+
+OctaveDecimator::OctaveDecimator(unsigned int levelCount,
+	unsigned int _channelCount, unsigned int blockSize, unsigned int span,
+	unsigned int _maxChunk)
+	:	channelCount{_channelCount}
+	,	maxChunk{_maxChunk}
+	,	levels(std::max(levelCount, 1U)) {
+
+	for(unsigned int k = 1; k < levels.size(); ++k) {
+		Level& level = levels[k];
+
+		level.history = std::make_unique<SampleHistory>(blockSize + (span >> k) + 2,
+			channelCount);
+		level.input.resize(channelCount * (TAP_COUNT - 1 + maxChunk));
+		level.output.resize(channelCount * maxChunk);
+		level.samples.resize(channelCount * maxChunk);
+		level.inputCount = 0;
+
+		for(unsigned int channel = 0; channel < channelCount; ++channel) {
+			level.channels.push_back(&level.samples[channel * maxChunk]);
+		}
+	}
+}
+
+void OctaveDecimator::write(const int16_t* const* channels,
+	unsigned int count) {
+
+	unsigned int stride = TAP_COUNT - 1 + maxChunk;
+
+	for(unsigned int k = 1; k < levels.size(); ++k) {
+		Level& level = levels[k];
+
+		//New input goes after the delay line
+		for(unsigned int channel = 0; channel < channelCount; ++channel) {
+			double *in = &level.input[channel*stride + TAP_COUNT - 1];
+
+			if(k == 1) {
+				for(unsigned int i = 0; i < count; ++i) {
+					in[i] = channels[channel][i];
+				}
+			}
+			else {
+				std::memcpy(in, &levels[k - 1].output[channel * maxChunk],
+					sizeof(double) * count);
+			}
+		}
+
+		count = decimate(level, count);
+
+		for(unsigned int channel = 0; channel < channelCount; ++channel) {
+			const double *out = &level.output[channel * maxChunk];
+			int16_t *samples = level.channels[channel];
+
+			for(unsigned int i = 0; i < count; ++i) {
+				samples[i] = std::lround(std::max((double)INT16_MIN,
+					std::min((double)INT16_MAX, out[i])));
+			}
+		}
+
+		level.history->write(level.channels.data(), count);
+	}
+}
+
+const SampleHistory& OctaveDecimator::getLevel(unsigned int level) const {
+	return *levels[level].history;
+}
+
+unsigned int OctaveDecimator::getLevelCount() const {
+	return levels.size();
+}
+
+const std::vector<double>& OctaveDecimator::getTaps() {
+	//Thread safe static initialization
+	static const std::vector<double> taps = []() {
+		//Blackman windowed sinc with its cutoff at a quarter of the rate,
+		//every other tap away from the center is zero
+		int m = (TAP_COUNT - 1) / 2;
+		std::vector<double> h(TAP_COUNT);
+		double sum = 0.;
+
+		for(int n = -m; n <= m; ++n) {
+			double sinc = (n == 0) ? 0.5 :
+				std::sin(3.141592653589793 * n / 2.) / (3.141592653589793 * n);
+			double x = (double)(n + m) / (TAP_COUNT - 1);
+			double w = 0.42 - 0.5 * std::cos(2*3.141592653589793*x) +
+				0.08 * std::cos(4*3.141592653589793*x);
+
+			h[n + m] = sinc * w;
+			sum += h[n + m];
+		}
+
+		//Unity gain at DC
+		for(auto& tap : h) {
+			tap /= sum;
+		}
+
+		return h;
+	}();
+
+	return taps;
+}
+
+unsigned int OctaveDecimator::decimate(Level& level, unsigned int count) {
+	const double *taps = getTaps().data();
+	unsigned int m = (TAP_COUNT - 1) / 2, stride = TAP_COUNT - 1 + maxChunk;
+
+	//Inputs with an even overall index produce an output
+	unsigned int first = (level.inputCount & 1) ? 1 : 0, produced = 0;
+
+	for(unsigned int channel = 0; channel < channelCount; ++channel) {
+		double *x = &level.input[channel * stride];
+		double *y = &level.output[channel * maxChunk];
+
+		produced = 0;
+
+		for(unsigned int j = first; j < count; j += 2) {
+			//p[0, TAP_COUNT) are the inputs up to and including j
+			const double *p = x + j;
+			double acc = taps[m] * p[m];
+
+			//Symmetric, and the even offsets are zero
+			for(unsigned int t = 1; t <= m; t += 2) {
+				acc += taps[m - t] * (p[m - t] + p[m + t]);
+			}
+
+			y[produced++] = acc;
+		}
+
+		//Keep the last TAP_COUNT - 1 inputs for the next call
+		std::memmove(x, x + count, sizeof(double) * (TAP_COUNT - 1));
+	}
+
+	level.inputCount += count;
+
+	return produced;
+}
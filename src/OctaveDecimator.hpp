@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "SampleHistory.hpp"
+
+//Cascade of halfband decimators for multirate analysis. Level k holds the
+//input at 1/2^k of its sample rate in a SampleHistory of its own, so a
+//small FFT over level k sees the octaves below a quarter of that rate
+//with 2^k times the frequency resolution of the same FFT at full rate.
+//Level 0 is the input itself and is not stored here.
+//Single writer, any number of readers per level (see SampleHistory)
+
+class OctaveDecimator
+{
+public:
+	//Filter length, each level delays its output by (TAP_COUNT - 1)/2
+	//samples at its input rate
+	static const unsigned int TAP_COUNT = 23;
+
+	//levelCount includes level 0, level k keeps blockSize samples plus
+	//span >> k for blocks still waiting to be analyzed. maxChunk is the
+	//largest count passed to write
+	OctaveDecimator(unsigned int levelCount, unsigned int channelCount,
+		unsigned int blockSize, unsigned int span, unsigned int maxChunk);
+
+	//Decimate count new full rate samples of each channel into every level
+	//Level k has produced ceil(n / 2^k) samples after n input samples
+	void write(const int16_t* const* channels, unsigned int count);
+
+	//Level k in [1, getLevelCount())
+	const SampleHistory& getLevel(unsigned int level) const;
+
+	unsigned int getLevelCount() const;
+
+	//Lowpass with a passband to 1/8 and a stopband from 3/8 of the input
+	//rate, so the octave below a quarter of the output rate is alias free
+	static const std::vector<double>& getTaps();
+
+private:
+	struct Level {
+		std::unique_ptr<SampleHistory> history;
+
+		//Last TAP_COUNT - 1 inputs per channel, followed by the new input
+		std::vector<double> input;
+
+		//Output at this level's rate, the next level's input
+		std::vector<double> output;
+		std::vector<int16_t> samples;
+		std::vector<int16_t*> channels;
+
+		//Inputs consumed so far, decides which ones produce an output
+		uint64_t inputCount;
+	};
+
+	//Filter count inputs of each channel (already after the delay line in
+	//level.input) into level.output, returns the number of outputs
+	unsigned int decimate(Level& level, unsigned int count);
+
+	unsigned int channelCount, maxChunk;
+
+	//Index 0 is unused, level 0 is the input
+	std::vector<Level> levels;
+};
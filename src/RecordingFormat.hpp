@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+
+//On-disk layout of spectrum recordings, written by SpectrumRecorder and
+//read by SpectrumPlayer. Native byte order (little endian on every
+//supported platform):
+//	RecordingHeader
+//	binCount + 1 double bin edges, Hz
+//	Frames, each a RecordingFrameHeader followed by payloadSize bytes
+//	indexCount RecordingIndexEntry, one per keyframe
+//	RecordingFooter
+//The index and footer are written when the recording is closed. A
+//recording that was cut short has neither, readers rebuild the index by
+//scanning the frames.
+//Energies are stored as int16 levels, round(dB / dbStep), with
+//RECORDING_NO_ENERGY for silent bins. A frame holds channel 0's levels,
+//then channel 1's, ...
+
+static const uint32_t RECORDING_MAGIC = 0x43525053;				//"SPRC"
+static const uint32_t RECORDING_INDEX_MAGIC = 0x58495053;	//"SPIX"
+static const uint32_t RECORDING_VERSION = 1;
+
+static const int16_t RECORDING_NO_ENERGY = INT16_MIN;
+
+enum class RecordingEncoding : uint32_t {
+	Raw,		//int16 levels
+	Delta		//Change in each level from the previous frame, zigzag and
+					//LEB128 varint coded. Keyframes code the change from 0
+};
+
+struct RecordingHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t channelCount;
+	uint32_t binCount;
+	uint32_t encoding;					//RecordingEncoding
+	uint32_t keyframeInterval;	//Frames between keyframes, at most
+	uint32_t hopSize;						//Samples between frames
+	uint32_t reserved;
+	double sampleRate;
+	double dbStep;
+	int64_t startTime;					//System clock at the start, ns since the epoch
+	uint64_t startTimestamp;		//Timestamp (steady clock) at the same moment
+};
+
+//RecordingFrameHeader::flags
+static const uint32_t RECORDING_KEYFRAME = 1;
+
+struct RecordingFrameHeader
+{
+	uint32_t payloadSize;
+	uint32_t flags;
+	uint64_t sequence;	//SpectrumFrame::sequence
+	uint64_t capture;		//FrameTimes::capture
+};
+
+struct RecordingIndexEntry
+{
+	uint64_t frame;			//Frame number in the recording
+	uint64_t offset;		//Of its RecordingFrameHeader, from the file start
+	uint64_t sequence;
+	uint64_t capture;
+};
+
+struct RecordingFooter
+{
+	uint64_t indexOffset;
+	uint64_t indexCount;
+	uint64_t frameCount;
+	uint32_t magic;			//RECORDING_INDEX_MAGIC
+	uint32_t reserved;
+};
+
+static_assert(sizeof(RecordingHeader) == 64, "RecordingHeader layout");
+static_assert(sizeof(RecordingFrameHeader) == 24,
+	"RecordingFrameHeader layout");
+static_assert(sizeof(RecordingIndexEntry) == 32, "RecordingIndexEntry layout");
+static_assert(sizeof(RecordingFooter) == 32, "RecordingFooter layout");
@@ -0,0 +1,75 @@
+#include "SampleHistory.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+SampleHistory::SampleHistory(unsigned int _capacity,
+	unsigned int _channelCount)
+	:	capacity{_capacity}
+	,	channelCount{_channelCount}
+	,	samples(2 * _capacity * _channelCount)
+	,	writeStart{0}
+	,	writeIndex{0} {
+
+}
+
+void SampleHistory::write(const int16_t* const* channels,
+	unsigned int count) {
+
+	uint64_t index = writeIndex.load(std::memory_order_relaxed);
+
+	//Mark the samples about to be overwritten
+	writeStart.store(index + count, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	unsigned int written = 0;
+
+	while(written < count) {
+		//Copy up to the end of the ring, then wrap around
+		unsigned int offset = (index + written) % capacity;
+		unsigned int run = std::min(count - written, capacity - offset);
+
+		for(unsigned int channel = 0; channel < channelCount; ++channel) {
+			int16_t *ring = &samples[channel * 2 * capacity];
+			const int16_t *in = channels[channel] + written;
+
+			std::memcpy(ring + offset, in, sizeof(int16_t) * run);
+			std::memcpy(ring + offset + capacity, in, sizeof(int16_t) * run);
+		}
+
+		written += run;
+	}
+
+	index += count;
+
+	writeIndex.store(index, std::memory_order_release);
+}
+
+uint64_t SampleHistory::getWriteIndex() const {
+	return writeIndex.load(std::memory_order_acquire);
+}
+
+const int16_t* SampleHistory::getChannel(unsigned int channel,
+	uint64_t start) const {
+
+	return &samples[channel * 2 * capacity + start % capacity];
+}
+
+bool SampleHistory::isIntact(uint64_t start) const {
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	//Sample n shares its slot with sample n + capacity
+	return writeStart.load(std::memory_order_relaxed) <= start + capacity;
+}
+
+size_t SampleHistory::getChannelStride() const {
+	return 2 * capacity;
+}
+
+unsigned int SampleHistory::getCapacity() const {
+	return capacity;
+}
+
+unsigned int SampleHistory::getChannelCount() const {
+	return channelCount;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//History of the most recent samples of every channel for the FFT workers.
+//The ring is mirrored: every sample is stored twice, capacity apart, so any
+//window of up to capacity samples is contiguous in memory and blocks never
+//need to be shifted or copied. Single writer, any number of readers.
+
+class SampleHistory
+{
+public:
+	SampleHistory(unsigned int capacity, unsigned int channelCount = 2);
+
+	//Writer side, count samples of each channel
+	void write(const int16_t* const* channels, unsigned int count);
+
+	//Total number of samples written per channel
+	uint64_t getWriteIndex() const;
+
+	//Contiguous view of samples [start, start + length), length <= capacity
+	//The view is only meaningful while isIntact(start) holds
+	const int16_t* getChannel(unsigned int channel, uint64_t start) const;
+
+	//Distance between the views of consecutive channels
+	size_t getChannelStride() const;
+
+	//Check, after reading a view, that the writer has not begun overwriting
+	//samples from start onwards
+	bool isIntact(uint64_t start) const;
+
+	unsigned int getCapacity() const;
+	unsigned int getChannelCount() const;
+
+private:
+	unsigned int capacity, channelCount;
+
+	//2 * capacity samples per channel, one channel after another
+	std::vector<int16_t> samples;
+
+	//writeStart is bumped before samples are written, writeIndex after
+	std::atomic<uint64_t> writeStart, writeIndex;
+};
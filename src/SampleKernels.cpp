@@ -0,0 +1,1139 @@
+#include "SampleKernels.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <initializer_list>
+
+#if defined(__x86_64__) || defined(__i386__)
+	#define SAMPLE_KERNELS_X86
+	#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+	#define SAMPLE_KERNELS_NEON
+	#include <arm_neon.h>
+#endif
+
+namespace {
+
+//Scalar kernels, also used for the tails of the vector kernels
+
+void deinterleaveScalar(const int16_t* interleaved, int16_t* left,
+	int16_t* right, size_t frames) {
+
+	for(size_t i = 0; i < frames; ++i) {
+		left[i] = interleaved[2*i];
+		right[i] = interleaved[2*i + 1];
+	}
+}
+
+void windowScalar(const int16_t* samples, const double* window, double* out,
+	size_t count) {
+
+	for(size_t i = 0; i < count; ++i) {
+		out[i] = window[i] * samples[i];
+	}
+}
+
+void windowPackedScalar(const int16_t* left, const int16_t* right,
+	const double* window, double* out, size_t count) {
+
+	for(size_t i = 0; i < count; ++i) {
+		out[2*i] = window[i] * left[i];
+		out[2*i + 1] = window[i] * right[i];
+	}
+}
+
+void windowFloatScalar(const int16_t* samples, const float* window,
+	float* out, size_t count) {
+
+	for(size_t i = 0; i < count; ++i) {
+		out[i] = window[i] * samples[i];
+	}
+}
+
+void windowPackedFloatScalar(const int16_t* left, const int16_t* right,
+	const float* window, float* out, size_t count) {
+
+	for(size_t i = 0; i < count; ++i) {
+		out[2*i] = window[i] * left[i];
+		out[2*i + 1] = window[i] * right[i];
+	}
+}
+
+void statsScalar(const double* values, size_t count, double* sum,
+	size_t* minIndex, size_t* maxIndex) {
+
+	double total = 0.;
+	size_t lo = 0, hi = 0;
+
+	for(size_t i = 0; i < count; ++i) {
+		total += values[i];
+
+		if(values[i] < values[lo]) {
+			lo = i;
+		}
+		if(values[i] > values[hi]) {
+			hi = i;
+		}
+	}
+
+	*sum = total;
+	*minIndex = lo;
+	*maxIndex = hi;
+}
+
+void scaleScalar(double* values, double factor, size_t count) {
+	for(size_t i = 0; i < count; ++i) {
+		values[i] *= factor;
+	}
+}
+
+//The vector stats kernels find the extreme values, then this finds where
+//they first occur, which is cheaper than tracking indices in every lane
+void finishStats(const double* values, size_t count, size_t start,
+	double total, double lo, double hi, double* sum, size_t* minIndex,
+	size_t* maxIndex) {
+
+	//Tail
+	for(size_t i = start; i < count; ++i) {
+		total += values[i];
+		lo = std::min(lo, values[i]);
+		hi = std::max(hi, values[i]);
+	}
+
+	*sum = total;
+	*minIndex = std::find(values, values + count, lo) - values;
+	*maxIndex = std::find(values, values + count, hi) - values;
+}
+
+//Fast dB conversion. log2 comes from the exponent bits plus a series for
+//the mantissa, 2^x from a rounded exponent plus a series for the rest.
+//Both stay within about 1e-4 dB of the exact result
+
+const double DB_PER_LOG2 = 6.020599913279624;		//20 / log2(10)
+const double LOG2_PER_DB = 0.16609640474436813;	//log2(10) / 20
+const double LOG2_SERIES = 2.8853900817779268;	//2 / ln(2)
+const double LN2 = 0.6931471805599453;
+const double SQRT2 = 1.4142135623730951;
+
+//Adding 1.5 * 2^52 rounds a double to an integer, which ends up in the low
+//mantissa bits
+const double ROUND_MAGIC = 6755399441055744.;
+const uint64_t ROUND_MAGIC_BITS = 0x4338000000000000ULL;
+
+//Outside these, inputs take the exact path
+const double MAX_EXP2 = 1000.;
+
+const uint64_t MANTISSA_MASK = 0x000FFFFFFFFFFFFFULL;
+const uint64_t ONE_BITS = 0x3FF0000000000000ULL;
+
+//For x in [DBL_MIN, DBL_MAX]
+inline double fastLog2(double x) {
+	uint64_t bits;
+	std::memcpy(&bits, &x, sizeof(bits));
+
+	double e = (double)(int)(bits >> 52) - 1023.;
+
+	//Mantissa in [1, 2), then [sqrt(1/2), sqrt(2)) to keep the series short
+	bits = (bits & MANTISSA_MASK) | ONE_BITS;
+
+	double m;
+	std::memcpy(&m, &bits, sizeof(m));
+
+	if(m > SQRT2) {
+		m *= 0.5;
+		e += 1.;
+	}
+
+	//log2(m) = 2/ln(2) * (t + t^3/3 + t^5/5 + ...), t = (m - 1)/(m + 1)
+	double t = (m - 1.) / (m + 1.), t2 = t*t;
+
+	return e + LOG2_SERIES * t * (1. + t2 * (1./3. + t2 * (1./5.)));
+}
+
+//For x in [-MAX_EXP2, MAX_EXP2]
+inline double fastExp2(double x) {
+	//2^x = 2^n * e^(f ln(2)), n = round(x), f in [-0.5, 0.5]
+	double r = x + ROUND_MAGIC, n = r - ROUND_MAGIC;
+	double y = (x - n) * LN2;
+
+	double p = 1. + y*(1. + y*(1./2. + y*(1./6. + y*(1./24. + y*(1./120.)))));
+
+	uint64_t bits;
+	std::memcpy(&bits, &r, sizeof(bits));
+
+	//2^n straight into the exponent
+	bits = (bits - ROUND_MAGIC_BITS + 1023) << 52;
+
+	double scale;
+	std::memcpy(&scale, &bits, sizeof(scale));
+
+	return p * scale;
+}
+
+void toDbFastScalar(const double* values, double* db, size_t count) {
+	for(size_t i = 0; i < count; ++i) {
+		double x = values[i];
+
+		//Zero, negative, denormal, infinite and NaN energies
+		db[i] = (x >= DBL_MIN && x <= DBL_MAX) ? DB_PER_LOG2 * fastLog2(x) :
+			20. * std::log10(x);
+	}
+}
+
+void fromDbFastScalar(const double* db, double* values, size_t count) {
+	for(size_t i = 0; i < count; ++i) {
+		double x = db[i] * LOG2_PER_DB;
+
+		values[i] = (x >= -MAX_EXP2 && x <= MAX_EXP2) ? fastExp2(x) :
+			std::pow(10., db[i] / 20.);
+	}
+}
+
+#ifdef SAMPLE_KERNELS_X86
+
+//SSE2 kernels, 8 frames per iteration
+
+__attribute__((target("sse2")))
+void deinterleaveSSE2(const int16_t* interleaved, int16_t* left,
+	int16_t* right, size_t frames) {
+
+	size_t i = 0;
+
+	for(; i + 8 <= frames; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(interleaved + 2*i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(interleaved + 2*i + 8));
+
+		//Left is the low half of each 32 bit pair, right the high half
+		__m128i la = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+		__m128i lb = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+		__m128i ra = _mm_srai_epi32(a, 16);
+		__m128i rb = _mm_srai_epi32(b, 16);
+
+		_mm_storeu_si128((__m128i*)(left + i), _mm_packs_epi32(la, lb));
+		_mm_storeu_si128((__m128i*)(right + i), _mm_packs_epi32(ra, rb));
+	}
+
+	deinterleaveScalar(interleaved + 2*i, left + i, right + i, frames - i);
+}
+
+__attribute__((target("sse2")))
+void windowSSE2(const int16_t* samples, const double* window, double* out,
+	size_t count) {
+
+	size_t i = 0;
+
+	for(; i + 8 <= count; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(samples + i));
+
+		//Sign extend to 32 bit
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+
+		__m128d d0 = _mm_cvtepi32_pd(lo);
+		__m128d d1 = _mm_cvtepi32_pd(_mm_shuffle_epi32(lo, 0xEE));
+		__m128d d2 = _mm_cvtepi32_pd(hi);
+		__m128d d3 = _mm_cvtepi32_pd(_mm_shuffle_epi32(hi, 0xEE));
+
+		_mm_storeu_pd(out + i, _mm_mul_pd(d0, _mm_loadu_pd(window + i)));
+		_mm_storeu_pd(out + i + 2, _mm_mul_pd(d1, _mm_loadu_pd(window + i + 2)));
+		_mm_storeu_pd(out + i + 4, _mm_mul_pd(d2, _mm_loadu_pd(window + i + 4)));
+		_mm_storeu_pd(out + i + 6, _mm_mul_pd(d3, _mm_loadu_pd(window + i + 6)));
+	}
+
+	windowScalar(samples + i, window + i, out + i, count - i);
+}
+
+__attribute__((target("sse2")))
+void windowPackedSSE2(const int16_t* left, const int16_t* right,
+	const double* window, double* out, size_t count) {
+
+	size_t i = 0;
+
+	for(; i + 8 <= count; i += 8) {
+		__m128i l = _mm_loadu_si128((const __m128i*)(left + i));
+		__m128i r = _mm_loadu_si128((const __m128i*)(right + i));
+
+		//Interleave to l0/r0/l1/r1..., then each pair converts to one vector
+		__m128i lr[2] = {_mm_unpacklo_epi16(l, r), _mm_unpackhi_epi16(l, r)};
+
+		for(int half = 0; half < 2; ++half) {
+			__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(lr[half], lr[half]), 16);
+			__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(lr[half], lr[half]), 16);
+
+			const double *w = window + i + 4*half;
+			double *o = out + 2*(i + 4*half);
+
+			__m128d w01 = _mm_loadu_pd(w), w23 = _mm_loadu_pd(w + 2);
+
+			_mm_storeu_pd(o, _mm_mul_pd(_mm_cvtepi32_pd(lo),
+				_mm_unpacklo_pd(w01, w01)));
+			_mm_storeu_pd(o + 2, _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(lo, 0xEE)),
+				_mm_unpackhi_pd(w01, w01)));
+			_mm_storeu_pd(o + 4, _mm_mul_pd(_mm_cvtepi32_pd(hi),
+				_mm_unpacklo_pd(w23, w23)));
+			_mm_storeu_pd(o + 6, _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(hi, 0xEE)),
+				_mm_unpackhi_pd(w23, w23)));
+		}
+	}
+
+	windowPackedScalar(left + i, right + i, window + i, out + 2*i, count - i);
+}
+
+__attribute__((target("sse2")))
+void windowFloatSSE2(const int16_t* samples, const float* window, float* out,
+	size_t count) {
+
+	size_t i = 0;
+
+	for(; i + 8 <= count; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(samples + i));
+
+		__m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+		__m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+
+		_mm_storeu_ps(out + i, _mm_mul_ps(lo, _mm_loadu_ps(window + i)));
+		_mm_storeu_ps(out + i + 4, _mm_mul_ps(hi, _mm_loadu_ps(window + i + 4)));
+	}
+
+	windowFloatScalar(samples + i, window + i, out + i, count - i);
+}
+
+__attribute__((target("sse2")))
+void windowPackedFloatSSE2(const int16_t* left, const int16_t* right,
+	const float* window, float* out, size_t count) {
+
+	size_t i = 0;
+
+	for(; i + 8 <= count; i += 8) {
+		__m128i l = _mm_loadu_si128((const __m128i*)(left + i));
+		__m128i r = _mm_loadu_si128((const __m128i*)(right + i));
+
+		__m128i lr[2] = {_mm_unpacklo_epi16(l, r), _mm_unpackhi_epi16(l, r)};
+
+		for(int half = 0; half < 2; ++half) {
+			__m128 lo = _mm_cvtepi32_ps(
+				_mm_srai_epi32(_mm_unpacklo_epi16(lr[half], lr[half]), 16));
+			__m128 hi = _mm_cvtepi32_ps(
+				_mm_srai_epi32(_mm_unpackhi_epi16(lr[half], lr[half]), 16));
+
+			__m128 w = _mm_loadu_ps(window + i + 4*half);
+			float *o = out + 2*(i + 4*half);
+
+			//w0/w0/w1/w1 and w2/w2/w3/w3
+			_mm_storeu_ps(o, _mm_mul_ps(lo, _mm_unpacklo_ps(w, w)));
+			_mm_storeu_ps(o + 4, _mm_mul_ps(hi, _mm_unpackhi_ps(w, w)));
+		}
+	}
+
+	windowPackedFloatScalar(left + i, right + i, window + i, out + 2*i,
+		count - i);
+}
+
+__attribute__((target("sse2")))
+void statsSSE2(const double* values, size_t count, double* sum,
+	size_t* minIndex, size_t* maxIndex) {
+
+	if(count < 4) {
+		statsScalar(values, count, sum, minIndex, maxIndex);
+		return;
+	}
+
+	size_t i = 0;
+	__m128d total = _mm_setzero_pd(), lo = _mm_set1_pd(values[0]), hi = lo;
+
+	for(; i + 2 <= count; i += 2) {
+		__m128d v = _mm_loadu_pd(values + i);
+
+		total = _mm_add_pd(total, v);
+		lo = _mm_min_pd(lo, v);
+		hi = _mm_max_pd(hi, v);
+	}
+
+	double t[2], l[2], h[2];
+
+	_mm_storeu_pd(t, total);
+	_mm_storeu_pd(l, lo);
+	_mm_storeu_pd(h, hi);
+
+	finishStats(values, count, i, t[0] + t[1], std::min(l[0], l[1]),
+		std::max(h[0], h[1]), sum, minIndex, maxIndex);
+}
+
+__attribute__((target("sse2")))
+void scaleSSE2(double* values, double factor, size_t count) {
+	size_t i = 0;
+	__m128d f = _mm_set1_pd(factor);
+
+	for(; i + 4 <= count; i += 4) {
+		_mm_storeu_pd(values + i, _mm_mul_pd(_mm_loadu_pd(values + i), f));
+		_mm_storeu_pd(values + i + 2,
+			_mm_mul_pd(_mm_loadu_pd(values + i + 2), f));
+	}
+
+	scaleScalar(values + i, factor, count - i);
+}
+
+__attribute__((target("sse2")))
+void toDbFastSSE2(const double* values, double* db, size_t count) {
+	const __m128i mantissaMask = _mm_set1_epi64x(MANTISSA_MASK);
+	const __m128i oneBits = _mm_set1_epi64x(ONE_BITS);
+
+	//An 11 bit exponent in the low bits of 2^52, minus 2^52, is its value
+	const __m128i exponentBits = _mm_set1_epi64x(0x4330000000000000LL);
+	const __m128d exponentBias = _mm_set1_pd(4503599627370496. + 1023.);
+
+	const __m128d low = _mm_set1_pd(DBL_MIN), high = _mm_set1_pd(DBL_MAX);
+	const __m128d one = _mm_set1_pd(1.), half = _mm_set1_pd(0.5),
+		sqrt2 = _mm_set1_pd(SQRT2);
+
+	size_t i = 0;
+
+	for(; i + 2 <= count; i += 2) {
+		__m128d x = _mm_loadu_pd(values + i);
+
+		__m128d valid = _mm_and_pd(_mm_cmpge_pd(x, low), _mm_cmple_pd(x, high));
+
+		if(_mm_movemask_pd(valid) != 0x3) {
+			toDbFastScalar(values + i, db + i, 2);
+			continue;
+		}
+
+		__m128i bits = _mm_castpd_si128(x);
+
+		__m128d e = _mm_sub_pd(_mm_castsi128_pd(
+			_mm_or_si128(_mm_srli_epi64(bits, 52), exponentBits)), exponentBias);
+		__m128d m = _mm_castsi128_pd(
+			_mm_or_si128(_mm_and_si128(bits, mantissaMask), oneBits));
+
+		//No blend before SSE4.1, select with masks
+		__m128d big = _mm_cmpgt_pd(m, sqrt2);
+
+		m = _mm_or_pd(_mm_and_pd(big, _mm_mul_pd(m, half)), _mm_andnot_pd(big, m));
+		e = _mm_add_pd(e, _mm_and_pd(big, one));
+
+		__m128d t = _mm_div_pd(_mm_sub_pd(m, one), _mm_add_pd(m, one));
+		__m128d t2 = _mm_mul_pd(t, t);
+
+		__m128d p = _mm_add_pd(_mm_set1_pd(1./3.),
+			_mm_mul_pd(t2, _mm_set1_pd(1./5.)));
+		p = _mm_add_pd(one, _mm_mul_pd(t2, p));
+
+		__m128d log2 = _mm_add_pd(e,
+			_mm_mul_pd(_mm_set1_pd(LOG2_SERIES), _mm_mul_pd(t, p)));
+
+		_mm_storeu_pd(db + i, _mm_mul_pd(_mm_set1_pd(DB_PER_LOG2), log2));
+	}
+
+	toDbFastScalar(values + i, db + i, count - i);
+}
+
+__attribute__((target("sse2")))
+void fromDbFastSSE2(const double* db, double* values, size_t count) {
+	const __m128d magic = _mm_set1_pd(ROUND_MAGIC);
+	const __m128i magicBits = _mm_set1_epi64x(ROUND_MAGIC_BITS - 1023);
+	const __m128d low = _mm_set1_pd(-MAX_EXP2), high = _mm_set1_pd(MAX_EXP2);
+
+	size_t i = 0;
+
+	for(; i + 2 <= count; i += 2) {
+		__m128d x = _mm_mul_pd(_mm_loadu_pd(db + i), _mm_set1_pd(LOG2_PER_DB));
+
+		__m128d valid = _mm_and_pd(_mm_cmpge_pd(x, low), _mm_cmple_pd(x, high));
+
+		if(_mm_movemask_pd(valid) != 0x3) {
+			fromDbFastScalar(db + i, values + i, 2);
+			continue;
+		}
+
+		__m128d r = _mm_add_pd(x, magic);
+		__m128d y = _mm_mul_pd(_mm_sub_pd(x, _mm_sub_pd(r, magic)),
+			_mm_set1_pd(LN2));
+
+		__m128d p = _mm_set1_pd(1./120.);
+
+		for(double c : {1./24., 1./6., 1./2., 1., 1.}) {
+			p = _mm_add_pd(_mm_set1_pd(c), _mm_mul_pd(y, p));
+		}
+
+		__m128d scale = _mm_castsi128_pd(_mm_slli_epi64(
+			_mm_sub_epi64(_mm_castpd_si128(r), magicBits), 52));
+
+		_mm_storeu_pd(values + i, _mm_mul_pd(p, scale));
+	}
+
+	fromDbFastScalar(db + i, values + i, count - i);
+}
+
+//AVX2 kernels, 16 frames per iteration
+
+__attribute__((target("avx2")))
+void deinterleaveAVX2(const int16_t* interleaved, int16_t* left,
+	int16_t* right, size_t frames) {
+
+	size_t i = 0;
+
+	for(; i + 16 <= frames; i += 16) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)(interleaved + 2*i));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(interleaved + 2*i + 16));
+
+		__m256i la = _mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16);
+		__m256i lb = _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16);
+		__m256i ra = _mm256_srai_epi32(a, 16);
+		__m256i rb = _mm256_srai_epi32(b, 16);
+
+		//packs works within 128 bit lanes, restore the order afterwards
+		__m256i l = _mm256_permute4x64_epi64(_mm256_packs_epi32(la, lb), 0xD8);
+		__m256i r = _mm256_permute4x64_epi64(_mm256_packs_epi32(ra, rb), 0xD8);
+
+		_mm256_storeu_si256((__m256i*)(left + i), l);
+		_mm256_storeu_si256((__m256i*)(right + i), r);
+	}
+
+	//Avoid AVX to SSE transition penalties in the code that follows
+	_mm256_zeroupper();
+
+	deinterleaveScalar(interleaved + 2*i, left + i, right + i, frames - i);
+}
+
+__attribute__((target("avx2")))
+void windowAVX2(const int16_t* samples, const double* window, double* out,
+	size_t count) {
+
+	size_t i = 0;
+
+	for(; i + 8 <= count; i += 8) {
+		__m256i v = _mm256_cvtepi16_epi32(
+			_mm_loadu_si128((const __m128i*)(samples + i)));
+
+		__m256d d0 = _mm256_cvtepi32_pd(_mm256_castsi256_si128(v));
+		__m256d d1 = _mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1));
+
+		_mm256_storeu_pd(out + i, _mm256_mul_pd(d0, _mm256_loadu_pd(window + i)));
+		_mm256_storeu_pd(out + i + 4,
+			_mm256_mul_pd(d1, _mm256_loadu_pd(window + i + 4)));
+	}
+
+	//Avoid AVX to SSE transition penalties in the code that follows
+	_mm256_zeroupper();
+
+	windowScalar(samples + i, window + i, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void windowPackedAVX2(const int16_t* left, const int16_t* right,
+	const double* window, double* out, size_t count) {
+
+	size_t i = 0;
+
+	for(; i + 8 <= count; i += 8) {
+		__m128i l = _mm_loadu_si128((const __m128i*)(left + i));
+		__m128i r = _mm_loadu_si128((const __m128i*)(right + i));
+
+		__m128i lr[2] = {_mm_unpacklo_epi16(l, r), _mm_unpackhi_epi16(l, r)};
+
+		for(int half = 0; half < 2; ++half) {
+			//l0/r0/l1/r1/l2/r2/l3/r3 as 32 bit
+			__m256i v = _mm256_cvtepi16_epi32(lr[half]);
+
+			__m256d w = _mm256_loadu_pd(window + i + 4*half);
+			double *o = out + 2*(i + 4*half);
+
+			//w0/w0/w1/w1 and w2/w2/w3/w3
+			_mm256_storeu_pd(o, _mm256_mul_pd(
+				_mm256_cvtepi32_pd(_mm256_castsi256_si128(v)),
+				_mm256_permute4x64_pd(w, 0x50)));
+			_mm256_storeu_pd(o + 4, _mm256_mul_pd(
+				_mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1)),
+				_mm256_permute4x64_pd(w, 0xFA)));
+		}
+	}
+
+	//Avoid AVX to SSE transition penalties in the code that follows
+	_mm256_zeroupper();
+
+	windowPackedScalar(left + i, right + i, window + i, out + 2*i, count - i);
+}
+
+__attribute__((target("avx2")))
+void windowFloatAVX2(const int16_t* samples, const float* window, float* out,
+	size_t count) {
+
+	size_t i = 0;
+
+	for(; i + 16 <= count; i += 16) {
+		__m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(
+			_mm_loadu_si128((const __m128i*)(samples + i))));
+		__m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(
+			_mm_loadu_si128((const __m128i*)(samples + i + 8))));
+
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(lo, _mm256_loadu_ps(window + i)));
+		_mm256_storeu_ps(out + i + 8,
+			_mm256_mul_ps(hi, _mm256_loadu_ps(window + i + 8)));
+	}
+
+	//Avoid AVX to SSE transition penalties in the code that follows
+	_mm256_zeroupper();
+
+	windowFloatScalar(samples + i, window + i, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void windowPackedFloatAVX2(const int16_t* left, const int16_t* right,
+	const float* window, float* out, size_t count) {
+
+	size_t i = 0;
+
+	//Window duplication, w0/w0/w1/w1/w2/w2/w3/w3 and w4/w4/.../w7/w7
+	const __m256i dupLow = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+	const __m256i dupHigh = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+
+	for(; i + 8 <= count; i += 8) {
+		__m128i l = _mm_loadu_si128((const __m128i*)(left + i));
+		__m128i r = _mm_loadu_si128((const __m128i*)(right + i));
+
+		//l0/r0/l1/r1/l2/r2/l3/r3 and l4/r4/.../l7/r7 as float
+		__m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(
+			_mm_unpacklo_epi16(l, r)));
+		__m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(
+			_mm_unpackhi_epi16(l, r)));
+
+		__m256 w = _mm256_loadu_ps(window + i);
+
+		_mm256_storeu_ps(out + 2*i, _mm256_mul_ps(lo,
+			_mm256_permutevar8x32_ps(w, dupLow)));
+		_mm256_storeu_ps(out + 2*i + 8, _mm256_mul_ps(hi,
+			_mm256_permutevar8x32_ps(w, dupHigh)));
+	}
+
+	//Avoid AVX to SSE transition penalties in the code that follows
+	_mm256_zeroupper();
+
+	windowPackedFloatScalar(left + i, right + i, window + i, out + 2*i,
+		count - i);
+}
+
+__attribute__((target("avx2")))
+void statsAVX2(const double* values, size_t count, double* sum,
+	size_t* minIndex, size_t* maxIndex) {
+
+	if(count < 8) {
+		statsScalar(values, count, sum, minIndex, maxIndex);
+		return;
+	}
+
+	size_t i = 0;
+	__m256d total = _mm256_setzero_pd(), lo = _mm256_set1_pd(values[0]),
+		hi = lo;
+
+	for(; i + 4 <= count; i += 4) {
+		__m256d v = _mm256_loadu_pd(values + i);
+
+		total = _mm256_add_pd(total, v);
+		lo = _mm256_min_pd(lo, v);
+		hi = _mm256_max_pd(hi, v);
+	}
+
+	double t[4], l[4], h[4];
+
+	_mm256_storeu_pd(t, total);
+	_mm256_storeu_pd(l, lo);
+	_mm256_storeu_pd(h, hi);
+
+	//Avoid AVX to SSE transition penalties in the code that follows
+	_mm256_zeroupper();
+
+	finishStats(values, count, i, (t[0] + t[1]) + (t[2] + t[3]),
+		std::min(std::min(l[0], l[1]), std::min(l[2], l[3])),
+		std::max(std::max(h[0], h[1]), std::max(h[2], h[3])),
+		sum, minIndex, maxIndex);
+}
+
+__attribute__((target("avx2")))
+void scaleAVX2(double* values, double factor, size_t count) {
+	size_t i = 0;
+	__m256d f = _mm256_set1_pd(factor);
+
+	for(; i + 8 <= count; i += 8) {
+		_mm256_storeu_pd(values + i,
+			_mm256_mul_pd(_mm256_loadu_pd(values + i), f));
+		_mm256_storeu_pd(values + i + 4,
+			_mm256_mul_pd(_mm256_loadu_pd(values + i + 4), f));
+	}
+
+	//Avoid AVX to SSE transition penalties in the code that follows
+	_mm256_zeroupper();
+
+	scaleScalar(values + i, factor, count - i);
+}
+
+__attribute__((target("avx2")))
+void toDbFastAVX2(const double* values, double* db, size_t count) {
+	const __m256i mantissaMask = _mm256_set1_epi64x(MANTISSA_MASK);
+	const __m256i oneBits = _mm256_set1_epi64x(ONE_BITS);
+	const __m256i exponentBits = _mm256_set1_epi64x(0x4330000000000000LL);
+	const __m256d exponentBias = _mm256_set1_pd(4503599627370496. + 1023.);
+
+	const __m256d low = _mm256_set1_pd(DBL_MIN), high = _mm256_set1_pd(DBL_MAX);
+	const __m256d one = _mm256_set1_pd(1.), sqrt2 = _mm256_set1_pd(SQRT2);
+
+	size_t i = 0;
+
+	for(; i + 4 <= count; i += 4) {
+		__m256d x = _mm256_loadu_pd(values + i);
+
+		__m256d valid = _mm256_and_pd(_mm256_cmp_pd(x, low, _CMP_GE_OQ),
+			_mm256_cmp_pd(x, high, _CMP_LE_OQ));
+
+		if(_mm256_movemask_pd(valid) != 0xF) {
+			toDbFastScalar(values + i, db + i, 4);
+			continue;
+		}
+
+		__m256i bits = _mm256_castpd_si256(x);
+
+		__m256d e = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(
+			_mm256_srli_epi64(bits, 52), exponentBits)), exponentBias);
+		__m256d m = _mm256_castsi256_pd(
+			_mm256_or_si256(_mm256_and_si256(bits, mantissaMask), oneBits));
+
+		__m256d big = _mm256_cmp_pd(m, sqrt2, _CMP_GT_OQ);
+
+		m = _mm256_blendv_pd(m, _mm256_mul_pd(m, _mm256_set1_pd(0.5)), big);
+		e = _mm256_add_pd(e, _mm256_and_pd(big, one));
+
+		__m256d t = _mm256_div_pd(_mm256_sub_pd(m, one), _mm256_add_pd(m, one));
+		__m256d t2 = _mm256_mul_pd(t, t);
+
+		__m256d p = _mm256_add_pd(_mm256_set1_pd(1./3.),
+			_mm256_mul_pd(t2, _mm256_set1_pd(1./5.)));
+		p = _mm256_add_pd(one, _mm256_mul_pd(t2, p));
+
+		__m256d log2 = _mm256_add_pd(e,
+			_mm256_mul_pd(_mm256_set1_pd(LOG2_SERIES), _mm256_mul_pd(t, p)));
+
+		_mm256_storeu_pd(db + i, _mm256_mul_pd(_mm256_set1_pd(DB_PER_LOG2), log2));
+	}
+
+	//Avoid AVX to SSE transition penalties in the code that follows
+	_mm256_zeroupper();
+
+	toDbFastScalar(values + i, db + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void fromDbFastAVX2(const double* db, double* values, size_t count) {
+	const __m256d magic = _mm256_set1_pd(ROUND_MAGIC);
+	const __m256i magicBits = _mm256_set1_epi64x(ROUND_MAGIC_BITS - 1023);
+	const __m256d low = _mm256_set1_pd(-MAX_EXP2), high = _mm256_set1_pd(MAX_EXP2);
+
+	size_t i = 0;
+
+	for(; i + 4 <= count; i += 4) {
+		__m256d x = _mm256_mul_pd(_mm256_loadu_pd(db + i),
+			_mm256_set1_pd(LOG2_PER_DB));
+
+		__m256d valid = _mm256_and_pd(_mm256_cmp_pd(x, low, _CMP_GE_OQ),
+			_mm256_cmp_pd(x, high, _CMP_LE_OQ));
+
+		if(_mm256_movemask_pd(valid) != 0xF) {
+			fromDbFastScalar(db + i, values + i, 4);
+			continue;
+		}
+
+		__m256d r = _mm256_add_pd(x, magic);
+		__m256d y = _mm256_mul_pd(_mm256_sub_pd(x, _mm256_sub_pd(r, magic)),
+			_mm256_set1_pd(LN2));
+
+		__m256d p = _mm256_set1_pd(1./120.);
+
+		for(double c : {1./24., 1./6., 1./2., 1., 1.}) {
+			p = _mm256_add_pd(_mm256_set1_pd(c), _mm256_mul_pd(y, p));
+		}
+
+		__m256d scale = _mm256_castsi256_pd(_mm256_slli_epi64(
+			_mm256_sub_epi64(_mm256_castpd_si256(r), magicBits), 52));
+
+		_mm256_storeu_pd(values + i, _mm256_mul_pd(p, scale));
+	}
+
+	//Avoid AVX to SSE transition penalties in the code that follows
+	_mm256_zeroupper();
+
+	fromDbFastScalar(db + i, values + i, count - i);
+}
+
+#endif //SAMPLE_KERNELS_X86
+
+#ifdef SAMPLE_KERNELS_NEON
+
+//NEON kernels (AArch64, which has double precision vectors)
+
+void deinterleaveNEON(const int16_t* interleaved, int16_t* left,
+	int16_t* right, size_t frames) {
+
+	size_t i = 0;
+
+	for(; i + 8 <= frames; i += 8) {
+		int16x8x2_t v = vld2q_s16(interleaved + 2*i);
+
+		vst1q_s16(left + i, v.val[0]);
+		vst1q_s16(right + i, v.val[1]);
+	}
+
+	deinterleaveScalar(interleaved + 2*i, left + i, right + i, frames - i);
+}
+
+inline float64x2_t toDouble(int32x2_t v) {
+	return vcvtq_f64_s64(vmovl_s32(v));
+}
+
+void windowNEON(const int16_t* samples, const double* window, double* out,
+	size_t count) {
+
+	size_t i = 0;
+
+	for(; i + 4 <= count; i += 4) {
+		int32x4_t v = vmovl_s16(vld1_s16(samples + i));
+
+		vst1q_f64(out + i, vmulq_f64(toDouble(vget_low_s32(v)),
+			vld1q_f64(window + i)));
+		vst1q_f64(out + i + 2, vmulq_f64(toDouble(vget_high_s32(v)),
+			vld1q_f64(window + i + 2)));
+	}
+
+	windowScalar(samples + i, window + i, out + i, count - i);
+}
+
+void windowPackedNEON(const int16_t* left, const int16_t* right,
+	const double* window, double* out, size_t count) {
+
+	size_t i = 0;
+
+	for(; i + 4 <= count; i += 4) {
+		//l0/r0/l1/r1 and l2/r2/l3/r3
+		int16x4x2_t lr = vzip_s16(vld1_s16(left + i), vld1_s16(right + i));
+
+		int32x4_t v0 = vmovl_s16(lr.val[0]), v1 = vmovl_s16(lr.val[1]);
+		double *o = out + 2*i;
+
+		vst1q_f64(o, vmulq_f64(toDouble(vget_low_s32(v0)),
+			vld1q_dup_f64(window + i)));
+		vst1q_f64(o + 2, vmulq_f64(toDouble(vget_high_s32(v0)),
+			vld1q_dup_f64(window + i + 1)));
+		vst1q_f64(o + 4, vmulq_f64(toDouble(vget_low_s32(v1)),
+			vld1q_dup_f64(window + i + 2)));
+		vst1q_f64(o + 6, vmulq_f64(toDouble(vget_high_s32(v1)),
+			vld1q_dup_f64(window + i + 3)));
+	}
+
+	windowPackedScalar(left + i, right + i, window + i, out + 2*i, count - i);
+}
+
+void windowFloatNEON(const int16_t* samples, const float* window, float* out,
+	size_t count) {
+
+	size_t i = 0;
+
+	for(; i + 8 <= count; i += 8) {
+		int16x8_t v = vld1q_s16(samples + i);
+
+		float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(v)));
+		float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(v)));
+
+		vst1q_f32(out + i, vmulq_f32(lo, vld1q_f32(window + i)));
+		vst1q_f32(out + i + 4, vmulq_f32(hi, vld1q_f32(window + i + 4)));
+	}
+
+	windowFloatScalar(samples + i, window + i, out + i, count - i);
+}
+
+void windowPackedFloatNEON(const int16_t* left, const int16_t* right,
+	const float* window, float* out, size_t count) {
+
+	size_t i = 0;
+
+	for(; i + 4 <= count; i += 4) {
+		//l0/r0/l1/r1 and l2/r2/l3/r3
+		int16x4x2_t lr = vzip_s16(vld1_s16(left + i), vld1_s16(right + i));
+
+		float32x4_t lo = vcvtq_f32_s32(vmovl_s16(lr.val[0]));
+		float32x4_t hi = vcvtq_f32_s32(vmovl_s16(lr.val[1]));
+
+		//w0/w0/w1/w1 and w2/w2/w3/w3
+		float32x4_t w = vld1q_f32(window + i);
+		float32x4x2_t ww = vzipq_f32(w, w);
+
+		vst1q_f32(out + 2*i, vmulq_f32(lo, ww.val[0]));
+		vst1q_f32(out + 2*i + 4, vmulq_f32(hi, ww.val[1]));
+	}
+
+	windowPackedFloatScalar(left + i, right + i, window + i, out + 2*i,
+		count - i);
+}
+
+void statsNEON(const double* values, size_t count, double* sum,
+	size_t* minIndex, size_t* maxIndex) {
+
+	if(count < 4) {
+		statsScalar(values, count, sum, minIndex, maxIndex);
+		return;
+	}
+
+	size_t i = 0;
+	float64x2_t total = vdupq_n_f64(0.), lo = vdupq_n_f64(values[0]), hi = lo;
+
+	for(; i + 2 <= count; i += 2) {
+		float64x2_t v = vld1q_f64(values + i);
+
+		total = vaddq_f64(total, v);
+		lo = vminq_f64(lo, v);
+		hi = vmaxq_f64(hi, v);
+	}
+
+	finishStats(values, count, i, vaddvq_f64(total), vminvq_f64(lo),
+		vmaxvq_f64(hi), sum, minIndex, maxIndex);
+}
+
+void scaleNEON(double* values, double factor, size_t count) {
+	size_t i = 0;
+	float64x2_t f = vdupq_n_f64(factor);
+
+	for(; i + 4 <= count; i += 4) {
+		vst1q_f64(values + i, vmulq_f64(vld1q_f64(values + i), f));
+		vst1q_f64(values + i + 2, vmulq_f64(vld1q_f64(values + i + 2), f));
+	}
+
+	scaleScalar(values + i, factor, count - i);
+}
+
+void toDbFastNEON(const double* values, double* db, size_t count) {
+	const uint64x2_t mantissaMask = vdupq_n_u64(MANTISSA_MASK);
+	const uint64x2_t oneBits = vdupq_n_u64(ONE_BITS);
+	const float64x2_t one = vdupq_n_f64(1.);
+
+	size_t i = 0;
+
+	for(; i + 2 <= count; i += 2) {
+		float64x2_t x = vld1q_f64(values + i);
+
+		uint64x2_t valid = vandq_u64(vcgeq_f64(x, vdupq_n_f64(DBL_MIN)),
+			vcleq_f64(x, vdupq_n_f64(DBL_MAX)));
+
+		if(!(vgetq_lane_u64(valid, 0) & vgetq_lane_u64(valid, 1))) {
+			toDbFastScalar(values + i, db + i, 2);
+			continue;
+		}
+
+		uint64x2_t bits = vreinterpretq_u64_f64(x);
+
+		float64x2_t e = vsubq_f64(vcvtq_f64_u64(vshrq_n_u64(bits, 52)),
+			vdupq_n_f64(1023.));
+		float64x2_t m = vreinterpretq_f64_u64(
+			vorrq_u64(vandq_u64(bits, mantissaMask), oneBits));
+
+		uint64x2_t big = vcgtq_f64(m, vdupq_n_f64(SQRT2));
+
+		m = vbslq_f64(big, vmulq_f64(m, vdupq_n_f64(0.5)), m);
+		e = vbslq_f64(big, vaddq_f64(e, one), e);
+
+		float64x2_t t = vdivq_f64(vsubq_f64(m, one), vaddq_f64(m, one));
+		float64x2_t t2 = vmulq_f64(t, t);
+
+		float64x2_t p = vaddq_f64(vdupq_n_f64(1./3.),
+			vmulq_f64(t2, vdupq_n_f64(1./5.)));
+		p = vaddq_f64(one, vmulq_f64(t2, p));
+
+		float64x2_t log2 = vaddq_f64(e,
+			vmulq_f64(vdupq_n_f64(LOG2_SERIES), vmulq_f64(t, p)));
+
+		vst1q_f64(db + i, vmulq_f64(vdupq_n_f64(DB_PER_LOG2), log2));
+	}
+
+	toDbFastScalar(values + i, db + i, count - i);
+}
+
+void fromDbFastNEON(const double* db, double* values, size_t count) {
+	size_t i = 0;
+
+	for(; i + 2 <= count; i += 2) {
+		float64x2_t x = vmulq_f64(vld1q_f64(db + i), vdupq_n_f64(LOG2_PER_DB));
+
+		uint64x2_t valid = vandq_u64(vcgeq_f64(x, vdupq_n_f64(-MAX_EXP2)),
+			vcleq_f64(x, vdupq_n_f64(MAX_EXP2)));
+
+		if(!(vgetq_lane_u64(valid, 0) & vgetq_lane_u64(valid, 1))) {
+			fromDbFastScalar(db + i, values + i, 2);
+			continue;
+		}
+
+		//NEON rounds directly, no magic number needed
+		float64x2_t n = vrndnq_f64(x);
+		float64x2_t y = vmulq_f64(vsubq_f64(x, n), vdupq_n_f64(LN2));
+
+		float64x2_t p = vdupq_n_f64(1./120.);
+
+		for(double c : {1./24., 1./6., 1./2., 1., 1.}) {
+			p = vaddq_f64(vdupq_n_f64(c), vmulq_f64(y, p));
+		}
+
+		float64x2_t scale = vreinterpretq_f64_s64(vshlq_n_s64(
+			vaddq_s64(vcvtq_s64_f64(n), vdupq_n_s64(1023)), 52));
+
+		vst1q_f64(values + i, vmulq_f64(p, scale));
+	}
+
+	fromDbFastScalar(db + i, values + i, count - i);
+}
+
+#endif //SAMPLE_KERNELS_NEON
+
+} //namespace
+
+SampleKernels::SampleKernels()
+	:	isa{Isa::Scalar}
+	,	deinterleave{&deinterleaveScalar}
+	,	window{&windowScalar}
+	,	windowPacked{&windowPackedScalar}
+	,	windowFloat{&windowFloatScalar}
+	,	windowPackedFloat{&windowPackedFloatScalar}
+	,	stats{&statsScalar}
+	,	scale{&scaleScalar}
+	,	toDbFast{&toDbFastScalar}
+	,	fromDbFast{&fromDbFastScalar} {
+
+}
+
+const SampleKernels& SampleKernels::get() {
+	//Detected once, thread safe static initialization
+	static const SampleKernels best = []() {
+			for(Isa isa : {Isa::AVX2, Isa::NEON, Isa::SSE2}) {
+				if(isSupported(isa)) {
+					return forIsa(isa);
+				}
+			}
+
+			return forIsa(Isa::Scalar);
+		}();
+
+	return best;
+}
+
+SampleKernels SampleKernels::forIsa(Isa isa) {
+	SampleKernels kernels;
+
+	if(!isSupported(isa)) {
+		return kernels;
+	}
+
+	kernels.isa = isa;
+
+	switch(isa) {
+#ifdef SAMPLE_KERNELS_X86
+	case Isa::SSE2:
+		kernels.deinterleave = &deinterleaveSSE2;
+		kernels.window = &windowSSE2;
+		kernels.windowPacked = &windowPackedSSE2;
+		kernels.windowFloat = &windowFloatSSE2;
+		kernels.windowPackedFloat = &windowPackedFloatSSE2;
+		kernels.stats = &statsSSE2;
+		kernels.scale = &scaleSSE2;
+		kernels.toDbFast = &toDbFastSSE2;
+		kernels.fromDbFast = &fromDbFastSSE2;
+		break;
+
+	case Isa::AVX2:
+		kernels.deinterleave = &deinterleaveAVX2;
+		kernels.window = &windowAVX2;
+		kernels.windowPacked = &windowPackedAVX2;
+		kernels.windowFloat = &windowFloatAVX2;
+		kernels.windowPackedFloat = &windowPackedFloatAVX2;
+		kernels.stats = &statsAVX2;
+		kernels.scale = &scaleAVX2;
+		kernels.toDbFast = &toDbFastAVX2;
+		kernels.fromDbFast = &fromDbFastAVX2;
+		break;
+#endif
+
+#ifdef SAMPLE_KERNELS_NEON
+	case Isa::NEON:
+		kernels.deinterleave = &deinterleaveNEON;
+		kernels.window = &windowNEON;
+		kernels.windowPacked = &windowPackedNEON;
+		kernels.windowFloat = &windowFloatNEON;
+		kernels.windowPackedFloat = &windowPackedFloatNEON;
+		kernels.stats = &statsNEON;
+		kernels.scale = &scaleNEON;
+		kernels.toDbFast = &toDbFastNEON;
+		kernels.fromDbFast = &fromDbFastNEON;
+		break;
+#endif
+
+	default:
+		kernels.isa = Isa::Scalar;
+		break;
+	}
+
+	return kernels;
+}
+
+bool SampleKernels::isSupported(Isa isa) {
+	switch(isa) {
+	case Isa::Scalar:
+		return true;
+
+#ifdef SAMPLE_KERNELS_X86
+	case Isa::SSE2:
+		return __builtin_cpu_supports("sse2");
+
+	case Isa::AVX2:
+		return __builtin_cpu_supports("avx2");
+#endif
+
+#ifdef SAMPLE_KERNELS_NEON
+	case Isa::NEON:
+		//Always present on AArch64
+		return true;
+#endif
+
+	default:
+		return false;
+	}
+}
+
+const char* SampleKernels::getIsaName(Isa isa) {
+	switch(isa) {
+	case Isa::SSE2:
+		return "sse2";
+	case Isa::AVX2:
+		return "avx2";
+	case Isa::NEON:
+		return "neon";
+	default:
+		return "scalar";
+	}
+}
+
+void SampleKernels::quantizeDb(const double* values, double step,
+	int16_t sentinel, int16_t* out, size_t count) const {
+
+	//A block at a time, so no buffer has to be allocated
+	double db[256];
+
+	for(size_t start = 0; start < count; start += 256) {
+		size_t n = std::min(count - start, (size_t)256);
+
+		toDbFast(values + start, db, n);
+
+		for(size_t i = 0; i < n; ++i) {
+			double level = db[i] / step;
+
+			//-inf (and NaN) for silent bins, otherwise clamp to the range
+			out[start + i] = !(level > sentinel) ? sentinel :
+				(int16_t)std::lround(std::min(level, (double)INT16_MAX));
+		}
+	}
+}
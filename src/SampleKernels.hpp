@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+//Vectorized kernels for the loops that touch every audio sample or
+//spectrum bin.
+//The best implementation for the running CPU is picked once at startup,
+//with a scalar fallback.
+
+class SampleKernels
+{
+public:
+	enum class Isa {
+		Scalar,
+		SSE2,
+		AVX2,
+		NEON
+	};
+
+	//l0/r0/l1/r1... to planar left/right
+	typedef void (*Deinterleave)(const int16_t* interleaved, int16_t* left,
+		int16_t* right, size_t frames);
+
+	//out[i] = window[i] * samples[i]
+	//The window table carries the int16 and FFT size normalization
+	typedef void (*Window)(const int16_t* samples, const double* window,
+		double* out, size_t count);
+
+	//out[2i] = window[i] * left[i], out[2i+1] = window[i] * right[i]
+	//(packed stereo FFT input, left real and right imaginary)
+	typedef void (*WindowPacked)(const int16_t* left, const int16_t* right,
+		const double* window, double* out, size_t count);
+
+	//Single precision versions
+	typedef void (*WindowFloat)(const int16_t* samples, const float* window,
+		float* out, size_t count);
+	typedef void (*WindowPackedFloat)(const int16_t* left, const int16_t* right,
+		const float* window, float* out, size_t count);
+
+	//Sum of count values, and the index of the first smallest and largest
+	//(0 for both when count is 0)
+	typedef void (*Stats)(const double* values, size_t count, double* sum,
+		size_t* minIndex, size_t* maxIndex);
+
+	//values[i] *= factor
+	typedef void (*Scale)(double* values, double factor, size_t count);
+
+	//db[i] = 20 * log10(values[i]) and values[i] = 10^(db[i] / 20), to
+	//within about 1e-4 dB. Inputs outside the normal range of doubles
+	//(zero, denormals, infinities) get the exact result
+	typedef void (*ToDb)(const double* values, double* db, size_t count);
+	typedef void (*FromDb)(const double* db, double* values, size_t count);
+
+	//Kernels for the best instruction set this CPU supports
+	static const SampleKernels& get();
+
+	//Kernels for a specific instruction set, falls back to scalar if
+	//it is not supported (used for benchmarking)
+	static SampleKernels forIsa(Isa isa);
+
+	static bool isSupported(Isa isa);
+	static const char* getIsaName(Isa isa);
+
+	//Overloads for code templated on the sample type
+	void applyWindow(const int16_t* samples, const double* w, double* out,
+		size_t count) const {
+		window(samples, w, out, count);
+	}
+	void applyWindow(const int16_t* samples, const float* w, float* out,
+		size_t count) const {
+		windowFloat(samples, w, out, count);
+	}
+	void applyWindowPacked(const int16_t* left, const int16_t* right,
+		const double* w, double* out, size_t count) const {
+		windowPacked(left, right, w, out, count);
+	}
+	void applyWindowPacked(const int16_t* left, const int16_t* right,
+		const float* w, float* out, size_t count) const {
+		windowPackedFloat(left, right, w, out, count);
+	}
+
+	//out[i] = round(dB(values[i]) / step) through toDbFast, clamped to
+	//int16, or sentinel for silent (and NaN) values
+	void quantizeDb(const double* values, double step, int16_t sentinel,
+		int16_t* out, size_t count) const;
+
+	Isa isa;
+	Deinterleave deinterleave;
+	Window window;
+	WindowPacked windowPacked;
+	WindowFloat windowFloat;
+	WindowPackedFloat windowPackedFloat;
+	Stats stats;
+	Scale scale;
+	ToDb toDbFast;
+	FromDb fromDbFast;
+
+private:
+	SampleKernels();
+};
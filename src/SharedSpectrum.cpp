@@ -0,0 +1,298 @@
+#include "SharedSpectrum.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Exception.hpp"
+
+const int SharedSpectrumPublisher::ERROR_SHARED_MEMORY;
+const size_t SharedSpectrumPublisher::DEFAULT_SLOT_COUNT;
+const int SharedSpectrumReader::ERROR_SHARED_MEMORY;
+
+//Keep every section and slot on its own cache lines
+static const size_t ALIGNMENT = 64;
+
+static size_t align(size_t offset) {
+	return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+//Whether count elements of elementSize bytes at offset lie within size
+//bytes, without overflowing on untrusted values
+static bool fits(uint64_t offset, uint64_t count, uint64_t elementSize,
+	uint64_t size) {
+
+	return offset <= size && count <= (size - offset) / elementSize;
+}
+
+static std::string segmentName(const std::string& name) {
+	return (!name.empty() && name[0] == '/') ? name : "/" + name;
+}
+
+SharedSpectrumPublisher::SharedSpectrumPublisher(const std::string& _name,
+	const Spectrum& layout, unsigned int _channelCount, double sampleRate,
+	unsigned int hopSize, size_t slotCount)
+	:	name{segmentName(_name)}
+	,	binCount{layout.getBinCount()}
+	,	channelCount{_channelCount} {
+
+	slotCount = std::max(slotCount, (size_t)1);
+
+	size_t edgesOffset = align(sizeof(SharedSpectrumHeader));
+	size_t centersOffset = edgesOffset + sizeof(double) * (binCount + 1);
+	size_t slotsOffset = align(centersOffset + sizeof(double) * binCount);
+	size_t slotSize = align(sizeof(SharedSpectrumSlot) +
+		sizeof(double) * channelCount * binCount);
+
+	size = slotsOffset + slotCount * slotSize;
+
+	//Replace any segment left behind by a publisher that did not exit cleanly
+	shm_unlink(name.c_str());
+
+	int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+
+	if(fd < 0) {
+		throw Exception(ERROR_SHARED_MEMORY, "SharedSpectrumPublisher::"
+			"SharedSpectrumPublisher: Failed to create " + name + ": " +
+			std::strerror(errno));
+	}
+
+	if(ftruncate(fd, size) < 0) {
+		int error = errno;
+		close(fd);
+		shm_unlink(name.c_str());
+
+		throw Exception(ERROR_SHARED_MEMORY, "SharedSpectrumPublisher::"
+			"SharedSpectrumPublisher: Failed to size " + name + ": " +
+			std::strerror(error));
+	}
+
+	void *address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		fd, 0);
+
+	//The mapping stays valid without the descriptor
+	close(fd);
+
+	if(address == MAP_FAILED) {
+		int error = errno;
+		shm_unlink(name.c_str());
+
+		throw Exception(ERROR_SHARED_MEMORY, "SharedSpectrumPublisher::"
+			"SharedSpectrumPublisher: Failed to map " + name + ": " +
+			std::strerror(error));
+	}
+
+	//The new segment is zero filled, so every slot starts at generation 0
+	mapping = (uint8_t*)address;
+	header = new(mapping) SharedSpectrumHeader;
+
+	header->version = SHARED_SPECTRUM_VERSION;
+	header->channelCount = channelCount;
+	header->binCount = binCount;
+	header->slotCount = slotCount;
+	header->hopSize = hopSize;
+	header->sampleRate = sampleRate;
+	header->edgesOffset = edgesOffset;
+	header->centersOffset = centersOffset;
+	header->slotsOffset = slotsOffset;
+	header->slotSize = slotSize;
+	header->writeIndex.store(0, std::memory_order_relaxed);
+
+	std::memcpy(mapping + edgesOffset, layout.getFreqEdges(),
+		sizeof(double) * (binCount + 1));
+	std::memcpy(mapping + centersOffset, layout.getFreqCenters(),
+		sizeof(double) * binCount);
+
+	for(size_t i = 0; i < slotCount; ++i) {
+		new(mapping + slotsOffset + i * slotSize) SharedSpectrumSlot;
+	}
+
+	//Readers check the magic before anything else
+	header->magic.store(SHARED_SPECTRUM_MAGIC, std::memory_order_release);
+}
+
+SharedSpectrumPublisher::~SharedSpectrumPublisher() {
+	munmap(mapping, size);
+	shm_unlink(name.c_str());
+}
+
+void SharedSpectrumPublisher::publish(const SpectrumFrame& frame) {
+	uint64_t index = header->writeIndex.load(std::memory_order_relaxed);
+
+	auto slot = (SharedSpectrumSlot*)(mapping + header->slotsOffset +
+		(index % header->slotCount) * header->slotSize);
+	auto energies = (double*)(slot + 1);
+
+	//Odd while writing
+	slot->generation.store(2*index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot->sequence = frame.sequence;
+	slot->capture = frame.times.capture;
+
+	for(unsigned int channel = 0; channel < channelCount; ++channel) {
+		std::memcpy(energies + channel * binCount,
+			frame.channels[channel].getEnergies(), sizeof(double) * binCount);
+	}
+
+	slot->generation.store(2*index + 2, std::memory_order_release);
+	header->writeIndex.store(index + 1, std::memory_order_release);
+}
+
+const std::string& SharedSpectrumPublisher::getName() const {
+	return name;
+}
+
+size_t SharedSpectrumPublisher::getSize() const {
+	return size;
+}
+
+SharedSpectrumReader::SharedSpectrumReader(const std::string& _name) {
+	std::string name = segmentName(_name);
+
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+
+	if(fd < 0) {
+		throw Exception(ERROR_SHARED_MEMORY, "SharedSpectrumReader::"
+			"SharedSpectrumReader: Failed to open " + name + ": " +
+			std::strerror(errno));
+	}
+
+	struct stat segmentStat;
+
+	if(fstat(fd, &segmentStat) < 0) {
+		int error = errno;
+		close(fd);
+
+		throw Exception(ERROR_SHARED_MEMORY, "SharedSpectrumReader::"
+			"SharedSpectrumReader: Failed to stat " + name + ": " +
+			std::strerror(error));
+	}
+
+	size = segmentStat.st_size;
+
+	if(size < sizeof(SharedSpectrumHeader)) {
+		close(fd);
+
+		throw Exception(ERROR_SHARED_MEMORY, "SharedSpectrumReader::"
+			"SharedSpectrumReader: " + name + " is not initialized");
+	}
+
+	void *address = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	int error = errno;
+
+	close(fd);
+
+	if(address == MAP_FAILED) {
+		throw Exception(ERROR_SHARED_MEMORY, "SharedSpectrumReader::"
+			"SharedSpectrumReader: Failed to map " + name + ": " +
+			std::strerror(error));
+	}
+
+	mapping = (const uint8_t*)address;
+	header = (const SharedSpectrumHeader*)mapping;
+
+	std::string problem;
+
+	if(header->magic.load(std::memory_order_acquire) != SHARED_SPECTRUM_MAGIC) {
+		problem = " is not initialized";
+	}
+	else if(header->version != SHARED_SPECTRUM_VERSION) {
+		problem = " has layout version " + std::to_string(header->version) +
+			", expected " + std::to_string(SHARED_SPECTRUM_VERSION);
+	}
+	else if(header->channelCount == 0 || header->binCount == 0 ||
+		header->slotCount == 0) {
+		problem = " has no channels, bins or slots";
+	}
+	else if(header->edgesOffset % sizeof(double) != 0 ||
+		header->centersOffset % sizeof(double) != 0 ||
+		header->slotsOffset % alignof(SharedSpectrumSlot) != 0 ||
+		header->slotSize % alignof(SharedSpectrumSlot) != 0 ||
+		header->slotSize < sizeof(SharedSpectrumSlot) ||
+		(header->slotSize - sizeof(SharedSpectrumSlot)) / sizeof(double) <
+			(uint64_t)header->channelCount * header->binCount) {
+		problem = " has a bad layout";
+	}
+	else if(!fits(header->edgesOffset, header->binCount + 1ULL, sizeof(double),
+			size) ||
+		!fits(header->centersOffset, header->binCount, sizeof(double), size) ||
+		!fits(header->slotsOffset, header->slotCount, header->slotSize, size)) {
+		problem = " is truncated";
+	}
+
+	if(!problem.empty()) {
+		munmap((void*)mapping, size);
+
+		throw Exception(ERROR_SHARED_MEMORY, "SharedSpectrumReader::"
+			"SharedSpectrumReader: " + name + problem);
+	}
+}
+
+SharedSpectrumReader::~SharedSpectrumReader() {
+	munmap((void*)mapping, size);
+}
+
+const SharedSpectrumHeader& SharedSpectrumReader::getHeader() const {
+	return *header;
+}
+
+const double* SharedSpectrumReader::getFreqEdges() const {
+	return (const double*)(mapping + header->edgesOffset);
+}
+
+const double* SharedSpectrumReader::getFreqCenters() const {
+	return (const double*)(mapping + header->centersOffset);
+}
+
+uint64_t SharedSpectrumReader::getWriteIndex() const {
+	return header->writeIndex.load(std::memory_order_acquire);
+}
+
+const SharedSpectrumSlot* SharedSpectrumReader::getSlot(uint64_t index) const {
+	return (const SharedSpectrumSlot*)(mapping + header->slotsOffset +
+		(index % header->slotCount) * header->slotSize);
+}
+
+const double* SharedSpectrumReader::getEnergies(uint64_t index) const {
+	auto slot = getSlot(index);
+
+	if(slot->generation.load(std::memory_order_acquire) != 2*index + 2) {
+		return nullptr;
+	}
+
+	return (const double*)(slot + 1);
+}
+
+uint64_t SharedSpectrumReader::getSequence(uint64_t index) const {
+	return getSlot(index)->sequence;
+}
+
+Timestamp SharedSpectrumReader::getCaptureTime(uint64_t index) const {
+	return getSlot(index)->capture;
+}
+
+bool SharedSpectrumReader::isIntact(uint64_t index) const {
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	return getSlot(index)->generation.load(std::memory_order_relaxed) ==
+		2*index + 2;
+}
+
+bool SharedSpectrumReader::read(uint64_t index, double* out) const {
+	const double *energies = getEnergies(index);
+
+	if(!energies) {
+		return false;
+	}
+
+	std::memcpy(out, energies,
+		sizeof(double) * header->channelCount * header->binCount);
+
+	return isIntact(index);
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "FramePool.hpp"
+
+//Frames published to a POSIX shared memory segment for other processes.
+//The segment is a fixed binary layout: a SharedSpectrumHeader, the bin
+//edges and centers, then a ring of slotCount slots. Each slot is a
+//SharedSpectrumSlot followed by channelCount * binCount double energies
+//(channel 0's bins, then channel 1's, ...). All offsets are in bytes from
+//the start of the segment, and everything is in native byte order.
+//Readers map the segment read only, so they can never slow the writer,
+//and use each slot's generation like a seqlock to detect overwrites.
+
+static const uint32_t SHARED_SPECTRUM_MAGIC = 0x43455053; //"SPEC"
+static const uint32_t SHARED_SPECTRUM_VERSION = 1;
+
+struct SharedSpectrumHeader
+{
+	std::atomic<uint32_t> magic;	//SHARED_SPECTRUM_MAGIC once initialized
+	uint32_t version;
+	uint32_t channelCount;
+	uint32_t binCount;
+	uint32_t slotCount;
+	uint32_t hopSize;			//Samples between frames
+	double sampleRate;
+	uint64_t edgesOffset;		//binCount + 1 doubles, Hz
+	uint64_t centersOffset;	//binCount doubles, Hz
+	uint64_t slotsOffset;
+	uint64_t slotSize;
+	std::atomic<uint64_t> writeIndex; //Frames published so far
+};
+
+struct SharedSpectrumSlot
+{
+	//Frame n lives in slot n % slotCount, its generation is 2n + 1 while
+	//it is written and 2n + 2 once complete
+	std::atomic<uint64_t> generation;
+	uint64_t sequence;	//SpectrumFrame::sequence
+	Timestamp capture;
+	uint64_t reserved;
+};
+
+//Other processes rely on this layout, and on the atomics being plain,
+//lock-free words (a lock would live in one process only)
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LONG_LOCK_FREE == 2 &&
+	ATOMIC_LLONG_LOCK_FREE == 2, "Shared spectrum atomics must be lock-free");
+static_assert(sizeof(std::atomic<uint32_t>) == 4 &&
+	sizeof(std::atomic<uint64_t>) == 8 && alignof(std::atomic<uint64_t>) == 8,
+	"Shared spectrum atomics must be the size of their values");
+
+static_assert(sizeof(SharedSpectrumHeader) == 72 &&
+	alignof(SharedSpectrumHeader) == 8, "SharedSpectrumHeader layout");
+static_assert(offsetof(SharedSpectrumHeader, version) == 4 &&
+	offsetof(SharedSpectrumHeader, sampleRate) == 24 &&
+	offsetof(SharedSpectrumHeader, edgesOffset) == 32 &&
+	offsetof(SharedSpectrumHeader, slotSize) == 56 &&
+	offsetof(SharedSpectrumHeader, writeIndex) == 64,
+	"SharedSpectrumHeader layout");
+
+static_assert(sizeof(SharedSpectrumSlot) == 32 &&
+	alignof(SharedSpectrumSlot) == 8, "SharedSpectrumSlot layout");
+static_assert(offsetof(SharedSpectrumSlot, sequence) == 8 &&
+	offsetof(SharedSpectrumSlot, capture) == 16,
+	"SharedSpectrumSlot layout");
+
+//Creates the segment and writes frames into it, single writer
+class SharedSpectrumPublisher
+{
+public:
+	static const int ERROR_SHARED_MEMORY = 0x5000;
+
+	static const size_t DEFAULT_SLOT_COUNT = 64;
+
+	//A name without a leading '/' gets one. An existing segment of the same
+	//name is replaced, readers still mapping it keep the old one
+	SharedSpectrumPublisher(const std::string& name, const Spectrum& layout,
+		unsigned int channelCount, double sampleRate, unsigned int hopSize,
+		size_t slotCount = DEFAULT_SLOT_COUNT);
+
+	//Unlinks the segment
+	~SharedSpectrumPublisher();
+
+	SharedSpectrumPublisher(const SharedSpectrumPublisher&) = delete;
+	SharedSpectrumPublisher& operator=(const SharedSpectrumPublisher&) = delete;
+
+	//Write the next slot
+	void publish(const SpectrumFrame& frame);
+
+	const std::string& getName() const;
+	size_t getSize() const;
+
+private:
+	std::string name;
+	size_t size;
+	uint8_t *mapping;
+	SharedSpectrumHeader *header;
+	size_t binCount;
+	unsigned int channelCount;
+};
+
+//Maps a publisher's segment read only. Any number of readers
+class SharedSpectrumReader
+{
+public:
+	static const int ERROR_SHARED_MEMORY = 0x5001;
+
+	SharedSpectrumReader(const std::string& name);
+	~SharedSpectrumReader();
+
+	SharedSpectrumReader(const SharedSpectrumReader&) = delete;
+	SharedSpectrumReader& operator=(const SharedSpectrumReader&) = delete;
+
+	const SharedSpectrumHeader& getHeader() const;
+	const double* getFreqEdges() const;
+	const double* getFreqCenters() const;
+
+	//Frames published so far, the newest is getWriteIndex() - 1
+	uint64_t getWriteIndex() const;
+
+	//Energies of frame index in the mapping, nullptr if its slot does not
+	//hold it (not yet written, being written or overwritten)
+	//The view is only meaningful while isIntact(index) holds
+	const double* getEnergies(uint64_t index) const;
+
+	//Sequence number and capture time of frame index, check with isIntact
+	uint64_t getSequence(uint64_t index) const;
+	Timestamp getCaptureTime(uint64_t index) const;
+
+	//Check, after reading, that the slot still holds frame index
+	bool isIntact(uint64_t index) const;
+
+	//Copy frame index's energies to out, false if it is not held
+	bool read(uint64_t index, double* out) const;
+
+private:
+	const SharedSpectrumSlot* getSlot(uint64_t index) const;
+
+	size_t size;
+	const uint8_t *mapping;
+	const SharedSpectrumHeader *header;
+};
@@ -0,0 +1,216 @@
+#include "SlidingDft.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+#define TWO_PI	6.283185307179586
+
+const unsigned int SlidingDft::RESYNC_INTERVAL;
+
+SlidingDft::SlidingDft(const std::vector<double>& frequencies,
+	const std::vector<unsigned int>& _windowSizes, double sampleRate,
+	unsigned int _channelCount, unsigned int _snapshotCount)
+	:	binCount(frequencies.size())
+	,	channelCount{_channelCount}
+	,	snapshotCount{_snapshotCount}
+	,	maxWindowSize{*std::max_element(_windowSizes.begin(), _windowSizes.end())}
+	,	windowSizes(_windowSizes)
+	,	stateRe(3 * frequencies.size() * _channelCount)
+	,	stateIm(3 * frequencies.size() * _channelCount)
+	,	position{0}
+	,	lastResync{0}
+	,	resyncNext(frequencies.size() * _channelCount)
+	,	magnitudes(_snapshotCount * _channelCount * frequencies.size())
+	,	writeStart{0}
+	,	writeIndex{0} {
+
+	for(unsigned int bin = 0; bin < binCount; ++bin) {
+		unsigned int n = windowSizes[bin];
+
+		//Resonators at f - fs/N, f and f + fs/N
+		for(int neighbour = -1; neighbour <= 1; ++neighbour) {
+			double w = TWO_PI * frequencies[bin] / sampleRate +
+				neighbour * TWO_PI / n;
+
+			//S(n) = e^jw * (S(n-1) - x[n-N]) + x[n] * e^-jw(N-1)
+			rotRe.push_back(std::cos(w));
+			rotIm.push_back(std::sin(w));
+			inRe.push_back(std::cos(w * (n - 1)));
+			inIm.push_back(-std::sin(w * (n - 1)));
+		}
+	}
+}
+
+void SlidingDft::update(const SampleHistory& history, uint64_t end) {
+	if(end <= position) {
+		return;
+	}
+
+	unsigned int count = end - position, resonators = 3 * binCount;
+
+	//Oldest sample that can leave a window during this update
+	uint64_t outStart = (position >= maxWindowSize) ?
+		position - maxWindowSize : 0;
+
+	for(unsigned int channel = 0; channel < channelCount; ++channel) {
+		const int16_t *in = history.getChannel(channel, position);
+		const int16_t *base = history.getChannel(channel, outStart);
+
+		for(unsigned int bin = 0; bin < binCount; ++bin) {
+			unsigned int n = windowSizes[bin], r = 3 * bin;
+
+			//While the window is still filling up, nothing leaves it for the
+			//first skip samples
+			unsigned int skip = (position >= n) ? 0 :
+				std::min<uint64_t>(n - position, count);
+			const int16_t *out = (skip < count) ?
+				base + (position + skip - n - outStart) : nullptr;
+
+			double *sRe = &stateRe[channel*resonators + r];
+			double *sIm = &stateIm[channel*resonators + r];
+
+			//Keep the three resonators in registers for the whole chunk
+			double re0 = sRe[0], im0 = sIm[0], re1 = sRe[1], im1 = sIm[1],
+				re2 = sRe[2], im2 = sIm[2];
+
+			for(unsigned int i = 0; i < count; ++i) {
+				double xNew = in[i], xOld = (i < skip) ? 0. : out[i - skip];
+				double d;
+
+				d = re0 - xOld;
+				re0 = rotRe[r]*d - rotIm[r]*im0 + xNew*inRe[r];
+				im0 = rotRe[r]*im0 + rotIm[r]*d + xNew*inIm[r];
+
+				d = re1 - xOld;
+				re1 = rotRe[r + 1]*d - rotIm[r + 1]*im1 + xNew*inRe[r + 1];
+				im1 = rotRe[r + 1]*im1 + rotIm[r + 1]*d + xNew*inIm[r + 1];
+
+				d = re2 - xOld;
+				re2 = rotRe[r + 2]*d - rotIm[r + 2]*im2 + xNew*inRe[r + 2];
+				im2 = rotRe[r + 2]*im2 + rotIm[r + 2]*d + xNew*inIm[r + 2];
+			}
+
+			sRe[0] = re0; sIm[0] = im0;
+			sRe[1] = re1; sIm[1] = im1;
+			sRe[2] = re2; sIm[2] = im2;
+		}
+	}
+
+	position = end;
+
+	unsigned int resyncCount = binCount * channelCount;
+
+	if(resyncNext == resyncCount && position >= maxWindowSize &&
+		position - lastResync >= RESYNC_INTERVAL) {
+		resyncNext = 0;
+		lastResync = position;
+	}
+
+	//Resync until the window samples summed are about as many resonator
+	//steps as this update took (at least one bin of one channel), so a
+	//resync never stalls the audio thread
+	uint64_t budget = (uint64_t)count * binCount, spent = 0;
+
+	while(resyncNext < resyncCount && spent < budget) {
+		unsigned int bin = resyncNext / channelCount;
+
+		spent += windowSizes[bin];
+		resync(history, bin, resyncNext++ % channelCount);
+	}
+}
+
+void SlidingDft::snapshot() {
+	uint64_t index = writeIndex.load(std::memory_order_relaxed);
+
+	//Mark the oldest snapshot as being overwritten before touching it
+	writeStart.store(index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	unsigned int resonators = 3 * binCount;
+
+	AnalysisSample *slot = &magnitudes[(index % snapshotCount) *
+		channelCount * binCount];
+
+	for(unsigned int channel = 0; channel < channelCount; ++channel) {
+		const double *sRe = &stateRe[channel * resonators];
+		const double *sIm = &stateIm[channel * resonators];
+
+		for(unsigned int bin = 0; bin < binCount; ++bin) {
+			const unsigned int r = 3 * bin;
+
+			//Hann window in the frequency domain: 0.5*X[k] - 0.25*(X[k-1] + X[k+1])
+			double re = 0.5*sRe[r + 1] - 0.25*(sRe[r] + sRe[r + 2]);
+			double im = 0.5*sIm[r + 1] - 0.25*(sIm[r] + sIm[r + 2]);
+
+			//Same scaling as FftEngine::makeWindow
+			slot[channel*binCount + bin] = std::sqrt(re*re + im*im) /
+				((double)INT16_MAX * windowSizes[bin]);
+		}
+	}
+
+	writeIndex.store(index + 1, std::memory_order_release);
+}
+
+uint64_t SlidingDft::getSnapshotCount() const {
+	return writeIndex.load(std::memory_order_acquire);
+}
+
+const AnalysisSample* SlidingDft::getMagnitudes(uint64_t snapshot,
+	unsigned int channel) const {
+
+	return &magnitudes[((snapshot % snapshotCount) * channelCount + channel) *
+		binCount];
+}
+
+bool SlidingDft::isIntact(uint64_t snapshot) const {
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	//Snapshot n shares its slot with snapshot n + snapshotCount
+	return writeStart.load(std::memory_order_relaxed) <= snapshot + snapshotCount;
+}
+
+unsigned int SlidingDft::getBinCount() const {
+	return binCount;
+}
+
+unsigned int SlidingDft::getWindowSize() const {
+	return maxWindowSize;
+}
+
+double SlidingDft::getFlopsPerSample() const {
+	//Three resonators per bin, 6 multiplies and 5 adds each
+	return 3. * binCount * 11.;
+}
+
+void SlidingDft::resync(const SampleHistory& history, unsigned int bin,
+	unsigned int channel) {
+
+	unsigned int n = windowSizes[bin], r = 3 * bin;
+	const int16_t *window = history.getChannel(channel, position - n);
+
+	//S = sum x[m] * e^-jwm over the window, oldest sample first, with e^-jwm
+	//kept as a phasor per resonator, turned back by one sample at a time
+	double re[3] = {}, im[3] = {}, pRe[3] = {1., 1., 1.}, pIm[3] = {};
+
+	for(unsigned int m = 0; m < n; ++m) {
+		double x = window[m];
+
+		for(unsigned int k = 0; k < 3; ++k) {
+			re[k] += x * pRe[k];
+			im[k] += x * pIm[k];
+
+			double t = pRe[k]*rotRe[r + k] + pIm[k]*rotIm[r + k];
+			pIm[k] = pIm[k]*rotRe[r + k] - pRe[k]*rotIm[r + k];
+			pRe[k] = t;
+		}
+	}
+
+	double *sRe = &stateRe[channel*3*binCount + r];
+	double *sIm = &stateIm[channel*3*binCount + r];
+
+	for(unsigned int k = 0; k < 3; ++k) {
+		sRe[k] = re[k];
+		sIm[k] = im[k];
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "FftwTraits.hpp"
+#include "SampleHistory.hpp"
+
+//Hann windowed DFT at an arbitrary set of frequencies, slid one sample at a
+//time. Each frequency has a window of its own length (so bins can be
+//constant Q) and costs three complex resonators per sample, the frequency
+//and its neighbours a window bin apart, combined into the Hann window in
+//the frequency domain. That is independent of the window length, so a few
+//dozen bins are far cheaper to keep current than a full FFT per block.
+//Magnitudes are scaled like FftEngine's. Single writer; magnitudes are
+//published as numbered snapshots that any thread can read, in the same way
+//SampleHistory publishes samples
+
+class SlidingDft
+{
+public:
+	//Resonators drift by rounding error, so every this many samples they
+	//are recomputed directly from the window. The recomputation is spread
+	//over the updates that follow, a few bins at a time
+	static const unsigned int RESYNC_INTERVAL = 1 << 20;
+
+	//One window length per frequency
+	SlidingDft(const std::vector<double>& frequencies,
+		const std::vector<unsigned int>& windowSizes, double sampleRate,
+		unsigned int channelCount, unsigned int snapshotCount);
+
+	//Slide every window forward to end with sample end - 1. history must
+	//hold the longest window plus the new samples
+	void update(const SampleHistory& history, uint64_t end);
+
+	//Publish the current magnitudes as the next snapshot
+	void snapshot();
+
+	//Snapshots published so far
+	uint64_t getSnapshotCount() const;
+
+	//Magnitudes of every frequency for one channel of a snapshot
+	//Only meaningful while isIntact(snapshot) holds
+	const AnalysisSample* getMagnitudes(uint64_t snapshot,
+		unsigned int channel) const;
+
+	bool isIntact(uint64_t snapshot) const;
+
+	unsigned int getBinCount() const;
+
+	//Longest window
+	unsigned int getWindowSize() const;
+
+	//Estimated floating point operations per sample and channel
+	double getFlopsPerSample() const;
+
+private:
+	//Recompute the resonators of one bin and channel from the window
+	//ending at position
+	void resync(const SampleHistory& history, unsigned int bin,
+		unsigned int channel);
+
+	unsigned int binCount, channelCount, snapshotCount, maxWindowSize;
+	std::vector<unsigned int> windowSizes;
+
+	//Per resonator (three per bin): rotation by one sample, and the factor
+	//for a sample entering at the end of the window
+	std::vector<double> rotRe, rotIm, inRe, inIm;
+
+	//Resonator states per channel
+	std::vector<double> stateRe, stateIm;
+
+	uint64_t position, lastResync;
+	//Next bin and channel to resync, as bin * channelCount + channel,
+	//binCount * channelCount between resyncs
+	unsigned int resyncNext;
+
+	//snapshotCount slots of channelCount * binCount magnitudes
+	std::vector<AnalysisSample> magnitudes;
+	std::atomic<uint64_t> writeStart, writeIndex;
+};
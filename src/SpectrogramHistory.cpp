@@ -0,0 +1,252 @@
+#include "SpectrogramHistory.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+
+#include "SampleKernels.hpp"
+
+const double SpectrogramHistory::DB_STEP = 0.01;
+const int16_t SpectrogramHistory::NO_ENERGY;
+
+SpectrogramHistory::SpectrogramHistory(size_t _capacity,
+	unsigned int _channelCount, size_t _binCount, Format _format)
+	:	capacity{std::max(_capacity, (size_t)1)}
+	,	binCount{_binCount}
+	,	rowStride{_channelCount * _binCount}
+	,	channelCount{_channelCount}
+	,	format{_format}
+	,	sequences(capacity)
+	,	captureTimes(capacity)
+	,	writeStart{0}
+	,	writeIndex{0} {
+
+	if(format == Format::Float) {
+		energies.resize(2 * capacity * rowStride);
+	}
+	else {
+		levels.resize(2 * capacity * rowStride);
+	}
+}
+
+void SpectrogramHistory::append(const SpectrumFrame& frame) {
+	uint64_t index = writeIndex.load(std::memory_order_relaxed);
+
+	//Mark the row about to be overwritten
+	writeStart.store(index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	size_t offset = (index % capacity) * rowStride;
+	size_t mirror = offset + capacity * rowStride;
+
+	for(unsigned int channel = 0; channel < channelCount; ++channel) {
+		const double *in = frame.channels[channel].getEnergies();
+		size_t start = channel * binCount;
+
+		if(format == Format::Float) {
+			float *row = &energies[offset + start];
+
+			for(size_t i = 0; i < binCount; ++i) {
+				row[i] = in[i];
+			}
+
+			std::memcpy(&energies[mirror + start], row, sizeof(float) * binCount);
+		}
+		else {
+			int16_t *row = &levels[offset + start];
+
+			SampleKernels::get().quantizeDb(in, DB_STEP, NO_ENERGY, row, binCount);
+
+			std::memcpy(&levels[mirror + start], row, sizeof(int16_t) * binCount);
+		}
+	}
+
+	sequences[index % capacity] = frame.sequence;
+	captureTimes[index % capacity] = frame.times.capture;
+
+	writeIndex.store(index + 1, std::memory_order_release);
+}
+
+uint64_t SpectrogramHistory::getWriteIndex() const {
+	return writeIndex.load(std::memory_order_acquire);
+}
+
+uint64_t SpectrogramHistory::getOldestIndex() const {
+	uint64_t index = getWriteIndex();
+
+	return (index > capacity) ? index - capacity : 0;
+}
+
+const float* SpectrogramHistory::getRows(uint64_t start) const {
+	if(format != Format::Float) {
+		return nullptr;
+	}
+
+	return &energies[(start % capacity) * rowStride];
+}
+
+const int16_t* SpectrogramHistory::getRowsDB(uint64_t start) const {
+	if(format != Format::DecibelInt16) {
+		return nullptr;
+	}
+
+	return &levels[(start % capacity) * rowStride];
+}
+
+uint64_t SpectrogramHistory::getSequence(uint64_t row) const {
+	return sequences[row % capacity];
+}
+
+Timestamp SpectrogramHistory::getCaptureTime(uint64_t row) const {
+	return captureTimes[row % capacity];
+}
+
+template<typename Before>
+uint64_t SpectrogramHistory::search(Before before) const {
+	//Skip the oldest row, it may be overwritten at any moment
+	uint64_t end = getWriteIndex(), first = getOldestIndex();
+
+	if(end - first == capacity) {
+		++first;
+	}
+
+	//Binary search, both keys increase with the row
+	while(first < end) {
+		uint64_t middle = first + (end - first) / 2;
+
+		if(before(middle)) {
+			first = middle + 1;
+		}
+		else {
+			end = middle;
+		}
+	}
+
+	return first;
+}
+
+uint64_t SpectrogramHistory::findSequence(uint64_t sequence) const {
+	return search([this, sequence](uint64_t row) {
+			return getSequence(row) < sequence;
+		});
+}
+
+uint64_t SpectrogramHistory::findTime(Timestamp time) const {
+	return search([this, time](uint64_t row) {
+			return getCaptureTime(row) < time;
+		});
+}
+
+bool SpectrogramHistory::isWritten(uint64_t start, size_t count) const {
+	uint64_t end = getWriteIndex();
+
+	return count <= capacity && start <= end && count <= end - start;
+}
+
+bool SpectrogramHistory::isIntact(uint64_t start) const {
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	//Row n shares its slot with row n + capacity
+	return writeStart.load(std::memory_order_relaxed) <= start + capacity;
+}
+
+template<typename T>
+size_t SpectrogramHistory::decimateRows(const T* rows, size_t count,
+	unsigned int factor, Reduction reduction, T* out) const {
+
+	factor = std::max(factor, 1U);
+
+	size_t outCount = 0;
+
+	for(size_t first = 0; first < count; first += factor, ++outCount) {
+		size_t groupSize = std::min((size_t)factor, count - first);
+		const T *group = rows + first * rowStride;
+		T *row = out + outCount * rowStride;
+
+		if(reduction == Reduction::Max) {
+			std::copy(group, group + rowStride, row);
+
+			for(size_t r = 1; r < groupSize; ++r) {
+				const T *in = group + r * rowStride;
+
+				for(size_t i = 0; i < rowStride; ++i) {
+					row[i] = std::max(row[i], in[i]);
+				}
+			}
+		}
+		else {
+			//Accumulate in double, then round back to the row type
+			for(size_t i = 0; i < rowStride; ++i) {
+				double sum = 0.;
+				size_t levelCount = 0;
+
+				for(size_t r = 0; r < groupSize; ++r) {
+					T value = group[r * rowStride + i];
+
+					//A silent DecibelInt16 bin has no level to average
+					if(std::is_integral<T>::value && value == (T)NO_ENERGY) {
+						continue;
+					}
+
+					sum += value;
+					++levelCount;
+				}
+
+				if(levelCount == 0) {
+					row[i] = (T)NO_ENERGY;
+				}
+				else {
+					row[i] = (std::is_integral<T>::value) ?
+						(T)std::lround(sum / levelCount) : (T)(sum / levelCount);
+				}
+			}
+		}
+	}
+
+	return outCount;
+}
+
+size_t SpectrogramHistory::decimate(uint64_t start, size_t count,
+	unsigned int factor, Reduction reduction, float* out) const {
+
+	if(format != Format::Float || !isWritten(start, count)) {
+		return 0;
+	}
+
+	size_t rows = decimateRows(getRows(start), count, factor, reduction, out);
+
+	return isIntact(start) ? rows : 0;
+}
+
+size_t SpectrogramHistory::decimate(uint64_t start, size_t count,
+	unsigned int factor, Reduction reduction, int16_t* out) const {
+
+	if(format != Format::DecibelInt16 || !isWritten(start, count)) {
+		return 0;
+	}
+
+	size_t rows = decimateRows(getRowsDB(start), count, factor, reduction, out);
+
+	return isIntact(start) ? rows : 0;
+}
+
+size_t SpectrogramHistory::getCapacity() const {
+	return capacity;
+}
+
+size_t SpectrogramHistory::getRowStride() const {
+	return rowStride;
+}
+
+size_t SpectrogramHistory::getBinCount() const {
+	return binCount;
+}
+
+unsigned int SpectrogramHistory::getChannelCount() const {
+	return channelCount;
+}
+
+SpectrogramHistory::Format SpectrogramHistory::getFormat() const {
+	return format;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "FramePool.hpp"
+
+//The most recent frames of every channel's bin energies, one row per frame
+//(channel 0's bins, then channel 1's, ...). Rows are stored as float
+//energies or as int16 dB in steps of DB_STEP, and the ring is mirrored like
+//SampleHistory, so any run of up to capacity rows is contiguous and range
+//queries return pointers into the ring. Single writer, any number of readers.
+
+class SpectrogramHistory
+{
+public:
+	enum class Format {
+		Float,				//Energies, as in Spectrum
+		DecibelInt16	//Rounded dB / DB_STEP, NO_ENERGY for silent bins
+	};
+
+	//How decimate combines rows
+	enum class Reduction {
+		Max,
+		Mean
+	};
+
+	static const double DB_STEP;
+	static const int16_t NO_ENERGY = INT16_MIN;
+
+	SpectrogramHistory(size_t capacity, unsigned int channelCount,
+		size_t binCount, Format format = Format::Float);
+
+	//Writer side, the next row
+	void append(const SpectrumFrame& frame);
+
+	//Total number of rows written
+	uint64_t getWriteIndex() const;
+
+	//Oldest row still held
+	uint64_t getOldestIndex() const;
+
+	//Contiguous rows [start, start + count), count <= capacity, getRowStride
+	//values apart. nullptr unless the format matches
+	//The view is only meaningful while isIntact(start) holds
+	const float* getRows(uint64_t start) const;
+	const int16_t* getRowsDB(uint64_t start) const;
+
+	//Frame sequence number and capture time of a row
+	uint64_t getSequence(uint64_t row) const;
+	Timestamp getCaptureTime(uint64_t row) const;
+
+	//First held row with a sequence number, or capture time, at or after
+	//the given one. getWriteIndex() if there is none
+	uint64_t findSequence(uint64_t sequence) const;
+	uint64_t findTime(Timestamp time) const;
+
+	//Check, after reading, that the writer has not begun overwriting rows
+	//from start onwards
+	bool isIntact(uint64_t start) const;
+
+	//Combine every factor rows of [start, start + count) into one, the last
+	//group may be shorter. Writes ceil(count / factor) rows to out and
+	//returns that count, or 0 if the format does not match, the rows have
+	//not all been written, or they were overwritten meanwhile
+	//Mean of DecibelInt16 rows is taken in dB over the rows where the bin
+	//has energy, NO_ENERGY only if it has none in the whole group
+	size_t decimate(uint64_t start, size_t count, unsigned int factor,
+		Reduction reduction, float* out) const;
+	size_t decimate(uint64_t start, size_t count, unsigned int factor,
+		Reduction reduction, int16_t* out) const;
+
+	size_t getCapacity() const;
+	size_t getRowStride() const;
+	size_t getBinCount() const;
+	unsigned int getChannelCount() const;
+	Format getFormat() const;
+
+private:
+	template<typename T>
+	size_t decimateRows(const T* rows, size_t count, unsigned int factor,
+		Reduction reduction, T* out) const;
+
+	//Whether [start, start + count) has been written and fits the ring,
+	//checked before reading (isIntact covers overwrites after)
+	bool isWritten(uint64_t start, size_t count) const;
+
+	//First held row for which before(row) is false, rows are ordered
+	template<typename Before>
+	uint64_t search(Before before) const;
+
+	size_t capacity, binCount, rowStride;
+	unsigned int channelCount;
+	Format format;
+
+	//2 * capacity rows, only the one matching the format is used
+	std::vector<float> energies;
+	std::vector<int16_t> levels;
+
+	//Per row, indexed modulo capacity
+	std::vector<uint64_t> sequences;
+	std::vector<Timestamp> captureTimes;
+
+	//writeStart is bumped before a row is written, writeIndex after
+	std::atomic<uint64_t> writeStart, writeIndex;
+};
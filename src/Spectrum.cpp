@@ -4,73 +4,86 @@
 #include <iostream>
 #include <algorithm>
 
-FrequencyBin::FrequencyBin(double _fStart, double _fEnd, double _energy)
-	:	fStart{_fStart}
-	,	fEnd{_fEnd}
+#include "SampleKernels.hpp"
+
+FrequencyBin::FrequencyBin(const double* _edge, const double* _center,
+	double* _energy)
+	:	edge{_edge}
+	,	center{_center}
 	,	energy{_energy} {
 
 }
 
 FrequencyBin& FrequencyBin::operator=(const double _energy) {
-	energy = _energy;
+	*energy = _energy;
 
 	return *this;
 }
 
 FrequencyBin& FrequencyBin::operator+=(double _energy) {
-	energy += _energy;
+	*energy += _energy;
 
 	return *this;
 }
 
 double FrequencyBin::getFreqStart() const {
-	return fStart;
+	return edge[0];
 }
 
 double FrequencyBin::getFreqEnd() const {
-	return fEnd;
+	return edge[1];
 }
 
 double FrequencyBin::getFreqCenter() const {
-	//Return geometric mean of fStart, fEnd
-	return std::sqrt(fStart * fEnd);
+	//Geometric mean of fStart, fEnd, precomputed by Spectrum
+	return *center;
 }
 
 double FrequencyBin::getQ() const {
 	//Return quality factor of frequency bin
-	return std::sqrt(fStart * fEnd) / (fEnd - fStart);
+	return *center / (edge[1] - edge[0]);
 }
 
 double FrequencyBin::getEnergy() const {
-	return energy;
+	return *energy;
 }
 
 double FrequencyBin::getEnergyDB() const {
-	return 20 * std::log10(energy);
+	return 20 * std::log10(*energy);
 }
 
 void FrequencyBin::setEnergy(const double _energy) {
-	energy = _energy;
+	*energy = _energy;
 }
 
 void FrequencyBin::setEnergyDB(const double _energyDB) {
-	energy = std::pow(10., _energyDB / 20.);
+	*energy = std::pow(10., _energyDB / 20.);
 }
 
 void FrequencyBin::addEnergy(const double _energy) {
-	energy += _energy;
+	*energy += _energy;
 }
 
 void FrequencyBin::addEnergyDB(const double _energyDB) {
-	energy += std::pow(10., _energyDB / 20.);
+	*energy += std::pow(10., _energyDB / 20.);
 }
 
 
+const size_t Spectrum::NO_BIN;
+
+Spectrum::Spectrum(double fStart, double fEnd, double binsPerOctave)
+	:	sum{0.}
+	,	minFreq{0.}
+	,	maxFreq{0.} {
 
-Spectrum::Spectrum(double fStart, double fEnd, double binsPerOctave) {
 	double multiplier = std::pow(2., 1./binsPerOctave);
 	double curFreq = fStart;
 
+	auto newLayout = std::make_shared<Layout>();
+	std::vector<double>& edges = newLayout->edges;
+
+	edges.push_back(fStart);
+
 	while(curFreq < fEnd) {
 		//Calculate new end frequency based on standard octave frequency doubling
 		double curEnd = curFreq * multiplier;
@@ -79,78 +92,240 @@ Spectrum::Spectrum(double fStart, double fEnd, double binsPerOctave) {
 		//with the previous bin
 		double fCenter = std::sqrt(curFreq*curEnd);
 		if(fCenter > fEnd) {
-			bins[bins.size() - 1].fEnd = fEnd; //Extend the previous bin
+			edges.back() = fEnd; //Extend the previous bin
 
 			std::cout << "Extending previous bin fEnd to " << fEnd << "Hz\n";
 
 			break;
 		}
 		else {
-			//Construct a new frequency bin at the end of the vector
-			bins.emplace_back(curFreq, curEnd);
+			//Add a new frequency bin at the end
+			edges.push_back(curEnd);
 
 			std::cout << "New bin: [" << curFreq << "hz, " << curEnd << "hz), Q = "
-				<< (bins.end() - 1)->getQ() << "\n";
+				<< fCenter / (curEnd - curFreq) << "\n";
 
 			curFreq = curEnd;
 		}
 	}
 
 	std::cout << std::endl;
+
+	for(size_t i = 0; i + 1 < edges.size(); ++i) {
+		newLayout->centers.push_back(std::sqrt(edges[i] * edges[i + 1]));
+	}
+
+	layout = newLayout;
+	energies.resize(layout->centers.size());
+
+	makeViews();
+}
+
+Spectrum::Spectrum(const std::vector<double>& edges)
+	:	sum{0.}
+	,	minFreq{0.}
+	,	maxFreq{0.} {
+
+	auto newLayout = std::make_shared<Layout>();
+	newLayout->edges = edges;
+
+	for(size_t i = 0; i + 1 < edges.size(); ++i) {
+		newLayout->centers.push_back(std::sqrt(edges[i] * edges[i + 1]));
+	}
+
+	layout = newLayout;
+	energies.resize(layout->centers.size());
+
+	makeViews();
+}
+
+Spectrum::Spectrum(const Spectrum& other)
+	:	layout(other.layout)
+	,	energies(other.energies)
+	,	sum{other.sum}
+	,	minFreq{other.minFreq}
+	,	maxFreq{other.maxFreq} {
+
+	makeViews();
+}
+
+Spectrum& Spectrum::operator=(const Spectrum& other) {
+	if(this != &other) {
+		layout = other.layout;
+		energies = other.energies;
+		sum = other.sum;
+		minFreq = other.minFreq;
+		maxFreq = other.maxFreq;
+
+		makeViews();
+	}
+
+	return *this;
+}
+
+void Spectrum::makeViews() {
+	bins.clear();
+	bins.reserve(energies.size());
+
+	for(size_t i = 0; i < energies.size(); ++i) {
+		bins.push_back(FrequencyBin(&layout->edges[i], &layout->centers[i],
+			&energies[i]));
+	}
 }
 
 FrequencyBin& Spectrum::get(double frequency) {
-	auto foundBin = std::find_if(std::begin(bins),
-		std::end(bins),
-		[&](const FrequencyBin& bin) {
-			return frequency >= bin.fStart && frequency < bin.fEnd;
-		});
+	size_t index = findIndex(frequency);
 
-	if(foundBin == std::end(bins)) {
+	if(index == NO_BIN) {
 		throw Exception(ERROR_BIN_NOT_FOUND,
 			"Spectrum::get: Frequency bin not found");
 	}
 
-	return *foundBin;
+	return bins[index];
 }
 
 FrequencyBin& Spectrum::getByIndex(size_t index) {
 	return bins[index];
 }
 
-size_t Spectrum::getBinCount() {
-	return bins.size();
+const FrequencyBin& Spectrum::getByIndex(size_t index) const {
+	return bins[index];
 }
 
-void Spectrum::clear() {
-	for(auto& bin : bins) {
-		bin.energy = 0.;
+size_t Spectrum::findIndex(double frequency) const {
+	//Bins are contiguous and sorted, find the first edge above frequency
+	const std::vector<double>& edges = layout->edges;
+	auto nextEdge = std::upper_bound(std::begin(edges), std::end(edges),
+		frequency);
+
+	if(nextEdge == std::begin(edges) || nextEdge == std::end(edges)) {
+		//Below fStart, or at or above fEnd
+		return NO_BIN;
 	}
+
+	return nextEdge - std::begin(edges) - 1;
 }
 
-void Spectrum::updateStats() {
-	sum = 0;
+FrequencyBin* Spectrum::find(double frequency) {
+	size_t index = findIndex(frequency);
 
-	FrequencyBin *minBin = &bins[0];
-	FrequencyBin *maxBin = &bins[0];
+	return (index == NO_BIN) ? nullptr : &bins[index];
+}
 
-	for(auto& bin : bins) {
-		sum += bin.energy;
+std::vector<uint32_t> Spectrum::mapFftBins(double sampleRate,
+	unsigned int fftSize, unsigned int& firstFftBin, double fLow,
+	double fHigh) const {
 
-		if(bin.energy < minBin->energy) {
-			minBin = &bin;
-		}
-		if(bin.energy > maxBin->energy) {
-			maxBin = &bin;
+	std::vector<uint32_t> indexTable;
+	firstFftBin = 0;
+
+	for(unsigned int i = 0; i < fftSize/2; ++i) {
+		double f = sampleRate * i / fftSize; //Frequency of fft bin
+
+		size_t index = (f >= fLow && f < fHigh) ? findIndex(f) : NO_BIN;
+
+		if(index == NO_BIN) {
+			if(indexTable.empty()) {
+				//Still below fStart
+				firstFftBin = i + 1;
+				continue;
+			}
+			else {
+				//Above fEnd, bins are contiguous so nothing else maps
+				break;
+			}
 		}
+
+		indexTable.push_back(index);
+	}
+
+	return indexTable;
+}
+
+void Spectrum::accumulate(const uint32_t* indexTable, const double* magnitudes,
+	size_t count) {
+
+	double *energy = energies.data();
+
+	for(size_t i = 0; i < count; ++i) {
+		energy[indexTable[i]] += magnitudes[i];
+	}
+}
+
+void Spectrum::accumulate(const uint32_t* indexTable, const float* magnitudes,
+	size_t count) {
+
+	double *energy = energies.data();
+
+	for(size_t i = 0; i < count; ++i) {
+		energy[indexTable[i]] += magnitudes[i];
+	}
+}
+
+size_t Spectrum::getBinCount() const {
+	return bins.size();
+}
+
+double* Spectrum::getEnergies() {
+	return energies.data();
+}
+
+const double* Spectrum::getEnergies() const {
+	return energies.data();
+}
+
+const double* Spectrum::getFreqEdges() const {
+	return layout->edges.data();
+}
+
+const double* Spectrum::getFreqCenters() const {
+	return layout->centers.data();
+}
+
+void Spectrum::getEnergiesDB(double* db, DbMode mode) const {
+	if(mode == DbMode::Fast) {
+		SampleKernels::get().toDbFast(energies.data(), db, energies.size());
+
+		return;
+	}
+
+	for(size_t i = 0; i < energies.size(); ++i) {
+		db[i] = 20. * std::log10(energies[i]);
 	}
+}
+
+void Spectrum::setEnergiesDB(const double* db, DbMode mode) {
+	if(mode == DbMode::Fast) {
+		SampleKernels::get().fromDbFast(db, energies.data(), energies.size());
+
+		return;
+	}
+
+	for(size_t i = 0; i < energies.size(); ++i) {
+		energies[i] = std::pow(10., db[i] / 20.);
+	}
+}
+
+void Spectrum::clear() {
+	std::fill(energies.begin(), energies.end(), 0.);
+}
+
+void Spectrum::scale(double factor) {
+	SampleKernels::get().scale(energies.data(), factor, energies.size());
+}
+
+void Spectrum::updateStats() {
+	size_t minIndex, maxIndex;
+
+	SampleKernels::get().stats(energies.data(), energies.size(), &sum,
+		&minIndex, &maxIndex);
 
-	minFreq = minBin->getFreqCenter();
-	maxFreq = maxBin->getFreqCenter();
+	minFreq = layout->centers[minIndex];
+	maxFreq = layout->centers[maxIndex];
 }
 
 double Spectrum::getAverageEnergy() const {
-	return sum / bins.size();
+	return sum / energies.size();
 }
 
 double Spectrum::getAverageEnergyDB() const {
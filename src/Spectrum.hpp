@@ -3,16 +3,20 @@
 #include <vector>
 #include <algorithm>
 #include <limits>
+#include <memory>
+#include <cstdint>
 
 #include <Exception.hpp>
 
 //Forward declaration of class Spectrum
 class Spectrum;
 
+//View of one bin of a Spectrum, which stores its bins as arrays
 class FrequencyBin
 {
 public:
-	FrequencyBin(double fStart, double fEnd, double energy = 0.);
+	FrequencyBin(const FrequencyBin&) = default;
+	FrequencyBin& operator=(const FrequencyBin&) = delete;
 
 	//Operators
 	FrequencyBin& operator=(const double energy);
@@ -36,7 +40,11 @@ public:
 private:
 	friend class Spectrum;
 
-	double fStart, fEnd, energy;
+	//edge[0] and edge[1] are the bin's start and end
+	FrequencyBin(const double* edge, const double* center, double* energy);
+
+	const double *edge, *center;
+	double *energy;
 };
 
 
@@ -45,17 +53,68 @@ class Spectrum
 public:
 	static const int ERROR_BIN_NOT_FOUND = 0x1000;
 
+	//Bulk dB conversion. Fast is within about 1e-4 dB, for display
+	enum class DbMode {
+		Exact,
+		Fast
+	};
+
+	//Returned by findIndex when a frequency is outside the spectrum
+	static const size_t NO_BIN = std::numeric_limits<size_t>::max();
+
 	Spectrum(double fStart, double fEnd, double binsPerOctave);
 
-	size_t getBinCount();
+	//Bins with the given edges (getBinCount() + 1 of them), such as a layout
+	//read back from a recording
+	Spectrum(const std::vector<double>& edges);
+
+	//Copies share the bin layout, energies are copied
+	Spectrum(const Spectrum& other);
+	Spectrum(Spectrum&& other) = default;
+	Spectrum& operator=(const Spectrum& other);
+	Spectrum& operator=(Spectrum&& other) = default;
+
+	size_t getBinCount() const;
 
 	FrequencyBin& get(double frequency);
 
 	FrequencyBin& getByIndex(size_t index);
-
+	const FrequencyBin& getByIndex(size_t index) const;
+
+	//Non-throwing lookups
+	size_t findIndex(double frequency) const;
+	FrequencyBin* find(double frequency);
+
+	//Build a table mapping FFT bins to frequency bin indices. Only the
+	//contiguous run of FFT bins inside [fStart, fEnd) and [fLow, fHigh) is
+	//mapped, firstFftBin receives the FFT bin corresponding to the first
+	//table entry
+	std::vector<uint32_t> mapFftBins(double sampleRate, unsigned int fftSize,
+		unsigned int& firstFftBin, double fLow = 0.,
+		double fHigh = std::numeric_limits<double>::infinity()) const;
+
+	//Add magnitudes[i] to the bin at indexTable[i], for i in [0, count)
+	void accumulate(const uint32_t* indexTable, const double* magnitudes,
+		size_t count);
+	void accumulate(const uint32_t* indexTable, const float* magnitudes,
+		size_t count);
+
+	//Bulk access, one entry per bin. Bin i spans [edges[i], edges[i + 1]),
+	//so there are getBinCount() + 1 edges
+	double* getEnergies();
+	const double* getEnergies() const;
+	const double* getFreqEdges() const;
+	const double* getFreqCenters() const;
+
+	//Energy of every bin in dB into db[0, getBinCount()), and back
+	void getEnergiesDB(double* db, DbMode mode = DbMode::Exact) const;
+	void setEnergiesDB(const double* db, DbMode mode = DbMode::Exact);
 
 	void clear();
 
+	//Multiply every energy by factor
+	void scale(double factor);
+
 	void updateStats();
 
 	double getAverageEnergy() const;
@@ -71,10 +130,21 @@ public:
 	std::vector<FrequencyBin>::iterator end();
 
 private:
+	//Frequencies never change after construction, so every copy of a
+	//spectrum shares them
+	struct Layout {
+		std::vector<double> edges, centers;
+	};
+
+	void makeViews();
+
+	std::shared_ptr<const Layout> layout;
+	std::vector<double> energies;
+
+	//Views into the arrays above
 	std::vector<FrequencyBin> bins;
 
 	double sum;
-	double min, max;
 	double minFreq, maxFreq;
 
 };
@@ -1,86 +1,158 @@
 #include "SpectrumAnalyzer.hpp"
 
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+#include <limits>
+
 using namespace std;
 
-SpectrumAnalyzer::SpectrumAnalyzer(std::shared_ptr<AudioDevice>& _audioDevice,
+const unsigned int SpectrumAnalyzer::LATENCY_STAGE_COUNT;
+const unsigned int SpectrumAnalyzer::DEFAULT_QUEUE_DEPTH;
+const unsigned int SpectrumAnalyzer::MIN_OCTAVE_FFT_SIZE;
+const unsigned int SpectrumAnalyzer::MAX_LEVEL_COUNT;
+
+SpectrumAnalyzer::Options::Options()
+	:	threadCount{4}
+	,	priority{1}
+	,	fftMode{FftEngine::Mode::PackedStereo}
+	,	hopSize{0}
+	,	queueDepth{DEFAULT_QUEUE_DEPTH}
+	,	overloadPolicy{OverloadPolicy::DropOldest}
+	,	analysisEngine{AnalysisEngine::SingleBlock}
+	,	spectrogramFrames{0}
+	,	spectrogramFormat{SpectrogramHistory::Format::Float} {
+}
+
+SpectrumAnalyzer::SpectrumAnalyzer(std::shared_ptr<AudioSource> _audioSource,
 	double fStart, double fEnd,
-	double binsPerOctave, unsigned int maxBlockSize, unsigned int threadCount)
-	:	workUnit(std::make_unique<boost::asio::io_service::work>(ioService))
-	,	leftSpectrum(std::make_shared<Spectrum>(fStart, fEnd, binsPerOctave))
-	,	rightSpectrum(std::make_shared<Spectrum>(fStart, fEnd, binsPerOctave))
-	,	audioDevice(_audioDevice)
-	,	chunkSize{audioDevice->getBlockSize()} {
+	double binsPerOctave, unsigned int maxBlockSize, const Options& options)
+	:	executor{options.executor}
+	,	workerCount{std::max(options.threadCount, 1U)}
+	,	spectrumLayout(std::make_unique<Spectrum>(fStart, fEnd, binsPerOctave))
+	,	starvedFrames{0}
+	,	overwrittenFrames{0}
+	,	busyTime{0}
+	,	jobQueue(std::max(options.queueDepth, 1U))
+	,	jobHead{0}
+	,	jobCount{0}
+	,	nextSequence{0}
+	,	overloadPolicy{options.overloadPolicy}
+	,	droppedFrames{0}
+	,	coalescedFrames{0}
+	,	blockedBlocks{0}
+	,	nextDelivery{0}
+	,	delivering{false}
+	,	audioSource(_audioSource)
+	,	channelCount{audioSource->getChannelCount()}
+	,	chunkSize{audioSource->getBlockSize()}
+	,	hopSize{options.hopSize ? options.hopSize : chunkSize}
+	,	analysisEngine{options.analysisEngine}
+	,	levelCount{1}
+	,	windowCenter{0.} {
+
+	if(analysisEngine == AnalysisEngine::Multirate) {
+		chooseMultirateSize(maxBlockSize);
+	}
+	else if(analysisEngine == AnalysisEngine::SlidingDft) {
+		createSlidingDft(maxBlockSize);
+	}
+	else {
+		chooseBlockSize(maxBlockSize);
+	}
 
-	//Determine optimum block size
-	double minResolution = leftSpectrum->begin()->getFreqEnd() -
-		leftSpectrum->begin()->getFreqStart();
-	
-	unsigned int chunksPerBlockPower =
-		std::ceil(std::log2(audioDevice->getSampleRate() /
-		(minResolution * chunkSize)));
-	
-	blockSize = chunkSize * (1 << chunksPerBlockPower);
+	if(!slidingDft) {
+		//Initialize FFT buffers and plans, one engine per worker
+		//(the FFTW planner is not thread safe, so this is done up front)
+		for(unsigned int i = 0; i < workerCount; ++i) {
+			fftEngines.push_back(std::make_unique<FftEngine>(fftSize, options.fftMode,
+				channelCount));
+			freeEngines.push_back(fftEngines.back().get());
+		}
 
-	if(blockSize > maxBlockSize) {
-		cout << "[Warning] Optimal block size of " << blockSize << " too large, using "
-			<< maxBlockSize << " instead" << endl;
+		//Generate FFT window function
+		generateWindow();
+	}
 
-		blockSize = maxBlockSize;
+	//Precompute FFT bin to spectrum bin mapping
+	generateBinMap();
+
+	if(analysisEngine != AnalysisEngine::SingleBlock) {
+		double cost = getRelativeCost();
+		const char *name = slidingDft ? "Sliding DFT" : "Multirate";
+
+		if(cost < 1.) {
+			std::cout << "[Info] " << name << " analysis costs an estimated "
+				<< (int)(100.*cost + 0.5) << "% of a single block FFT" << std::endl;
+		}
+		else {
+			std::cout << "[Warning] " << name << " analysis costs an estimated "
+				<< cost << " times a single block FFT, SingleBlock is cheaper"
+				<< std::endl;
+		}
 	}
-	else {
-		std::cout << "[Info] For minimum resolution of " << (int)(minResolution+0.5)
-			<< "Hz, using block size of " << blockSize << std::endl;
+
+	//Each worker fills one frame at a time, a few more are needed for
+	//frames waiting to be reordered, the current snapshot and readers
+	framePool = std::make_unique<FramePool>(*spectrumLayout,
+		2*workerCount + 4, channelCount);
+
+	if(options.spectrogramFrames > 0) {
+		spectrogram = std::make_unique<SpectrogramHistory>(
+			options.spectrogramFrames, channelCount,
+			spectrumLayout->getBinCount(), options.spectrogramFormat);
 	}
-	
-	//resolution = Fs / blockSize
-	//blockSize = Fs/resolution
-	//chunksPerBlock = blockSize / chunkSize = Fs/(resolution * chunkSize)
 
-	//Initialize FFTW stuff
-	//fftIn, fftOut, fftPlan
-	fftIn = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * blockSize);
-	fftOut = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * blockSize);
+	if(!options.sharedMemoryName.empty()) {
+		sharedPublisher = std::make_unique<SharedSpectrumPublisher>(
+			options.sharedMemoryName, *spectrumLayout, channelCount,
+			audioSource->getSampleRate(), hopSize);
 
-	//Compute FFT plans
-	fftPlan = fftw_plan_dft_1d(blockSize, fftIn, fftOut,
-		FFTW_FORWARD, FFTW_MEASURE);
+		std::cout << "[Info] Publishing frames to shared memory "
+			<< sharedPublisher->getName() << std::endl;
+	}
 
-	//Generate FFT window function
-	generateWindow();
+	pendingFrames.resize(framePool->getFrameCount());
+	pendingReady.resize(framePool->getFrameCount());
+
+	//Publish an empty frame so readers always get a snapshot
+	SpectrumFrame *emptyFrame = framePool->acquire();
+	framePool->publish(emptyFrame);
+
+	//Initialize audio history, with room for every queued and in-progress
+	//block on top of the chunk being written
+	history = std::make_unique<SampleHistory>(blockSize +
+		hopSize * (jobQueue.size() + workerCount) + chunkSize, channelCount);
+
+	if(levelCount > 1) {
+		decimator = std::make_unique<OctaveDecimator>(levelCount, channelCount,
+			fftSize, hopSize * (jobQueue.size() + workerCount) + chunkSize,
+			chunkSize);
+	}
 
-	//Initialize audio buffers
-	leftBuffer.resize(blockSize);
-	rightBuffer.resize(blockSize);
+	nextBlockEnd = blockSize;
 
-	//Launch threads
-	for(unsigned int i = 0; i < threadCount; ++i) {
-		asyncThreads.emplace_back(std::bind(&SpectrumAnalyzer::threadRoutine,
-			this));
+	//Attach to the worker threads
+	if(!executor) {
+		executor = std::make_shared<AnalysisExecutor>(workerCount);
 	}
 
+	executorClient = executor->attach(options.priority, workerCount);
+
 	//Register audio callback
-	auto cb = [this](const int16_t* left, const int16_t* right) {
-			cbAudio(left, right);
+	auto cb = [this](const int16_t* const* channels, Timestamp captureTime) {
+			cbAudio(channels, captureTime);
 		};
 
-	callbackID = audioDevice->addCallback(cb);
+	callbackID = audioSource->addCallback(cb);
 }
 
 SpectrumAnalyzer::~SpectrumAnalyzer() {
 	//Remove audio callback
-	audioDevice->removeCallback(callbackID);
-
-	//Shutdown threads
-	workUnit.reset();
+	audioSource->removeCallback(callbackID);
 
-	for(auto& thread : asyncThreads) {
-		thread.join();
-	}
-
-	//Cleanup fftw stuff
-	fftw_destroy_plan(fftPlan);
-	fftw_free(fftIn);
-	fftw_free(fftOut);
+	//Finish queued blocks, then leave the executor
+	executorClient->detach();
 }
 
 void SpectrumAnalyzer::addListener(std::function<void(SpectrumAnalyzer*,
@@ -95,138 +167,700 @@ void SpectrumAnalyzer::removeListener(std::function<void(SpectrumAnalyzer*,
 	//sigSpectrumUpdate.disconnect(cb);
 }
 
-std::shared_ptr<AudioDevice> SpectrumAnalyzer::getAudioDevice() {
-	return audioDevice;
+void SpectrumAnalyzer::addFrameListener(std::function<void(SpectrumAnalyzer*,
+	std::shared_ptr<SpectrumFrame>)> cb) {
+
+	sigFrameUpdate.connect(cb);
+}
+
+std::shared_ptr<AudioSource> SpectrumAnalyzer::getAudioSource() {
+	return audioSource;
+}
+
+void SpectrumAnalyzer::waitForIdle() {
+	while(true) {
+		uint64_t sequence;
+
+		{
+			std::unique_lock<std::mutex> queueLock(queueMutex);
+
+			queueCondition.wait(queueLock, [this]() {
+					return jobCount == 0;
+				});
+
+			//Every block handed to a worker so far
+			sequence = nextSequence;
+		}
+
+		{
+			std::unique_lock<std::mutex> deliveryLock(deliveryMutex);
+
+			deliveryCondition.wait(deliveryLock, [this, sequence]() {
+					return nextDelivery >= sequence && !delivering;
+				});
+		}
+
+		std::unique_lock<std::mutex> queueLock(queueMutex);
+
+		//Done unless more audio came in meanwhile
+		if(jobCount == 0 && nextSequence == sequence) {
+			return;
+		}
+	}
 }
 
 std::shared_ptr<Spectrum> SpectrumAnalyzer::getLeftSpectrum() {
-	return leftSpectrum;
+	auto frame = framePool->getPublished();
+
+	//Aliasing constructor, shares ownership of the frame without allocating
+	return std::shared_ptr<Spectrum>(frame, &frame->left);
 }
 
 std::shared_ptr<Spectrum> SpectrumAnalyzer::getRightSpectrum() {
-	return rightSpectrum;
+	auto frame = framePool->getPublished();
+
+	return std::shared_ptr<Spectrum>(frame, &frame->right);
 }
 
-void SpectrumAnalyzer::cbAudio(const int16_t* left, const int16_t* right) {
-	//Lock the buffer mutex
-	//std::unique_lock<std::mutex> bufferLock(bufferMutex);
+std::shared_ptr<Spectrum> SpectrumAnalyzer::getSpectrum(unsigned int channel) {
+	auto frame = framePool->getPublished();
 
-	//Shift the samples forward by 1 chunk size
-	std::memcpy(leftBuffer.data(), &leftBuffer[chunkSize],
-		sizeof(int16_t) * (blockSize - chunkSize));
-	std::memcpy(rightBuffer.data(), &rightBuffer[chunkSize],
-		sizeof(int16_t) * (blockSize - chunkSize));
+	return std::shared_ptr<Spectrum>(frame, &frame->channels[channel]);
+}
 
-	//Copy the new chunk samples into the end of the block
-	std::memcpy(&leftBuffer[blockSize - chunkSize], left,
-		sizeof(int16_t) * chunkSize);
-	std::memcpy(&rightBuffer[blockSize - chunkSize], right,
-		sizeof(int16_t) * chunkSize);
+std::shared_ptr<SpectrumFrame> SpectrumAnalyzer::getSnapshot() {
+	return framePool->getPublished();
+}
 
-	//Post the fft routine to the async thread pool
-	ioService.post(std::bind(&SpectrumAnalyzer::fftRoutine, this,
-		leftBuffer, rightBuffer));
+const SpectrogramHistory* SpectrumAnalyzer::getSpectrogram() const {
+	return spectrogram.get();
 }
 
-void SpectrumAnalyzer::threadRoutine() {
-	//Run work from ioService
-	ioService.run();
+uint64_t SpectrumAnalyzer::getStarvedFrameCount() const {
+	return starvedFrames.load(std::memory_order_relaxed);
+}
 
-	std::cout << "[Info] SpectrumAnalyzer::threadRoutine: thread returning"
-		<< std::endl;
+uint64_t SpectrumAnalyzer::getOverrunCount() {
+	return audioSource->getOverrunCount(callbackID);
 }
 
-void SpectrumAnalyzer::fftRoutine(std::vector<int16_t> left,
-	std::vector<int16_t> right) {
+uint64_t SpectrumAnalyzer::getOverwrittenFrameCount() const {
+	return overwrittenFrames.load(std::memory_order_relaxed);
+}
 
-	//This value will be used often
-	double sampleRate = audioDevice->getSampleRate();
-	
-	//Fill FFT input buffer
-	for(unsigned int i = 0; i < blockSize; i++) {
-		fftIn[i][0] = fftWindow[i] *
-			((double)left[i] / INT16_MAX / blockSize);
-		fftIn[i][1] = 0.; //Imaginary
+uint64_t SpectrumAnalyzer::getDroppedFrameCount() const {
+	return droppedFrames.load(std::memory_order_relaxed);
+}
+
+uint64_t SpectrumAnalyzer::getCoalescedFrameCount() const {
+	return coalescedFrames.load(std::memory_order_relaxed);
+}
+
+uint64_t SpectrumAnalyzer::getBusyTime() const {
+	return busyTime.load(std::memory_order_relaxed);
+}
+
+unsigned int SpectrumAnalyzer::getWorkerCount() const {
+	return workerCount;
+}
+
+unsigned int SpectrumAnalyzer::getQueueDepth() {
+	std::unique_lock<std::mutex> queueLock(queueMutex);
+
+	return jobCount;
+}
+
+unsigned int SpectrumAnalyzer::getBlockSize() const {
+	return blockSize;
+}
+
+unsigned int SpectrumAnalyzer::getHopSize() const {
+	return hopSize;
+}
+
+double SpectrumAnalyzer::getWindowCenter() const {
+	return windowCenter;
+}
+
+unsigned int SpectrumAnalyzer::getFftSize() const {
+	return fftSize;
+}
+
+unsigned int SpectrumAnalyzer::getLevelCount() const {
+	return levelCount;
+}
+
+SpectrumAnalyzer::AnalysisEngine SpectrumAnalyzer::getAnalysisEngine() const {
+	return analysisEngine;
+}
+
+unsigned int SpectrumAnalyzer::getChannelCount() const {
+	return channelCount;
+}
+
+double SpectrumAnalyzer::getRelativeCost() const {
+	//Per channel flops, a real FFT takes about 2.5 n log2(n), windowing and
+	//magnitudes a few more per sample
+	auto fftCost = [](double n) {
+			return 2.5 * n * std::log2(n) + 4. * n;
+		};
+
+	double singleBlock = fftCost(blockSize), cost = singleBlock;
+
+	if(analysisEngine == AnalysisEngine::Multirate) {
+		cost = 0.;
+
+		for(const auto& binMap : binMaps) {
+			if(!binMap.empty()) {
+				cost += fftCost(fftSize);
+			}
+		}
+
+		//Every level together produces just under one output per input
+		//sample, each costing about one multiply-add per nonzero tap
+		cost += hopSize * (OctaveDecimator::TAP_COUNT + 1.);
+	}
+	else if(analysisEngine == AnalysisEngine::SlidingDft) {
+		//Resonators for every sample of the hop, then a snapshot
+		cost = hopSize * slidingDft->getFlopsPerSample() +
+			10. * slidingDft->getBinCount();
 	}
 
-	//Do FFT on left samples
-	fftw_execute(fftPlan);
+	return cost / singleBlock;
+}
+
+std::shared_ptr<AnalysisExecutor> SpectrumAnalyzer::getExecutor() {
+	return executor;
+}
+
+LatencyHistogram::Summary SpectrumAnalyzer::getLatency(
+	LatencyStage stage) const {
 
-	//Fill left spectrum with new FFT data
-	leftSpectrum->clear();
+	return latency[(int)stage].getSummary();
+}
+
+const LatencyHistogram& SpectrumAnalyzer::getLatencyHistogram(
+	LatencyStage stage) const {
 
+	return latency[(int)stage];
+}
 
-	for(unsigned int i = 0; i < blockSize/2; ++i) {
-		double f = sampleRate * i / blockSize; //Frequency of fft bin
+void SpectrumAnalyzer::resetLatency() {
+	for(auto& histogram : latency) {
+		histogram.reset();
+	}
+}
+
+void SpectrumAnalyzer::cbAudio(const int16_t* const* channels,
+	Timestamp captureTime) {
+
+	//Append the new chunk to the history
+	history->write(channels, chunkSize);
+
+	if(decimator) {
+		decimator->write(channels, chunkSize);
+	}
 
-		try {
-			//Put the energy from this bin into the appropriate location
-			leftSpectrum->get(f).addEnergy(std::sqrt(sqr(fftOut[i][0]) +
-				sqr(fftOut[i][1])));
+	uint64_t written = history->getWriteIndex();
+
+	//Queue every block that is now complete, there may be none or several
+	//depending on the hop size
+	while(nextBlockEnd <= written) {
+		//captureTime is for the newest sample of the chunk, the block may
+		//end before it
+		Timestamp blockCapture = captureTime - (written - nextBlockEnd) *
+			1000000000ULL / audioSource->getSampleRate();
+
+		if(slidingDft) {
+			//Snapshot n is the block ending at blockSize + n * hopSize
+			slidingDft->update(*history, nextBlockEnd);
+			slidingDft->snapshot();
 		}
-		catch(const Exception& e) {
-			if(e.getErrorCode() != Spectrum::ERROR_BIN_NOT_FOUND) {
-				std::cout << "[Error] SpectrumAnalyzer::fftRoutine Exception caught: "
-					<< e.what() << std::endl;
-			}
-			else {
-				//This is not an error
-				//The frequency is not in the range of interest for the spectrum
-			}
+
+		enqueueBlock(nextBlockEnd - blockSize, blockCapture);
+
+		nextBlockEnd += hopSize;
+	}
+
+	if(slidingDft) {
+		//Rest of the chunk, so the next one starts where it ends
+		slidingDft->update(*history, written);
+	}
+}
+
+void SpectrumAnalyzer::enqueueBlock(uint64_t blockStart,
+	Timestamp captureTime) {
+
+	bool post = false;
+
+	if(overloadPolicy == OverloadPolicy::Block) {
+		//A free queue slot is not enough, workers finish out of order and a
+		//slow one can fall behind by more than the queue depth. Nothing is
+		//dropped, so block n has sequence n, and waiting for delivery keeps
+		//every unfinished block inside the history
+		std::unique_lock<std::mutex> deliveryLock(deliveryMutex);
+
+		deliveryCondition.wait(deliveryLock, [this]() {
+				return blockedBlocks - nextDelivery <
+					jobQueue.size() + workerCount;
+			});
+
+		++blockedBlocks;
+	}
+
+	{
+		std::unique_lock<std::mutex> queueLock(queueMutex);
+
+		if(overloadPolicy == OverloadPolicy::Block) {
+			//Holds up the source (and so its callback thread) until a
+			//worker takes a block
+			queueCondition.wait(queueLock, [this]() {
+					return jobCount < jobQueue.size();
+				});
+		}
+
+		Job job{blockStart, captureTime, getTimestamp()};
+
+		if(jobCount < jobQueue.size()) {
+			jobQueue[(jobHead + jobCount) % jobQueue.size()] = job;
+			++jobCount;
+
+			post = true;
+		}
+		else if(overloadPolicy == OverloadPolicy::DropOldest) {
+			//Overwrite the oldest block, its handler runs this one instead
+			jobQueue[jobHead] = job;
+			jobHead = (jobHead + 1) % jobQueue.size();
+
+			droppedFrames.fetch_add(1, std::memory_order_relaxed);
+		}
+		else if(overloadPolicy == OverloadPolicy::DropNewest) {
+			droppedFrames.fetch_add(1, std::memory_order_relaxed);
+		}
+		else {
+			//Collapse the backlog into the newest block
+			coalescedFrames.fetch_add(jobCount, std::memory_order_relaxed);
+
+			jobQueue[jobHead] = job;
+			jobCount = 1;
 		}
 	}
-	
-	//Now do right FFT
-	//Copy real audio data into complex fft input array and scale to [-1., 1.]
-	for(unsigned int i = 0; i < blockSize; i++) {
-		fftIn[i][0] = fftWindow[i] * ((double)right[i] / INT16_MAX); //Real
-		fftIn[i][1] = 0.; //Imaginary
+
+	if(post) {
+		//Post the fft routine to the worker threads
+		executorClient->post(std::bind(&SpectrumAnalyzer::runQueuedBlock, this));
+	}
+}
+
+void SpectrumAnalyzer::runQueuedBlock() {
+	uint64_t sequence;
+	Job job;
+
+	{
+		std::unique_lock<std::mutex> queueLock(queueMutex);
+
+		if(jobCount == 0) {
+			//Block was coalesced into a later one
+			return;
+		}
+
+		job = jobQueue[jobHead];
+		jobHead = (jobHead + 1) % jobQueue.size();
+		--jobCount;
+
+		//Sequence numbers are assigned in queue order, so dropped blocks
+		//leave no gaps for frame reordering
+		sequence = nextSequence++;
 	}
 
-	//Do FFT on right samples
-	fftw_execute(fftPlan);
+	queueCondition.notify_all();
+
+	Timestamp dequeueTime = getTimestamp();
+
+	fftRoutine(sequence, job, dequeueTime);
+
+	busyTime.fetch_add(getTimestamp() - dequeueTime, std::memory_order_relaxed);
+}
+
+void SpectrumAnalyzer::fftRoutine(uint64_t sequence, const Job& job,
+	Timestamp dequeueTime) {
+
+	uint64_t blockStart = job.blockStart;
+
+	//Claim a frame that no reader is looking at
+	SpectrumFrame *frame = framePool->acquire();
 
-	//Fill right spectrum with new FFT data
-	rightSpectrum->clear();
+	if(!frame) {
+		//Readers are holding on to every frame, skip this one rather than
+		//wait for them
+		starvedFrames.fetch_add(1, std::memory_order_relaxed);
+		deliverFrame(sequence, nullptr);
+
+		return;
+	}
 
-	for(unsigned int i = 0; i < blockSize/2; ++i) {
-		double f = sampleRate * i / blockSize; //Frequency of fft bin
+	frame->sequence = sequence;
+	frame->times.capture = job.capture;
+	frame->times.enqueue = job.enqueue;
+	frame->times.dequeue = dequeueTime;
+
+	for(auto& spectrum : frame->channels) {
+		spectrum.clear();
+	}
+
+	bool intact = slidingDft ? readSlidingDft(*frame, blockStart) :
+		transformBlock(*frame, blockStart);
+
+	if(!intact) {
+		//This job waited so long that new audio overwrote its block
+		framePool->release(frame);
+
+		overwrittenFrames.fetch_add(1, std::memory_order_relaxed);
+		deliverFrame(sequence, nullptr);
+
+		return;
+	}
+
+	//Update stats for every spectrum
+	for(auto& spectrum : frame->channels) {
+		spectrum.updateStats();
+	}
 
-		try {
-			//Put the energy from this bin into the appropriate location
-			rightSpectrum->get(f).addEnergy(std::sqrt(sqr(fftOut[i][0]) +
-				sqr(fftOut[i][1])));
+	frame->times.fftDone = getTimestamp();
+
+	deliverFrame(sequence, frame);
+}
+
+bool SpectrumAnalyzer::transformBlock(SpectrumFrame& frame,
+	uint64_t blockStart) {
+
+	FftEngine *fftEngine = acquireEngine();
+
+	//One FFT per level, all ending where the block ends. SingleBlock has
+	//the full rate level only, with the FFT spanning the whole block
+	uint64_t blockEnd = blockStart + blockSize;
+
+	for(unsigned int level = 0; level < levelCount; ++level) {
+		if(binMaps[level].empty()) {
+			continue;
 		}
-		catch(const Exception& e) {
-			if(e.getErrorCode() != Spectrum::ERROR_BIN_NOT_FOUND) {
-				std::cout << "[Error] SpectrumAnalyzer::cbAudio Exception caught: "
-					<< e.what() << std::endl;
-			}
-			else {
-				//This is not an error
-				//The frequency is not in the range of interest for the spectrum
-			}
+
+		const SampleHistory& levelHistory = level ?
+			decimator->getLevel(level) : *history;
+
+		//Level k has produced ceil(n / 2^k) samples after n input samples
+		uint64_t levelEnd = (blockEnd + (1ULL << level) - 1) >> level;
+		uint64_t levelStart = levelEnd - fftSize;
+
+		//Window and transform every channel, straight from the history
+		fftEngine->execute(levelHistory.getChannel(0, levelStart),
+			levelHistory.getChannelStride(), fftWindow.data());
+
+		if(!levelHistory.isIntact(levelStart)) {
+			releaseEngine(fftEngine);
+
+			return false;
+		}
+
+		//Add this level's bins to the spectrums
+		for(unsigned int channel = 0; channel < channelCount; ++channel) {
+			fillSpectrum(frame.channels[channel], level,
+				fftEngine->getMagnitudes(channel));
 		}
 	}
 
-	//Update stats for both spectrums
-	leftSpectrum->updateStats();
-	rightSpectrum->updateStats();
+	releaseEngine(fftEngine);
 
-	//Call all listeners
-	sigSpectrumUpdate(this, leftSpectrum, rightSpectrum);
+	return true;
 }
 
-void SpectrumAnalyzer::generateWindow() {
-	//Hanning window
-	fftWindow.resize(blockSize);
+bool SpectrumAnalyzer::readSlidingDft(SpectrumFrame& frame,
+	uint64_t blockStart) {
+
+	//The audio callback took this block's snapshot as the block completed
+	uint64_t snapshot = blockStart / hopSize;
+
+	for(unsigned int channel = 0; channel < channelCount; ++channel) {
+		fillSpectrum(frame.channels[channel], 0,
+			slidingDft->getMagnitudes(snapshot, channel));
+	}
+
+	return slidingDft->isIntact(snapshot);
+}
+
+FftEngine* SpectrumAnalyzer::acquireEngine() {
+	std::unique_lock<std::mutex> engineLock(engineMutex);
+
+	//There is one engine per worker and the executor runs at most
+	//workerCount blocks at once, so this doesn't normally wait
+	engineCondition.wait(engineLock, [this]() {
+			return !freeEngines.empty();
+		});
+
+	FftEngine *engine = freeEngines.back();
+	freeEngines.pop_back();
+
+	return engine;
+}
+
+void SpectrumAnalyzer::releaseEngine(FftEngine* engine) {
+	{
+		std::unique_lock<std::mutex> engineLock(engineMutex);
+
+		freeEngines.push_back(engine);
+	}
+
+	engineCondition.notify_one();
+}
+
+void SpectrumAnalyzer::deliverFrame(uint64_t sequence, SpectrumFrame* frame) {
+	std::unique_lock<std::mutex> deliveryLock(deliveryMutex);
+
+	//Wait if this frame is too far ahead of the next one to deliver
+	//(a single worker is stalled while the others keep finishing frames)
+	deliveryCondition.wait(deliveryLock, [this, sequence]() {
+			return sequence - nextDelivery < pendingFrames.size();
+		});
+
+	size_t slot = sequence % pendingFrames.size();
+
+	pendingFrames[slot] = frame;
+	pendingReady[slot] = true;
+
+	//Another worker is already calling listeners, it will pick this frame up
+	if(delivering) {
+		return;
+	}
+
+	delivering = true;
+
+	while(pendingReady[slot = nextDelivery % pendingFrames.size()]) {
+		SpectrumFrame *next = pendingFrames[slot];
+		pendingReady[slot] = false;
+		++nextDelivery;
+
+		deliveryCondition.notify_all();
+
+		if(!next) {
+			//Skipped frame
+			continue;
+		}
+
+		//Call listeners without holding the lock, so other workers
+		//can keep queueing finished frames
+		deliveryLock.unlock();
+
+		//Take a reference before publishing, so the frame can't be reclaimed
+		//until the listeners are done with it
+		auto snapshot = framePool->share(next);
+
+		next->times.publish = getTimestamp();
+		framePool->publish(next);
+
+		//Only one thread delivers at a time, so this has a single writer
+		if(spectrogram) {
+			spectrogram->append(*next);
+		}
+
+		if(sharedPublisher) {
+			sharedPublisher->publish(*next);
+		}
+
+		//Call all listeners
+		sigSpectrumUpdate(this, std::shared_ptr<Spectrum>(snapshot, &next->left),
+			std::shared_ptr<Spectrum>(snapshot, &next->right));
+		sigFrameUpdate(this, snapshot);
+
+		recordLatency(next->times, getTimestamp());
+
+		deliveryLock.lock();
+	}
+
+	delivering = false;
 
-	for(unsigned int i = 0; i < blockSize; i++) {
-		fftWindow[i] = 0.5 * (1. - std::cos((2*3.141592654*i)/(blockSize - 1)));
+	//For waitForIdle
+	deliveryCondition.notify_all();
+}
+
+void SpectrumAnalyzer::recordLatency(const FrameTimes& times,
+	Timestamp listenersDone) {
+
+	latency[(int)LatencyStage::Capture].record(times.capture, times.enqueue);
+	latency[(int)LatencyStage::Queue].record(times.enqueue, times.dequeue);
+	latency[(int)LatencyStage::Fft].record(times.dequeue, times.fftDone);
+	latency[(int)LatencyStage::Reorder].record(times.fftDone, times.publish);
+	latency[(int)LatencyStage::Listeners].record(times.publish, listenersDone);
+	latency[(int)LatencyStage::Total].record(times.capture, listenersDone);
+}
+
+void SpectrumAnalyzer::fillSpectrum(Spectrum& spectrum, unsigned int level,
+	const AnalysisSample* magnitudes) {
+
+	//Scatter the energy from each FFT bin into its frequency bin
+	spectrum.accumulate(binMaps[level].data(), magnitudes + binMapStarts[level],
+		binMaps[level].size());
+}
+
+void SpectrumAnalyzer::chooseBlockSize(unsigned int maxBlockSize) {
+	//Determine optimum block size
+	double minResolution = spectrumLayout->getByIndex(0).getFreqEnd() -
+		spectrumLayout->getByIndex(0).getFreqStart();
+	
+	unsigned int chunksPerBlockPower =
+		std::ceil(std::log2(audioSource->getSampleRate() /
+		(minResolution * chunkSize)));
+	
+	blockSize = chunkSize * (1 << chunksPerBlockPower);
+
+	if(blockSize > maxBlockSize) {
+		cout << "[Warning] Optimal block size of " << blockSize << " too large, using "
+			<< maxBlockSize << " instead" << endl;
+
+		blockSize = maxBlockSize;
+	}
+	else {
+		std::cout << "[Info] For minimum resolution of " << (int)(minResolution+0.5)
+			<< "Hz, using block size of " << blockSize << std::endl;
 	}
+	
+	//resolution = Fs / blockSize
+	//blockSize = Fs/resolution
+	//chunksPerBlock = blockSize / chunkSize = Fs/(resolution * chunkSize)
+
+	fftSize = blockSize;
+	windowCenter = blockSize / 2.;
 }
 
-//Helper function
-double SpectrumAnalyzer::sqr(const double x) {
-	return x*x;
+void SpectrumAnalyzer::chooseMultirateSize(unsigned int maxBlockSize) {
+	//Level k covers the octave below a quarter of its rate (level 0 the two
+	//octaves below Nyquist), so bins are never narrower, relative to their
+	//frequency, than the narrowest bin of the layout
+	double minRatio = std::numeric_limits<double>::infinity();
+
+	for(size_t i = 0; i < spectrumLayout->getBinCount(); ++i) {
+		const FrequencyBin& bin = spectrumLayout->getByIndex(i);
+
+		minRatio = std::min(minRatio,
+			(bin.getFreqEnd() - bin.getFreqStart()) / bin.getFreqStart());
+	}
+
+	//Four FFT bins per frequency bin at the bottom of an octave, where the
+	//FFT bin spacing is 8f/fftSize, keeps the Hann window's main lobe from
+	//smearing a tone into its neighbours
+	fftSize = 1 << (unsigned int)std::ceil(std::log2(32. / minRatio));
+	fftSize = std::max(fftSize, MIN_OCTAVE_FFT_SIZE);
+
+	if(fftSize > maxBlockSize) {
+		cout << "[Warning] Optimal octave FFT size of " << fftSize
+			<< " too large, using " << maxBlockSize << " instead" << endl;
+
+		fftSize = maxBlockSize;
+	}
+
+	//Add levels until the lowest one covers fStart
+	double sampleRate = audioSource->getSampleRate(),
+		fStart = spectrumLayout->getByIndex(0).getFreqStart();
+
+	while(levelCount < MAX_LEVEL_COUNT &&
+		sampleRate / (1 << (levelCount - 1)) / 8. > fStart) {
+		++levelCount;
+	}
+
+	//Blocks are timed by the lowest level, which spans the most audio
+	blockSize = fftSize << (levelCount - 1);
+
+	//Every level ends at the block end, the full rate one is the shortest
+	windowCenter = blockSize - fftSize / 2.;
+
+	std::cout << "[Info] Multirate analysis with " << levelCount
+		<< " octave levels of FFT size " << fftSize << ", lowest level "
+		<< sampleRate / blockSize << "Hz resolution" << std::endl;
+}
+
+void SpectrumAnalyzer::createSlidingDft(unsigned int maxBlockSize) {
+	//Hann windows of twice the period at the bin width put each bin's first
+	//null at the neighbouring bin's center, and its edges at -6dB
+	double sampleRate = audioSource->getSampleRate();
+	std::vector<double> frequencies;
+	std::vector<unsigned int> windowSizes;
+
+	for(size_t i = 0; i < spectrumLayout->getBinCount(); ++i) {
+		const FrequencyBin& bin = spectrumLayout->getByIndex(i);
+		double width = bin.getFreqEnd() - bin.getFreqStart();
+
+		frequencies.push_back(bin.getFreqCenter());
+		windowSizes.push_back(std::min(maxBlockSize,
+			(unsigned int)std::ceil(2. * sampleRate / width)));
+	}
+
+	//Blocks span the longest window, so the first snapshot is taken once
+	//every window has filled
+	blockSize = *std::max_element(windowSizes.begin(), windowSizes.end());
+	fftSize = blockSize;
+
+	//Every window ends at the block end
+	windowCenter = blockSize -
+		*std::min_element(windowSizes.begin(), windowSizes.end()) / 2.;
+
+	if(blockSize == maxBlockSize) {
+		cout << "[Warning] Sliding DFT windows capped at " << maxBlockSize
+			<< " samples" << endl;
+	}
+
+	//A snapshot per queued or in-progress block, plus the one being written
+	slidingDft = std::make_unique<SlidingDft>(frequencies, windowSizes,
+		sampleRate, channelCount, jobQueue.size() + workerCount + 2);
+
+	std::cout << "[Info] Sliding DFT over " << frequencies.size()
+		<< " bins, longest window " << blockSize << std::endl;
+}
+
+void SpectrumAnalyzer::generateWindow() {
+	//Hanning window, with sample scaling folded in
+	fftWindow = FftEngine::makeWindow(fftSize);
+}
+
+void SpectrumAnalyzer::generateBinMap() {
+	//Every spectrum shares the same bin layout, each level maps its own band
+	double sampleRate = audioSource->getSampleRate();
+
+	//Move a band edge to the nearest frequency bin edge, so each frequency
+	//bin is filled from a single level
+	auto snap = [this](double edge) {
+		size_t index = spectrumLayout->findIndex(edge);
+
+		if(index == Spectrum::NO_BIN) {
+			return edge;
+		}
+
+		const FrequencyBin& bin = spectrumLayout->getByIndex(index);
+
+		return (bin.getFreqCenter() < edge) ? bin.getFreqEnd() :
+			bin.getFreqStart();
+	};
+
+	binMaps.resize(levelCount);
+	binMapStarts.resize(levelCount);
+
+	if(slidingDft) {
+		//One magnitude per spectrum bin
+		for(size_t i = 0; i < spectrumLayout->getBinCount(); ++i) {
+			binMaps[0].push_back(i);
+		}
+
+		binMapStarts[0] = 0;
+
+		return;
+	}
+
+	for(unsigned int level = 0; level < levelCount; ++level) {
+		double rate = sampleRate / (1 << level);
+
+		double fLow = (level + 1 < levelCount) ? snap(rate / 8.) : 0.;
+		double fHigh = level ? snap(rate / 4.) :
+			std::numeric_limits<double>::infinity();
+
+		binMaps[level] = spectrumLayout->mapFftBins(rate, fftSize,
+			binMapStarts[level], fLow, fHigh);
+	}
 }
@@ -5,21 +5,107 @@
 #include <functional>
 #include <cstdint>
 #include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <string>
 
-#include <boost/asio.hpp>
 #include <boost/signals2.hpp>
 
-#include <fftw3.h>
-
-#include "AudioDevice.hpp"
+#include "AnalysisExecutor.hpp"
+#include "AudioSource.hpp"
+#include "FftEngine.hpp"
+#include "FramePool.hpp"
+#include "OctaveDecimator.hpp"
+#include "SampleHistory.hpp"
+#include "SharedSpectrum.hpp"
+#include "SlidingDft.hpp"
+#include "SpectrogramHistory.hpp"
 #include "Spectrum.hpp"
 
 class SpectrumAnalyzer
 {
 public:
-	SpectrumAnalyzer(std::shared_ptr<AudioDevice>& audioDevice,
+	//What to do with a new block when the job queue is full
+	enum class OverloadPolicy {
+		DropOldest,			//Discard the oldest queued block
+		DropNewest,			//Discard the new block
+		CoalesceLatest,	//Discard every queued block, keep only the new one
+		Block						//Wait for room, for sources that can be paused
+	};
+
+	//Latency histograms, each stage is measured from the end of the one
+	//before (see FrameTimes)
+	enum class LatencyStage {
+		Capture,		//Capture to enqueue: source buffering and history writes
+		Queue,			//Enqueue to dequeue: waiting for a worker
+		Fft,				//Dequeue to FFT done: window, FFT and binning
+		Reorder,		//FFT done to publish: waiting for earlier frames
+		Listeners,	//Publish to the last listener returning
+		Total				//Capture to the last listener returning
+	};
+
+	static const unsigned int LATENCY_STAGE_COUNT = 6;
+
+	//How blocks are turned into spectrums
+	enum class AnalysisEngine {
+		SingleBlock,	//One FFT per block, sized for the narrowest (lowest) bin
+		Multirate,		//A small FFT per octave over a halfband decimation
+									//cascade, see OctaveDecimator
+		SlidingDft		//Every bin updated per sample as audio arrives, see
+									//SlidingDft. Cheaper for sparse bin sets
+	};
+
+	//Multirate limits
+	static const unsigned int MIN_OCTAVE_FFT_SIZE = 32;
+	static const unsigned int MAX_LEVEL_COUNT = 16;
+
+	static const unsigned int DEFAULT_QUEUE_DEPTH = 8;
+
+	//Settings beyond the bin layout, every one has a default
+	struct Options
+	{
+		Options();
+
+		//Without an executor the analyzer runs threadCount worker threads of
+		//its own. With one (such as AnalysisExecutor::getShared()) it shares
+		//that executor's threads with other analyzers, analyzing at most
+		//threadCount blocks at once, and priority weighs it against them
+		unsigned int threadCount;
+		std::shared_ptr<AnalysisExecutor> executor;
+		unsigned int priority;
+
+		FftEngine::Mode fftMode;
+
+		//Samples between blocks, 0 for one block per audio device chunk
+		unsigned int hopSize;
+
+		unsigned int queueDepth;
+		OverloadPolicy overloadPolicy;
+
+		//With Multirate, maxBlockSize caps the per octave FFT size instead,
+		//and high octaves come from the newest few samples of a block rather
+		//than the whole block. With SlidingDft, each bin gets a window of
+		//2 * sampleRate / binWidth samples, up to maxBlockSize, and the audio
+		//callback keeps them current instead of the workers transforming
+		//blocks
+		AnalysisEngine analysisEngine;
+
+		//> 0 keeps that many of the latest delivered frames in a
+		//SpectrogramHistory, see getSpectrogram
+		size_t spectrogramFrames;
+		SpectrogramHistory::Format spectrogramFormat;
+
+		//Non-empty also publishes every delivered frame to a POSIX shared
+		//memory segment of that name for other processes, see
+		//SharedSpectrumReader
+		std::string sharedMemoryName;
+	};
+
+	SpectrumAnalyzer(std::shared_ptr<AudioSource> audioSource,
 		double fStart, double fEnd,
-		double binsPerOctave, unsigned int maxBlockSize, unsigned int threadCount = 4);
+		double binsPerOctave, unsigned int maxBlockSize,
+		const Options& options = Options());
 	~SpectrumAnalyzer();
 
 	void addListener(std::function<void(SpectrumAnalyzer*,
@@ -28,43 +114,191 @@ public:
 	void removeListener(std::function<void(SpectrumAnalyzer*,
 		std::shared_ptr<Spectrum>, std::shared_ptr<Spectrum>)>);
 
-	std::shared_ptr<AudioDevice> getAudioDevice();
+	//Every channel of each frame, for sources with more than two channels
+	void addFrameListener(std::function<void(SpectrumAnalyzer*,
+		std::shared_ptr<SpectrumFrame>)> cb);
+
+	std::shared_ptr<AudioSource> getAudioSource();
+
+	//Wait until every queued block has been delivered to the listeners
+	//Only returns once the source stops feeding audio
+	void waitForIdle();
 
+	//Spectrums of the most recently delivered frame. These are snapshots
+	//that are not modified while held, use getSnapshot to get both
+	//channels of the same frame
 	std::shared_ptr<Spectrum> getLeftSpectrum();
 	std::shared_ptr<Spectrum> getRightSpectrum();
+	std::shared_ptr<Spectrum> getSpectrum(unsigned int channel);
+	std::shared_ptr<SpectrumFrame> getSnapshot();
+
+	//Recent frames in delivery order, nullptr unless spectrogramFrames was
+	//given. A frame is added before listeners see it
+	const SpectrogramHistory* getSpectrogram() const;
+
+	//Frames skipped because readers were holding every pooled frame
+	uint64_t getStarvedFrameCount() const;
+
+	//Audio chunks lost because the analyzer fell behind the audio source
+	uint64_t getOverrunCount();
+
+	//Frames discarded because their samples were overwritten in the
+	//history before a worker got to them
+	uint64_t getOverwrittenFrameCount() const;
+
+	//Blocks discarded by the DropOldest/DropNewest overload policies
+	uint64_t getDroppedFrameCount() const;
+
+	//Blocks discarded by the CoalesceLatest overload policy
+	uint64_t getCoalescedFrameCount() const;
+
+	//Nanoseconds workers have spent on blocks, from taking one off the queue
+	//to finishing its frame (including listeners when the worker delivers)
+	//Over a wall time interval, divide by getWorkerCount() for utilization
+	uint64_t getBusyTime() const;
+
+	//Blocks analyzed at once
+	unsigned int getWorkerCount() const;
+
+	//Blocks waiting for a worker
+	unsigned int getQueueDepth();
+
+	//Per stage latency of every delivered frame since construction or the
+	//last resetLatency. Lock-free, safe to call from listeners
+	LatencyHistogram::Summary getLatency(LatencyStage stage) const;
+	const LatencyHistogram& getLatencyHistogram(LatencyStage stage) const;
+	void resetLatency();
+
+	//Audio spanned by a block, for Multirate that of the lowest level
+	unsigned int getBlockSize() const;
+	unsigned int getHopSize() const;
+
+	//Samples from the start of a block to the centre of its analysis
+	//window, the shortest one when the engine has several. Frame n is
+	//centred at n * hopSize + getWindowCenter()
+	double getWindowCenter() const;
+
+	//Size of each FFT, blockSize unless Multirate (for SlidingDft, the
+	//longest window)
+	unsigned int getFftSize() const;
+
+	//Sample rate levels, 1 unless Multirate
+	unsigned int getLevelCount() const;
+	AnalysisEngine getAnalysisEngine() const;
+	unsigned int getChannelCount() const;
+
+	//Estimated arithmetic per block relative to SingleBlock with the same
+	//block size, so below 1 when the engine is the cheaper choice
+	double getRelativeCost() const;
+
+	std::shared_ptr<AnalysisExecutor> getExecutor();
 
 private:
-	void threadRoutine();
-	void cbAudio(const int16_t* left, const int16_t* right);
-	void fftRoutine(std::vector<int16_t>, std::vector<int16_t>);
+	struct Job {
+		uint64_t blockStart;
+		Timestamp capture, enqueue;
+	};
+
+	void cbAudio(const int16_t* const* channels, Timestamp captureTime);
+	void enqueueBlock(uint64_t blockStart, Timestamp captureTime);
+	void runQueuedBlock();
+	void fftRoutine(uint64_t sequence, const Job& job, Timestamp dequeueTime);
+
+	//Fill frame with the block, false if its samples were overwritten first
+	bool transformBlock(SpectrumFrame& frame, uint64_t blockStart);
+	bool readSlidingDft(SpectrumFrame& frame, uint64_t blockStart);
+
+	void recordLatency(const FrameTimes& times, Timestamp listenersDone);
+	void chooseBlockSize(unsigned int maxBlockSize);
+	void chooseMultirateSize(unsigned int maxBlockSize);
+	void createSlidingDft(unsigned int maxBlockSize);
 	void generateWindow();
+	void generateBinMap();
+	void fillSpectrum(Spectrum& spectrum, unsigned int level,
+		const AnalysisSample* magnitudes);
 
-	static double sqr(const double x);
+	FftEngine* acquireEngine();
+	void releaseEngine(FftEngine* engine);
+
+	//Frames finished out of order are held until all earlier frames
+	//have been delivered, then published and passed to listeners in
+	//sequence order. A null frame marks a skipped sequence number
+	void deliverFrame(uint64_t sequence, SpectrumFrame* frame);
 
 	//Thread stuff
-	boost::asio::io_service ioService;
-	std::unique_ptr<boost::asio::io_service::work> workUnit;
-	std::vector<std::thread> asyncThreads;
+	std::shared_ptr<AnalysisExecutor> executor;
+	std::shared_ptr<AnalysisExecutor::Client> executorClient;
+	unsigned int workerCount; //Blocks analyzed at once
+
+	//Bin layout, shared by every frame
+	std::unique_ptr<const Spectrum> spectrumLayout;
 
-	std::shared_ptr<Spectrum> leftSpectrum, rightSpectrum;
+	//Output frames and snapshot publication
+	std::unique_ptr<FramePool> framePool;
+	std::atomic<uint64_t> starvedFrames;
+	std::unique_ptr<SpectrogramHistory> spectrogram;
+	std::unique_ptr<SharedSpectrumPublisher> sharedPublisher;
 
-	//Audio sample buffers
-	std::vector<int16_t> leftBuffer, rightBuffer;
-//	std::mutex bufferMutex;
+	//Audio sample history, jobs refer to blocks by their first sample
+	std::unique_ptr<SampleHistory> history;
+	std::unique_ptr<OctaveDecimator> decimator; //Levels below full rate
+	std::unique_ptr<SlidingDft> slidingDft; //One snapshot per block
+	uint64_t nextBlockEnd;
+	std::atomic<uint64_t> overwrittenFrames;
+	std::atomic<uint64_t> busyTime;
+
+	//Bounded job queue (ring of blocks)
+	//One task is posted to the executor per queued block, tasks that
+	//find the queue empty (their block was dropped) do nothing
+	std::vector<Job> jobQueue;
+	size_t jobHead, jobCount;
+	uint64_t nextSequence;
+	OverloadPolicy overloadPolicy;
+	std::atomic<uint64_t> droppedFrames, coalescedFrames;
+	std::mutex queueMutex;
+	std::condition_variable queueCondition;
 
 	//FFT stuff
-	fftw_complex *fftIn, *fftOut;
-	fftw_plan fftPlan;
-	std::vector<double> fftWindow;
+	//One engine (plan and aligned buffers) per worker thread, each
+	//transforming every channel with a single batched plan
+	std::vector<std::unique_ptr<FftEngine>> fftEngines;
+	std::vector<FftEngine*> freeEngines;
+	std::mutex engineMutex;
+	std::condition_variable engineCondition;
+	std::vector<AnalysisSample> fftWindow;
+
+	//Frame reordering, indexed by sequence modulo the buffer size
+	std::vector<SpectrumFrame*> pendingFrames;
+	std::vector<bool> pendingReady;
+	uint64_t blockedBlocks; //Blocks queued with OverloadPolicy::Block
+	uint64_t nextDelivery;
+	bool delivering;
+	std::mutex deliveryMutex;
+	std::condition_variable deliveryCondition;
+
+	//Per level, maps FFT bins [binMapStarts[k], binMapStarts[k] +
+	//binMaps[k].size()) to spectrum bins
+	std::vector<std::vector<uint32_t>> binMaps;
+	std::vector<unsigned int> binMapStarts;
+
+	LatencyHistogram latency[LATENCY_STAGE_COUNT];
 
 	//Signals
 	boost::signals2::signal<void(SpectrumAnalyzer*,
 		std::shared_ptr<Spectrum> left, std::shared_ptr<Spectrum> right)>
 		sigSpectrumUpdate;
+	boost::signals2::signal<void(SpectrumAnalyzer*,
+		std::shared_ptr<SpectrumFrame>)> sigFrameUpdate;
 
-	//Audio device stuff
-	std::shared_ptr<AudioDevice> audioDevice;
+	//Audio source stuff
+	std::shared_ptr<AudioSource> audioSource;
 	unsigned int callbackID;
-	unsigned int chunkSize; //Size of buffer from audio device
-	unsigned int blockSize;	//Size of buffer sent through fft
+	unsigned int channelCount;
+	unsigned int chunkSize; //Size of buffer from audio source
+	unsigned int blockSize;	//Samples covered by one block
+	unsigned int hopSize;		//Samples between consecutive blocks
+	AnalysisEngine analysisEngine;
+	unsigned int fftSize;		//Size of buffer sent through fft
+	unsigned int levelCount;
+	double windowCenter;	//Samples from block start to the window centre
 };
@@ -0,0 +1,579 @@
+#include "SpectrumPlayer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Exception.hpp"
+#include "SampleKernels.hpp"
+
+const int SpectrumPlayer::ERROR_RECORDING_OPEN;
+const int SpectrumPlayer::ERROR_RECORDING_FORMAT;
+
+//Frames and index entries follow variable size payloads, so they are
+//copied out rather than read in place
+template<typename T>
+static T readStruct(const uint8_t* p) {
+	T value;
+	std::memcpy(&value, p, sizeof(T));
+
+	return value;
+}
+
+SpectrumPlayer::SpectrumPlayer(const std::string& path)
+	:	fd{-1}
+	,	mapping{nullptr}
+	,	mappingSize{0}
+	,	frameCount{0}
+	,	decodeFrame{0}
+	,	playing{false}
+	,	stopRequested{false} {
+
+	map(path);
+
+	try {
+		buildIndex();
+	}
+	catch(...) {
+		munmap((void*)mapping, mappingSize);
+		close(fd);
+
+		throw;
+	}
+
+	framePool = std::make_unique<FramePool>(*layout, 4, header->channelCount);
+
+	std::cout << "[Info] SpectrumPlayer::SpectrumPlayer: " << path << ": "
+		<< frameCount << " frames of " << header->channelCount << " channels, "
+		<< binCount << " bins" << std::endl;
+}
+
+SpectrumPlayer::~SpectrumPlayer() {
+	stop();
+
+	if(playThread.joinable()) {
+		playThread.join();
+	}
+
+	munmap((void*)mapping, mappingSize);
+	close(fd);
+}
+
+void SpectrumPlayer::map(const std::string& path) {
+	fd = open(path.c_str(), O_RDONLY);
+
+	if(fd < 0) {
+		throw Exception(ERROR_RECORDING_OPEN, "SpectrumPlayer::map: "
+			"Failed to open " + path + ": " + std::strerror(errno));
+	}
+
+	struct stat fileStat;
+
+	if(fstat(fd, &fileStat) < 0) {
+		close(fd);
+
+		throw Exception(ERROR_RECORDING_OPEN, "SpectrumPlayer::map: "
+			"Failed to stat " + path + ": " + std::strerror(errno));
+	}
+
+	mappingSize = fileStat.st_size;
+
+	if(mappingSize < sizeof(RecordingHeader)) {
+		close(fd);
+
+		throw Exception(ERROR_RECORDING_FORMAT, "SpectrumPlayer::map: "
+			+ path + " is not a recording");
+	}
+
+	void *address = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	if(address == MAP_FAILED) {
+		close(fd);
+
+		throw Exception(ERROR_RECORDING_OPEN, "SpectrumPlayer::map: "
+			"Failed to map " + path + ": " + std::strerror(errno));
+	}
+
+	//Mostly replayed front to back
+	madvise(address, mappingSize, MADV_SEQUENTIAL);
+
+	mapping = (const uint8_t*)address;
+}
+
+void SpectrumPlayer::buildIndex() {
+	header = (const RecordingHeader*)mapping;
+
+	if(header->magic != RECORDING_MAGIC) {
+		throw Exception(ERROR_RECORDING_FORMAT, "SpectrumPlayer::buildIndex: "
+			"Not a recording");
+	}
+
+	if(header->version != RECORDING_VERSION) {
+		throw Exception(ERROR_RECORDING_FORMAT, "SpectrumPlayer::buildIndex: "
+			"Unsupported version " + std::to_string(header->version));
+	}
+
+	binCount = header->binCount;
+	rowStride = (size_t)header->channelCount * binCount;
+
+	size_t framesStart = sizeof(RecordingHeader) + sizeof(double) * (binCount + 1);
+
+	if(header->channelCount == 0 || binCount == 0 ||
+		framesStart > mappingSize ||
+		header->encoding > (uint32_t)RecordingEncoding::Delta) {
+		throw Exception(ERROR_RECORDING_FORMAT, "SpectrumPlayer::buildIndex: "
+			"Bad header");
+	}
+
+	auto edges = (const double*)(mapping + sizeof(RecordingHeader));
+
+	//Written as !(a < b) so NaN edges are caught too
+	for(size_t i = 0; i < binCount; ++i) {
+		if(!(edges[i] < edges[i + 1])) {
+			throw Exception(ERROR_RECORDING_FORMAT, "SpectrumPlayer::buildIndex: "
+				"Bin edges are not increasing");
+		}
+	}
+
+	layout = std::make_unique<Spectrum>(
+		std::vector<double>(edges, edges + binCount + 1));
+
+	levels.resize(rowStride);
+	db.resize(binCount);
+
+	//One to three bytes per level when delta coded
+	minPayload = rowStride;
+	maxPayload = 3 * rowStride;
+
+	if(header->encoding == (uint32_t)RecordingEncoding::Raw) {
+		minPayload = maxPayload = sizeof(int16_t) * rowStride;
+	}
+
+	decodeOffset = framesStart;
+
+	//A closed recording ends with the index
+	if(mappingSize >= framesStart + sizeof(RecordingFooter)) {
+		auto footer = readStruct<RecordingFooter>(mapping + mappingSize -
+			sizeof(RecordingFooter));
+
+		size_t indexEnd = mappingSize - sizeof(RecordingFooter);
+
+		//indexCount is bounded first, so the product can't wrap around
+		if(footer.magic == RECORDING_INDEX_MAGIC &&
+			footer.indexOffset >= framesStart && footer.indexOffset <= indexEnd &&
+			footer.indexCount <= (indexEnd - footer.indexOffset) /
+				sizeof(RecordingIndexEntry) &&
+			footer.indexOffset + footer.indexCount * sizeof(RecordingIndexEntry) ==
+				indexEnd) {
+
+			index.resize(footer.indexCount);
+			std::memcpy(index.data(), mapping + footer.indexOffset,
+				footer.indexCount * sizeof(RecordingIndexEntry));
+
+			frameCount = footer.frameCount;
+			framesEnd = footer.indexOffset;
+
+			checkIndex(framesStart);
+
+			return;
+		}
+	}
+
+	//Otherwise scan every frame header, up to the first incomplete or
+	//implausible one (such as a partly written index)
+	size_t offset = framesStart;
+
+	while(offset + sizeof(RecordingFrameHeader) <= mappingSize) {
+		auto frameHeader = readStruct<RecordingFrameHeader>(mapping + offset);
+		size_t end = offset + sizeof(RecordingFrameHeader) +
+			frameHeader.payloadSize;
+
+		if(frameHeader.payloadSize < minPayload ||
+			frameHeader.payloadSize > maxPayload || end > mappingSize) {
+			break;
+		}
+
+		if(frameHeader.flags & RECORDING_KEYFRAME) {
+			index.push_back({frameCount, offset, frameHeader.sequence,
+				frameHeader.capture});
+		}
+		else if(index.empty()) {
+			break;
+		}
+
+		++frameCount;
+		offset = end;
+	}
+
+	framesEnd = offset;
+
+	std::cout << "[Warning] SpectrumPlayer::buildIndex: Recording was not "
+		"closed, found " << frameCount << " complete frames" << std::endl;
+}
+
+void SpectrumPlayer::addListener(std::function<void(SpectrumAnalyzer*,
+	std::shared_ptr<Spectrum>, std::shared_ptr<Spectrum>)> cb) {
+
+	sigSpectrumUpdate.connect(cb);
+}
+
+void SpectrumPlayer::addFrameListener(std::function<void(SpectrumAnalyzer*,
+	std::shared_ptr<SpectrumFrame>)> cb) {
+
+	sigFrameUpdate.connect(cb);
+}
+
+void SpectrumPlayer::play(double speed) {
+	if(playing) {
+		return;
+	}
+
+	if(playThread.joinable()) {
+		playThread.join();
+	}
+
+	stopRequested = false;
+	playing = true;
+
+	playThread = std::thread(&SpectrumPlayer::playRoutine, this, speed);
+}
+
+void SpectrumPlayer::checkIndex(size_t framesStart) {
+	//Keyframes start at frame 0 and move forward through the frames
+	bool valid = index.empty() ? (frameCount == 0) :
+		(index[0].frame == 0 && index[0].offset == framesStart &&
+		index.back().frame < frameCount);
+
+	for(size_t i = 0; valid && i < index.size(); ++i) {
+		valid = index[i].offset >= framesStart && index[i].offset < framesEnd &&
+			(i == 0 || (index[i].frame > index[i - 1].frame &&
+				index[i].offset > index[i - 1].offset));
+	}
+
+	if(!valid) {
+		throw Exception(ERROR_RECORDING_FORMAT, "SpectrumPlayer::checkIndex: "
+			"Corrupt keyframe index");
+	}
+}
+
+RecordingFrameHeader SpectrumPlayer::readFrameHeader(size_t offset) const {
+	if(offset > framesEnd ||
+		framesEnd - offset < sizeof(RecordingFrameHeader)) {
+		throw Exception(ERROR_RECORDING_FORMAT,
+			"SpectrumPlayer::readFrameHeader: Frame at offset " +
+			std::to_string(offset) + " is past the end of the frames");
+	}
+
+	auto frameHeader = readStruct<RecordingFrameHeader>(mapping + offset);
+
+	if(frameHeader.payloadSize < minPayload ||
+		frameHeader.payloadSize > maxPayload ||
+		frameHeader.payloadSize > framesEnd - offset -
+			sizeof(RecordingFrameHeader)) {
+		throw Exception(ERROR_RECORDING_FORMAT,
+			"SpectrumPlayer::readFrameHeader: Frame at offset " +
+			std::to_string(offset) + " is truncated or corrupt");
+	}
+
+	return frameHeader;
+}
+
+void SpectrumPlayer::stop() {
+	{
+		std::unique_lock<std::mutex> playLock(playMutex);
+
+		stopRequested = true;
+	}
+
+	playCondition.notify_all();
+
+	//A listener stopping playback can't wait for itself
+	if(std::this_thread::get_id() != playThread.get_id()) {
+		waitForEnd();
+	}
+}
+
+void SpectrumPlayer::waitForEnd() {
+	std::unique_lock<std::mutex> playLock(playMutex);
+
+	playCondition.wait(playLock, [this]() {
+			return !playing;
+		});
+}
+
+bool SpectrumPlayer::isPlaying() const {
+	return playing;
+}
+
+void SpectrumPlayer::seek(uint64_t frame) {
+	moveTo(std::min(frame, frameCount));
+}
+
+uint64_t SpectrumPlayer::getPosition() const {
+	return decodeFrame;
+}
+
+void SpectrumPlayer::moveTo(uint64_t frame) {
+	if(frame == decodeFrame) {
+		return;
+	}
+
+	//Last keyframe at or before the frame
+	auto keyframe = std::upper_bound(index.begin(), index.end(), frame,
+		[](uint64_t f, const RecordingIndexEntry& entry) {
+			return f < entry.frame;
+		});
+
+	if(keyframe == index.begin()) {
+		return;
+	}
+
+	--keyframe;
+
+	//Carry on from the current position if that is no further away
+	if(frame < decodeFrame || keyframe->frame > decodeFrame) {
+		decodeFrame = keyframe->frame;
+		decodeOffset = keyframe->offset;
+	}
+
+	bool delta = (header->encoding == (uint32_t)RecordingEncoding::Delta);
+
+	while(decodeFrame < frame) {
+		if(delta) {
+			decodeNext();
+		}
+		else {
+			//Raw frames stand alone, skip over them
+			auto frameHeader = readFrameHeader(decodeOffset);
+
+			decodeOffset += sizeof(RecordingFrameHeader) + frameHeader.payloadSize;
+			++decodeFrame;
+		}
+	}
+}
+
+RecordingFrameHeader SpectrumPlayer::decodeNext() {
+	auto frameHeader = readFrameHeader(decodeOffset);
+	const uint8_t *p = mapping + decodeOffset + sizeof(RecordingFrameHeader);
+	const uint8_t *end = p + frameHeader.payloadSize;
+
+	if(header->encoding == (uint32_t)RecordingEncoding::Raw) {
+		std::memcpy(levels.data(), p, sizeof(int16_t) * rowStride);
+	}
+	else {
+		if(frameHeader.flags & RECORDING_KEYFRAME) {
+			std::fill(levels.begin(), levels.end(), 0);
+		}
+
+		for(size_t i = 0; i < rowStride && p < end; ++i) {
+			uint32_t value = 0;
+			unsigned int shift = 0;
+
+			//LEB128, then undo the zigzag
+			while(p < end && (*p & 0x80) && shift < 28) {
+				value |= (uint32_t)(*p++ & 0x7F) << shift;
+				shift += 7;
+			}
+
+			if(p < end) {
+				value |= (uint32_t)*p++ << shift;
+			}
+
+			int32_t delta = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+
+			levels[i] = (int16_t)(levels[i] + delta);
+		}
+	}
+
+	decodeOffset = end - mapping;
+	++decodeFrame;
+
+	return frameHeader;
+}
+
+void SpectrumPlayer::readFrame(uint64_t frame, SpectrumFrame& out) {
+	if(frame >= frameCount) {
+		throw Exception(ERROR_RECORDING_FORMAT, "SpectrumPlayer::readFrame: "
+			"Frame " + std::to_string(frame) + " is past the end");
+	}
+
+	if(out.channels.size() < header->channelCount ||
+		out.channels[0].getBinCount() != binCount) {
+		throw Exception(ERROR_RECORDING_FORMAT, "SpectrumPlayer::readFrame: "
+			"Frame layout does not match the recording");
+	}
+
+	moveTo(frame);
+
+	fillFrame(decodeNext(), out);
+}
+
+void SpectrumPlayer::fillFrame(const RecordingFrameHeader& frameHeader,
+	SpectrumFrame& out) {
+
+	double infinity = std::numeric_limits<double>::infinity();
+
+	for(unsigned int channel = 0; channel < header->channelCount; ++channel) {
+		const int16_t *row = &levels[channel * binCount];
+		Spectrum& spectrum = out.channels[channel];
+
+		for(size_t i = 0; i < binCount; ++i) {
+			db[i] = (row[i] == RECORDING_NO_ENERGY) ? -infinity :
+				row[i] * header->dbStep;
+		}
+
+		SampleKernels::get().fromDbFast(db.data(), spectrum.getEnergies(),
+			binCount);
+		spectrum.updateStats();
+	}
+
+	out.sequence = frameHeader.sequence;
+	out.times = FrameTimes();
+	out.times.capture = frameHeader.capture;
+}
+
+template<typename Before>
+uint64_t SpectrumPlayer::findFrame(Before before) {
+	//Last keyframe that is still before, then step through frame headers
+	auto keyframe = std::partition_point(index.begin(), index.end(),
+		[&before](const RecordingIndexEntry& entry) {
+			return before(entry.sequence, entry.capture);
+		});
+
+	if(keyframe == index.begin()) {
+		return 0;
+	}
+
+	--keyframe;
+
+	uint64_t frame = keyframe->frame;
+	size_t offset = keyframe->offset;
+
+	for(; frame < frameCount; ++frame) {
+		auto frameHeader = readFrameHeader(offset);
+
+		if(!before(frameHeader.sequence, frameHeader.capture)) {
+			break;
+		}
+
+		offset += sizeof(RecordingFrameHeader) + frameHeader.payloadSize;
+	}
+
+	return frame;
+}
+
+uint64_t SpectrumPlayer::findSequence(uint64_t sequence) {
+	return findFrame([sequence](uint64_t frameSequence, Timestamp) {
+			return frameSequence < sequence;
+		});
+}
+
+uint64_t SpectrumPlayer::findTime(Timestamp time) {
+	return findFrame([time](uint64_t, Timestamp capture) {
+			return capture < time;
+		});
+}
+
+void SpectrumPlayer::playRoutine(double speed) {
+	using namespace std::chrono;
+
+	auto startTime = steady_clock::now();
+	uint64_t firstSequence = 0;
+	bool first = true;
+
+	//Recorded time between consecutive sequence numbers
+	double period = header->hopSize / header->sampleRate;
+
+	while(decodeFrame < frameCount && !stopRequested) {
+		RecordingFrameHeader frameHeader;
+
+		try {
+			frameHeader = decodeNext();
+		}
+		catch(const Exception& e) {
+			//A corrupt frame ends playback, like the end of the recording
+			std::cout << "[Warning] SpectrumPlayer::playRoutine: " << e.what()
+				<< std::endl;
+
+			break;
+		}
+
+		if(first) {
+			firstSequence = frameHeader.sequence;
+			first = false;
+		}
+
+		if(speed > 0.) {
+			auto due = startTime + duration_cast<steady_clock::duration>(
+				duration<double>((frameHeader.sequence - firstSequence) *
+					period / speed));
+
+			std::unique_lock<std::mutex> playLock(playMutex);
+
+			if(playCondition.wait_until(playLock, due, [this]() {
+					return (bool)stopRequested;
+				})) {
+				//Not delivered, play resumes from this frame
+				playLock.unlock();
+				moveTo(decodeFrame - 1);
+
+				break;
+			}
+		}
+
+		//Readers are holding every frame, skip this one
+		SpectrumFrame *frame = framePool->acquire();
+
+		if(!frame) {
+			continue;
+		}
+
+		fillFrame(frameHeader, *frame);
+
+		auto snapshot = framePool->share(frame);
+
+		frame->times.publish = getTimestamp();
+		framePool->publish(frame);
+
+		sigSpectrumUpdate(nullptr, std::shared_ptr<Spectrum>(snapshot,
+			&frame->left), std::shared_ptr<Spectrum>(snapshot, &frame->right));
+		sigFrameUpdate(nullptr, snapshot);
+	}
+
+	{
+		std::unique_lock<std::mutex> playLock(playMutex);
+
+		playing = false;
+	}
+
+	playCondition.notify_all();
+}
+
+const RecordingHeader& SpectrumPlayer::getHeader() const {
+	return *header;
+}
+
+const Spectrum& SpectrumPlayer::getLayout() const {
+	return *layout;
+}
+
+uint64_t SpectrumPlayer::getFrameCount() const {
+	return frameCount;
+}
+
+unsigned int SpectrumPlayer::getChannelCount() const {
+	return header->channelCount;
+}
+
+std::shared_ptr<SpectrumFrame> SpectrumPlayer::getSnapshot() {
+	return framePool->getPublished();
+}
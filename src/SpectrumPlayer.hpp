@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/signals2.hpp>
+
+#include "FramePool.hpp"
+#include "RecordingFormat.hpp"
+
+class SpectrumAnalyzer;
+
+//Memory maps a recording written by SpectrumRecorder and replays it
+//through the same listener callbacks as SpectrumAnalyzer (with a null
+//analyzer), on a thread of its own, at any speed. Frames can also be
+//decoded directly with readFrame. A recording that was cut short is
+//indexed by scanning it, and replays up to its last complete frame.
+
+class SpectrumPlayer
+{
+public:
+	static const int ERROR_RECORDING_OPEN = 0x6001;
+	static const int ERROR_RECORDING_FORMAT = 0x6002;
+
+	SpectrumPlayer(const std::string& path);
+	~SpectrumPlayer();
+
+	SpectrumPlayer(const SpectrumPlayer&) = delete;
+	SpectrumPlayer& operator=(const SpectrumPlayer&) = delete;
+
+	void addListener(std::function<void(SpectrumAnalyzer*,
+		std::shared_ptr<Spectrum>, std::shared_ptr<Spectrum>)> cb);
+	void addFrameListener(std::function<void(SpectrumAnalyzer*,
+		std::shared_ptr<SpectrumFrame>)> cb);
+
+	//Deliver frames from the current position, speed times faster than
+	//they were recorded (frames are hopSize / sampleRate apart, gaps in
+	//the sequence numbers are kept). speed <= 0 delivers frames as fast as
+	//the listeners take them
+	void play(double speed = 1.);
+
+	//Stop after the frame being delivered, safe to call from a listener
+	void stop();
+
+	//Blocks until the end of the recording is reached (or play is stopped)
+	void waitForEnd();
+	bool isPlaying() const;
+
+	//Where play continues from, only while stopped
+	void seek(uint64_t frame);
+	uint64_t getPosition() const;
+
+	//Decode a frame into one with this recording's layout and channel count
+	//Only while stopped. Sequential reads are cheapest, others decode from
+	//the keyframe before. Corrupt frames throw ERROR_RECORDING_FORMAT, and
+	//end play early
+	void readFrame(uint64_t frame, SpectrumFrame& out);
+
+	//First frame with a sequence number, or capture time, at or after the
+	//given one. getFrameCount() if there is none
+	uint64_t findSequence(uint64_t sequence);
+	uint64_t findTime(Timestamp time);
+
+	const RecordingHeader& getHeader() const;
+	const Spectrum& getLayout() const;
+	uint64_t getFrameCount() const;
+	unsigned int getChannelCount() const;
+
+	//Most recently delivered frame, nullptr before the first
+	std::shared_ptr<SpectrumFrame> getSnapshot();
+
+private:
+	void map(const std::string& path);
+	void buildIndex();
+
+	//Keyframes from the footer must point at frames, in order
+	void checkIndex(size_t framesStart);
+
+	//Header of the frame at offset, whose payload is checked to be a
+	//plausible size and to lie within the frames
+	RecordingFrameHeader readFrameHeader(size_t offset) const;
+
+	//Move the decoder to a frame, at most one keyframe interval of decoding
+	void moveTo(uint64_t frame);
+
+	//Decode the frame at the decoder position into levels, then advance
+	RecordingFrameHeader decodeNext();
+
+	//Levels to energies
+	void fillFrame(const RecordingFrameHeader& frameHeader, SpectrumFrame& out);
+
+	//First frame for which before(sequence, capture) is false
+	template<typename Before>
+	uint64_t findFrame(Before before);
+
+	void playRoutine(double speed);
+
+	int fd;
+	const uint8_t *mapping;
+	size_t mappingSize;
+
+	const RecordingHeader *header;
+	std::unique_ptr<Spectrum> layout;
+	size_t binCount, rowStride;
+
+	//Keyframes, from the footer or a scan
+	std::vector<RecordingIndexEntry> index;
+	uint64_t frameCount;
+	size_t framesEnd;	//Offset just past the last complete frame
+	size_t minPayload, maxPayload;
+
+	//Decoder, at the frame that decodeNext reads
+	uint64_t decodeFrame;
+	size_t decodeOffset;
+	std::vector<int16_t> levels;
+	std::vector<double> db;
+
+	std::unique_ptr<FramePool> framePool;
+
+	//Playback thread
+	std::thread playThread;
+	std::atomic<bool> playing, stopRequested;
+	std::mutex playMutex;
+	std::condition_variable playCondition;
+
+	boost::signals2::signal<void(SpectrumAnalyzer*,
+		std::shared_ptr<Spectrum> left, std::shared_ptr<Spectrum> right)>
+		sigSpectrumUpdate;
+	boost::signals2::signal<void(SpectrumAnalyzer*,
+		std::shared_ptr<SpectrumFrame>)> sigFrameUpdate;
+};
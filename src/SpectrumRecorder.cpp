@@ -0,0 +1,264 @@
+#include "SpectrumRecorder.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "Exception.hpp"
+#include "SampleKernels.hpp"
+
+const int SpectrumRecorder::ERROR_RECORDING_OPEN;
+const unsigned int SpectrumRecorder::DEFAULT_KEYFRAME_INTERVAL;
+const double SpectrumRecorder::DEFAULT_DB_STEP = 0.01;
+const size_t SpectrumRecorder::MAX_PENDING_BYTES;
+
+template<typename T>
+static void append(std::vector<uint8_t>& out, const T& value) {
+	auto bytes = (const uint8_t*)&value;
+
+	out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+SpectrumRecorder::SpectrumRecorder(const std::string& _path,
+	const Spectrum& layout, unsigned int _channelCount, double sampleRate,
+	unsigned int hopSize, RecordingEncoding _encoding,
+	unsigned int _keyframeInterval, double _dbStep)
+	:	file(_path, std::ios::binary | std::ios::trunc)
+	,	path{_path}
+	,	encoding{_encoding}
+	,	keyframeInterval{std::max(_keyframeInterval, 1U)}
+	,	dbStep{_dbStep}
+	,	binCount{layout.getBinCount()}
+	,	rowStride{_channelCount * binCount}
+	,	channelCount{_channelCount}
+	,	levels(rowStride)
+	,	previousLevels(rowStride)
+	,	sinceKeyframe{0}
+	,	needKeyframe{true}
+	,	frameCount{0}
+	,	droppedFrames{0}
+	,	size{0}
+	,	closing{false}
+	,	failed{false} {
+
+	if(!file) {
+		throw Exception(ERROR_RECORDING_OPEN, "SpectrumRecorder::SpectrumRecorder: "
+			"Failed to open " + path + ": " + std::strerror(errno));
+	}
+
+	RecordingHeader header{};
+
+	header.magic = RECORDING_MAGIC;
+	header.version = RECORDING_VERSION;
+	header.channelCount = channelCount;
+	header.binCount = binCount;
+	header.encoding = (uint32_t)encoding;
+	header.keyframeInterval = keyframeInterval;
+	header.hopSize = hopSize;
+	header.sampleRate = sampleRate;
+	header.dbStep = dbStep;
+	header.startTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+	header.startTimestamp = getTimestamp();
+
+	append(pending, header);
+
+	const double *edges = layout.getFreqEdges();
+	pending.insert(pending.end(), (const uint8_t*)edges,
+		(const uint8_t*)(edges + binCount + 1));
+
+	size = pending.size();
+
+	writeThread = std::thread(&SpectrumRecorder::writeRoutine, this);
+}
+
+SpectrumRecorder::~SpectrumRecorder() {
+	close();
+}
+
+void SpectrumRecorder::record(const SpectrumFrame& frame) {
+	{
+		std::unique_lock<std::mutex> pendingLock(pendingMutex);
+
+		if(closing) {
+			return;
+		}
+
+		//The disk is not keeping up, drop the frame rather than grow forever
+		if(pending.size() > MAX_PENDING_BYTES) {
+			++droppedFrames;
+			needKeyframe = true;
+
+			return;
+		}
+	}
+
+	for(unsigned int channel = 0; channel < channelCount; ++channel) {
+		SampleKernels::get().quantizeDb(frame.channels[channel].getEnergies(),
+			dbStep, RECORDING_NO_ENERGY, &levels[channel * binCount], binCount);
+	}
+
+	bool keyframe = needKeyframe || sinceKeyframe >= keyframeInterval;
+
+	RecordingFrameHeader frameHeader{};
+
+	frameHeader.flags = keyframe ? RECORDING_KEYFRAME : 0;
+	frameHeader.sequence = frame.sequence;
+	frameHeader.capture = frame.times.capture;
+
+	encoded.clear();
+	append(encoded, frameHeader);
+
+	if(encoding == RecordingEncoding::Raw) {
+		encoded.insert(encoded.end(), (const uint8_t*)levels.data(),
+			(const uint8_t*)(levels.data() + rowStride));
+	}
+	else {
+		if(keyframe) {
+			std::fill(previousLevels.begin(), previousLevels.end(), 0);
+		}
+
+		encodeDelta(levels.data(), previousLevels.data());
+		levels.swap(previousLevels);
+	}
+
+	auto header = (RecordingFrameHeader*)encoded.data();
+	header->payloadSize = encoded.size() - sizeof(RecordingFrameHeader);
+
+	if(keyframe) {
+		index.push_back({frameCount, size, frame.sequence,
+			frame.times.capture});
+
+		sinceKeyframe = 0;
+		needKeyframe = false;
+	}
+
+	++sinceKeyframe;
+	++frameCount;
+	size += encoded.size();
+
+	{
+		std::unique_lock<std::mutex> pendingLock(pendingMutex);
+
+		pending.insert(pending.end(), encoded.begin(), encoded.end());
+	}
+
+	pendingCondition.notify_one();
+}
+
+void SpectrumRecorder::encodeDelta(const int16_t* current,
+	const int16_t* previous) {
+
+	for(size_t i = 0; i < rowStride; ++i) {
+		int32_t delta = (int32_t)current[i] - previous[i];
+
+		//Zigzag, small changes of either sign become small numbers
+		uint32_t value = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+
+		//7 bits per byte, high bit set on all but the last
+		while(value >= 0x80) {
+			encoded.push_back((uint8_t)(value | 0x80));
+			value >>= 7;
+		}
+
+		encoded.push_back((uint8_t)value);
+	}
+}
+
+void SpectrumRecorder::close() {
+	{
+		std::unique_lock<std::mutex> pendingLock(pendingMutex);
+
+		if(closing) {
+			return;
+		}
+
+		closing = true;
+	}
+
+	pendingCondition.notify_one();
+	writeThread.join();
+
+	//Every frame is on disk, finish with the index
+	std::vector<uint8_t> trailer;
+	RecordingFooter footer{};
+
+	footer.indexOffset = size;
+	footer.indexCount = index.size();
+	footer.frameCount = frameCount;
+	footer.magic = RECORDING_INDEX_MAGIC;
+
+	trailer.insert(trailer.end(), (const uint8_t*)index.data(),
+		(const uint8_t*)(index.data() + index.size()));
+	append(trailer, footer);
+
+	write(trailer);
+	file.close();
+
+	//Whatever was still buffered is only written by close
+	if(!file) {
+		failed = true;
+	}
+
+	if(failed) {
+		std::cout << "[Warning] SpectrumRecorder::close: Failed to write "
+			<< path << ", the recording is incomplete" << std::endl;
+	}
+}
+
+void SpectrumRecorder::writeRoutine() {
+	std::vector<uint8_t> writing;
+
+	std::unique_lock<std::mutex> pendingLock(pendingMutex);
+
+	while(true) {
+		pendingCondition.wait(pendingLock, [this]() {
+				return closing || !pending.empty();
+			});
+
+		if(pending.empty()) {
+			//Closing and nothing left to write
+			break;
+		}
+
+		writing.swap(pending);
+
+		//Write without holding the lock so record() is never blocked on disk
+		pendingLock.unlock();
+
+		write(writing);
+		writing.clear();
+
+		pendingLock.lock();
+	}
+}
+
+void SpectrumRecorder::write(const std::vector<uint8_t>& data) {
+	if(failed) {
+		return;
+	}
+
+	file.write((const char*)data.data(), data.size());
+
+	if(!file) {
+		failed = true;
+	}
+}
+
+uint64_t SpectrumRecorder::getFrameCount() const {
+	return frameCount;
+}
+
+uint64_t SpectrumRecorder::getDroppedFrameCount() const {
+	return droppedFrames;
+}
+
+uint64_t SpectrumRecorder::getSize() const {
+	return size;
+}
+
+bool SpectrumRecorder::hasFailed() const {
+	return failed;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FramePool.hpp"
+#include "RecordingFormat.hpp"
+
+//Writes frames to a compact binary recording, see RecordingFormat.hpp.
+//record() quantizes and encodes a frame on the calling thread (usually a
+//frame listener) and queues the bytes for a thread of its own to write, so
+//a slow disk does not hold up frame delivery. If the disk falls more than
+//MAX_PENDING_BYTES behind, frames are dropped and the next one recorded is
+//a keyframe.
+
+class SpectrumRecorder
+{
+public:
+	static const int ERROR_RECORDING_OPEN = 0x6000;
+
+	static const unsigned int DEFAULT_KEYFRAME_INTERVAL = 256;
+	static const double DEFAULT_DB_STEP;
+
+	static const size_t MAX_PENDING_BYTES = 64 << 20;
+
+	SpectrumRecorder(const std::string& path, const Spectrum& layout,
+		unsigned int channelCount, double sampleRate, unsigned int hopSize,
+		RecordingEncoding encoding = RecordingEncoding::Delta,
+		unsigned int keyframeInterval = DEFAULT_KEYFRAME_INTERVAL,
+		double dbStep = DEFAULT_DB_STEP);
+
+	//Closes the recording
+	~SpectrumRecorder();
+
+	SpectrumRecorder(const SpectrumRecorder&) = delete;
+	SpectrumRecorder& operator=(const SpectrumRecorder&) = delete;
+
+	//Append a frame, from one thread at a time
+	void record(const SpectrumFrame& frame);
+
+	//Write everything queued, then the index and footer. Nothing can be
+	//recorded afterwards
+	void close();
+
+	//Frames recorded, and dropped because the disk fell behind
+	uint64_t getFrameCount() const;
+	uint64_t getDroppedFrameCount() const;
+
+	//Bytes queued so far, the file size once closed (less the index)
+	uint64_t getSize() const;
+
+	//True once a write has failed, nothing more is written after that
+	bool hasFailed() const;
+
+private:
+	void writeRoutine();
+	void write(const std::vector<uint8_t>& data);
+
+	void encodeDelta(const int16_t* levels, const int16_t* previous);
+
+	std::ofstream file;
+	std::string path;
+
+	RecordingEncoding encoding;
+	unsigned int keyframeInterval;
+	double dbStep;
+	size_t binCount, rowStride;
+	unsigned int channelCount;
+
+	//Encoder state, used by record() only
+	std::vector<int16_t> levels, previousLevels;
+	std::vector<uint8_t> encoded;
+	std::vector<RecordingIndexEntry> index;
+	uint64_t sinceKeyframe;
+	bool needKeyframe;
+	std::atomic<uint64_t> frameCount, droppedFrames, size;
+
+	//Bytes waiting for the write thread
+	std::vector<uint8_t> pending;
+	bool closing;
+	std::atomic<bool> failed;
+	std::mutex pendingMutex;
+	std::condition_variable pendingCondition;
+	std::thread writeThread;
+};
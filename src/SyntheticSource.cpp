@@ -0,0 +1,175 @@
+#include "SyntheticSource.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+#define TWO_PI	6.283185307179586
+
+const int SyntheticSource::ALL_CHANNELS;
+
+SyntheticSource::SyntheticSource(unsigned int _sampleRate,
+	unsigned int _blockSize, Pacing _pacing, uint64_t _length, uint64_t _seed,
+	unsigned int _channelCount)
+	:	ThreadedSource(_sampleRate, _blockSize, _channelCount, _pacing)
+	,	length{_length}
+	,	seed{_seed}
+	,	position{0}
+	,	mix(_blockSize * _channelCount)
+	,	scratch(_blockSize) {
+}
+
+SyntheticSource::~SyntheticSource() {
+	stopThread();
+}
+
+void SyntheticSource::addTone(double frequency, double amplitude,
+	int channel, double phase) {
+
+	Component tone{};
+
+	tone.type = Type::Tone;
+	tone.channel = channel;
+	tone.amplitude = amplitude;
+	tone.phase = phase;
+	tone.phaseStep = TWO_PI * frequency / sampleRate;
+
+	components.push_back(tone);
+}
+
+void SyntheticSource::addSweep(double fStart, double fEnd, double period,
+	double amplitude, int channel) {
+
+	Component sweep{};
+
+	sweep.type = Type::Sweep;
+	sweep.channel = channel;
+	sweep.amplitude = amplitude;
+	sweep.sweepLength = std::max<uint64_t>(1, period * sampleRate);
+
+	//f[n] = fStart * growth^n
+	sweep.sweepStart = TWO_PI * fStart / sampleRate;
+	sweep.sweepGrowth = std::pow(fEnd / fStart, 1. / sweep.sweepLength);
+	sweep.phaseStep = sweep.sweepStart;
+
+	components.push_back(sweep);
+}
+
+void SyntheticSource::addNoise(double amplitude, int channel) {
+	Component noise{};
+
+	noise.type = Type::Noise;
+	noise.channel = channel;
+	noise.amplitude = amplitude;
+
+	//Distinct non-zero state per noise component
+	noise.noiseState = (seed + components.size()) * 0x9E3779B97F4A7C15ULL;
+
+	if(noise.noiseState == 0) {
+		noise.noiseState = 1;
+	}
+
+	components.push_back(noise);
+}
+
+uint64_t SyntheticSource::getPosition() const {
+	return position.load(std::memory_order_relaxed);
+}
+
+uint64_t SyntheticSource::getLength() const {
+	return length;
+}
+
+bool SyntheticSource::generate(int16_t* const* channels) {
+	uint64_t position = this->position.load(std::memory_order_relaxed);
+
+	if(length && position >= length) {
+		return false;
+	}
+
+	size_t count = blockSize;
+
+	if(length) {
+		count = std::min<uint64_t>(count, length - position);
+	}
+
+	std::fill(mix.begin(), mix.end(), 0.);
+
+	for(auto& component : components) {
+		render(component, scratch.data(), count);
+
+		for(unsigned int channel = 0; channel < channelCount; ++channel) {
+			if(component.channel != ALL_CHANNELS &&
+				component.channel != (int)channel) {
+				continue;
+			}
+
+			double *out = &mix[channel * blockSize];
+
+			for(size_t i = 0; i < count; ++i) {
+				out[i] += scratch[i];
+			}
+		}
+	}
+
+	for(unsigned int channel = 0; channel < channelCount; ++channel) {
+		const double *in = &mix[channel * blockSize];
+		int16_t *out = channels[channel];
+
+		for(size_t i = 0; i < blockSize; ++i) {
+			//Past count the mix is still zero
+			out[i] = std::lround(std::max(-1., std::min(1., in[i])) * INT16_MAX);
+		}
+	}
+
+	this->position.store(position + count, std::memory_order_relaxed);
+
+	return true;
+}
+
+void SyntheticSource::render(Component& component, double* out,
+	size_t count) {
+
+	switch(component.type) {
+		case Type::Tone:
+			for(size_t i = 0; i < count; ++i) {
+				out[i] = component.amplitude * std::sin(component.phase);
+
+				component.phase += component.phaseStep;
+			}
+		break;
+
+		case Type::Sweep:
+			for(size_t i = 0; i < count; ++i) {
+				out[i] = component.amplitude * std::sin(component.phase);
+
+				component.phase += component.phaseStep;
+				component.phaseStep *= component.sweepGrowth;
+
+				if(++component.sweepPosition == component.sweepLength) {
+					component.sweepPosition = 0;
+					component.phaseStep = component.sweepStart;
+				}
+			}
+		break;
+
+		case Type::Noise:
+			for(size_t i = 0; i < count; ++i) {
+				uint64_t& x = component.noiseState;
+
+				x ^= x >> 12;
+				x ^= x << 25;
+				x ^= x >> 27;
+
+				//Top 53 bits to [-1, 1)
+				double uniform = (double)((x * 0x2545F4914F6CDD1DULL) >> 11) *
+					(1. / 4503599627370496.) - 1.;
+
+				out[i] = component.amplitude * uniform;
+			}
+		break;
+	}
+
+	//Keep phases small so precision doesn't drift over long runs
+	component.phase = std::fmod(component.phase, TWO_PI);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include "ThreadedSource.hpp"
+
+//Generated test audio: any mix of tones, logarithmic sweeps and white noise
+//per channel. The output only depends on the components, sample rate and
+//seed, so runs are reproducible across machines
+//Components must be added before the stream is started
+
+class SyntheticSource : public ThreadedSource
+{
+public:
+	//Component channel for every channel of the source
+	static const int ALL_CHANNELS = -1;
+
+	//length is in samples per channel, 0 for endless
+	SyntheticSource(unsigned int sampleRate, unsigned int blockSize,
+		Pacing pacing = Pacing::Free, uint64_t length = 0,
+		uint64_t seed = 1, unsigned int channelCount = 2);
+
+	~SyntheticSource();
+
+	//Amplitudes are relative to full scale, the sum is clipped to int16
+	//channel is an index (0 is left, 1 is right) or ALL_CHANNELS
+	void addTone(double frequency, double amplitude,
+		int channel = ALL_CHANNELS, double phase = 0.);
+
+	//Sweeps from fStart to fEnd (exponentially) over period seconds,
+	//then starts over
+	void addSweep(double fStart, double fEnd, double period,
+		double amplitude, int channel = ALL_CHANNELS);
+
+	//Uniform white noise
+	void addNoise(double amplitude, int channel = ALL_CHANNELS);
+
+	//Samples per channel generated so far
+	uint64_t getPosition() const;
+	uint64_t getLength() const;
+
+protected:
+	bool generate(int16_t* const* channels) override;
+
+private:
+	enum class Type {
+		Tone,
+		Sweep,
+		Noise
+	};
+
+	struct Component {
+		Type type;
+		int channel;
+		double amplitude;
+
+		//Tone/sweep phase in radians and increment per sample
+		double phase, phaseStep;
+
+		//Sweep: per sample frequency growth and samples per period
+		double sweepStart, sweepGrowth;
+		uint64_t sweepLength, sweepPosition;
+
+		//Noise: xorshift64* state
+		uint64_t noiseState;
+	};
+
+	void render(Component& component, double* out, size_t count);
+
+	std::vector<Component> components;
+	uint64_t length, seed;
+	std::atomic<uint64_t> position;
+
+	//Mix buffer, one chunk per channel
+	std::vector<double> mix, scratch;
+};
@@ -0,0 +1,176 @@
+#include "ThreadedSource.hpp"
+
+#include <chrono>
+#include <vector>
+
+const int ThreadedSource::ERROR_CALLBACK_INVALID_ID;
+
+ThreadedSource::ThreadedSource(unsigned int _sampleRate,
+	unsigned int _blockSize, unsigned int _channelCount, Pacing _pacing)
+	:	sampleRate{_sampleRate}
+	,	blockSize{_blockSize}
+	,	channelCount{_channelCount}
+	,	nextCallbackID{0}
+	,	running{false}
+	,	pacing{_pacing}
+	,	overruns{0} {
+}
+
+ThreadedSource::~ThreadedSource() {
+	stopThread();
+}
+
+unsigned int ThreadedSource::addCallback(Callback cb) {
+	std::unique_lock<std::mutex> callbackLock(callbackMutex);
+
+	unsigned int id = nextCallbackID++;
+
+	callbacks.emplace(id, cb);
+
+	return id;
+}
+
+void ThreadedSource::removeCallback(unsigned int id) {
+	//Waits for the chunk being fed to finish
+	std::unique_lock<std::mutex> callbackLock(callbackMutex);
+
+	if(callbacks.erase(id) == 0) {
+		throw Exception(ERROR_CALLBACK_INVALID_ID,
+			"ThreadedSource::removeCallback: Invalid callback ID");
+	}
+}
+
+int ThreadedSource::startStream() {
+	std::unique_lock<std::mutex> stateLock(stateMutex);
+
+	if(running) {
+		return 0;
+	}
+
+	//Previous run reached the end on its own
+	if(feedThread.joinable()) {
+		feedThread.join();
+	}
+
+	running = true;
+	feedThread = std::thread(&ThreadedSource::feedRoutine, this);
+
+	return 0;
+}
+
+int ThreadedSource::stopStream() {
+	stopThread();
+
+	return 0;
+}
+
+unsigned int ThreadedSource::getSampleRate() {
+	return sampleRate;
+}
+
+unsigned int ThreadedSource::getBlockSize() {
+	return blockSize;
+}
+
+unsigned int ThreadedSource::getChannelCount() {
+	return channelCount;
+}
+
+bool ThreadedSource::isRunning() {
+	return running;
+}
+
+uint64_t ThreadedSource::getOverrunCount(unsigned int id) {
+	std::unique_lock<std::mutex> callbackLock(callbackMutex);
+
+	if(callbacks.find(id) == callbacks.end()) {
+		throw Exception(ERROR_CALLBACK_INVALID_ID,
+			"ThreadedSource::getOverrunCount: Invalid callback ID");
+	}
+
+	return overruns.load(std::memory_order_relaxed);
+}
+
+void ThreadedSource::waitForEnd() {
+	std::unique_lock<std::mutex> stateLock(stateMutex);
+
+	stateCondition.wait(stateLock, [this]() {
+			return !running;
+		});
+}
+
+void ThreadedSource::setPacing(Pacing _pacing) {
+	pacing = _pacing;
+}
+
+ThreadedSource::Pacing ThreadedSource::getPacing() const {
+	return pacing;
+}
+
+void ThreadedSource::stopThread() {
+	std::thread thread;
+
+	{
+		std::unique_lock<std::mutex> stateLock(stateMutex);
+
+		running = false;
+		thread = std::move(feedThread);
+	}
+
+	//Joined without stateMutex, the source thread takes it when it runs out
+	//of audio
+	if(thread.joinable()) {
+		thread.join();
+	}
+
+	stateCondition.notify_all();
+}
+
+void ThreadedSource::feedRoutine() {
+	std::vector<int16_t> samples(blockSize * channelCount);
+	std::vector<int16_t*> channels(channelCount);
+
+	for(unsigned int channel = 0; channel < channelCount; ++channel) {
+		channels[channel] = &samples[channel * blockSize];
+	}
+
+	bool clocked = (pacing == Pacing::Clocked);
+
+	auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>((double)blockSize / sampleRate));
+	auto deadline = std::chrono::steady_clock::now();
+
+	while(running && generate(channels.data())) {
+		if(clocked) {
+			//A sound card hands over a chunk once it has been recorded
+			deadline += period;
+			std::this_thread::sleep_until(deadline);
+
+			if(std::chrono::steady_clock::now() > deadline + period) {
+				//More than a chunk behind, drop this one like a device would
+				overruns.fetch_add(1, std::memory_order_relaxed);
+				continue;
+			}
+		}
+
+		//Clocked chunks are captured at their deadline, free running ones
+		//as they are produced
+		Timestamp captureTime = clocked ? std::chrono::duration_cast<
+			std::chrono::nanoseconds>(deadline.time_since_epoch()).count() :
+			getTimestamp();
+
+		std::unique_lock<std::mutex> callbackLock(callbackMutex);
+
+		for(auto& callback : callbacks) {
+			callback.second(channels.data(), captureTime);
+		}
+	}
+
+	{
+		std::unique_lock<std::mutex> stateLock(stateMutex);
+
+		running = false;
+	}
+
+	stateCondition.notify_all();
+}
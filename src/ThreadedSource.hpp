@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "AudioSource.hpp"
+#include "Exception.hpp"
+
+//Base for sources that produce their audio on a thread of their own rather
+//than a sound card, such as files and generated signals
+//Chunks are passed to every callback in turn, on the source thread
+
+class ThreadedSource : public AudioSource
+{
+public:
+	enum class Pacing {
+		Free,		//Next chunk as soon as the callbacks return, nothing is lost
+		Clocked	//One chunk per chunk period like a sound card, chunks are
+						//skipped (and counted as overruns) when callbacks fall behind
+	};
+
+	//Error codes
+	static const int ERROR_CALLBACK_INVALID_ID = 0x4100;
+
+	virtual ~ThreadedSource();
+
+	ThreadedSource(const ThreadedSource&) = delete;
+	ThreadedSource& operator=(const ThreadedSource&) = delete;
+
+	unsigned int addCallback(Callback cb) override;
+	void removeCallback(unsigned int id) override;
+
+	//Continues where the last stopStream left off
+	int startStream() override;
+	int stopStream() override;
+
+	unsigned int getSampleRate() override;
+	unsigned int getBlockSize() override;
+	unsigned int getChannelCount() override;
+
+	//False once the source runs out of audio
+	bool isRunning() override;
+
+	//Chunks skipped by Clocked pacing, the same for every callback
+	uint64_t getOverrunCount(unsigned int id) override;
+
+	//Blocks until the source runs out of audio (or the stream is stopped)
+	void waitForEnd();
+
+	//Takes effect on the next startStream
+	void setPacing(Pacing pacing);
+	Pacing getPacing() const;
+
+protected:
+	ThreadedSource(unsigned int sampleRate, unsigned int blockSize,
+		unsigned int channelCount, Pacing pacing);
+
+	//Produce the next blockSize samples for each of channelCount channels,
+	//zero padded at the end of the audio. Returns false (without producing
+	//anything) once there is no more audio. Called on the source thread only
+	virtual bool generate(int16_t* const* channels) = 0;
+
+	//generate is called until this returns, so derived classes must call it
+	//from their destructor
+	void stopThread();
+
+	unsigned int sampleRate, blockSize, channelCount;
+
+private:
+	void feedRoutine();
+
+	//Callbacks, called in id order for every chunk
+	std::map<unsigned int, Callback> callbacks;
+	std::mutex callbackMutex;
+	unsigned int nextCallbackID;
+
+	//Source thread
+	std::thread feedThread;
+	std::atomic<bool> running;
+	std::atomic<Pacing> pacing;
+	std::atomic<uint64_t> overruns;
+	std::mutex stateMutex;
+	std::condition_variable stateCondition;
+};
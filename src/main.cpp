@@ -3,7 +3,8 @@
 #include <chrono>
 #include <cmath>
 #include <memory>
-#include <mutex>
+#include <atomic>
+#include <vector>
 
 #include "AudioDevice.hpp"
 #include "SpectrumAnalyzer.hpp"
@@ -14,9 +15,21 @@
 
 #define SAMPLE_RATE		48000
 #define CHUNK_SIZE		512
+#define CHANNEL_COUNT	2
 #define MAX_BLOCK_SIZE	4096
 
-#define THREAD_COUNT	1
+#define THREAD_COUNT	4
+
+#define FFT_MODE	FftEngine::Mode::PackedStereo
+
+#define HOP_SIZE	CHUNK_SIZE
+#define QUEUE_DEPTH	8
+#define OVERLOAD_POLICY	SpectrumAnalyzer::OverloadPolicy::CoalesceLatest
+
+//Plans from a previous run start instantly, new sizes are estimated and
+//re-planned in the background
+#define WISDOM_FILE	"SpectrumAnalyzer.wisdom"
+#define PLAN_STRATEGY	FftPlanCache::Strategy::Background
 
 #define FSTART	32.7032			//C1
 #define FEND		16744.0384	//C10
@@ -25,6 +38,9 @@
 #define WIN_WIDTH		1000
 #define WIN_HEIGHT	600
 
+#define RENDER_RATE	60	//Frames per second
+#define PEAK_DECAY	70.	//dB per second
+
 struct X11_t {
 	Display *dis;
 	int screen;
@@ -32,12 +48,38 @@ struct X11_t {
 	GC gc;
 };
 
-std::mutex displayMutex;
+//Drawing happens on a thread of its own at RENDER_RATE, with its own
+//display connection (the main thread's waits for events). Each frame is
+//drawn into a pixmap, bars batched into one request, then copied to the
+//window, so nothing flickers and there is one flush per frame
+struct Renderer_t {
+	Display *dis;
+	Pixmap buffer;
+	GC gc;
+	unsigned long black, white;
+
+	std::atomic<bool> running;
+	std::thread thread;
+
+	//Bar levels and their decaying peaks, in dB
+	std::vector<double> levelDB, peakDB;
+	std::vector<XRectangle> bars;
+
+	//Time spent drawing each frame, and between frame starts
+	LatencyHistogram drawTime, frameInterval;
+	uint64_t lateFrames; //Periods skipped because a frame overran
+};
 
 void x_init(X11_t* x11);
 void x_close(X11_t* x11);
 
-void x_drawSpectrum(X11_t*, std::shared_ptr<Spectrum>);
+void x_initRenderer(Renderer_t* renderer, X11_t* x11);
+void x_closeRenderer(Renderer_t* renderer);
+
+void x_renderRoutine(Renderer_t* renderer, Window win,
+	SpectrumAnalyzer* spectrumAnalyzer);
+void x_drawSpectrum(Renderer_t* renderer, Window win, const Spectrum& spectrum,
+	double peakDecay);
 
 int main() {
 	X11_t x11;
@@ -45,24 +87,41 @@ int main() {
 	//Initialize X11
 	x_init(&x11);
 
+	FftPlanCache::get().setStrategy(PLAN_STRATEGY);
+	FftPlanCache::get().setWisdomFile(WISDOM_FILE);
+
 	std::shared_ptr<AudioDevice> audioDevice(
 		std::make_shared<AudioDevice>(AudioDevice::DEFAULT_DEVICE,
-		SAMPLE_RATE, CHUNK_SIZE));
+		SAMPLE_RATE, CHUNK_SIZE, AudioDevice::DEFAULT_RING_SIZE, CHANNEL_COUNT));
+
+	SpectrumAnalyzer::Options options;
+
+	options.threadCount = THREAD_COUNT;
+	options.fftMode = FFT_MODE;
+	options.hopSize = HOP_SIZE;
+	options.queueDepth = QUEUE_DEPTH;
+	options.overloadPolicy = OVERLOAD_POLICY;
 
 	SpectrumAnalyzer spectrumAnalyzer(audioDevice, FSTART, FEND,
-		BINS_PER_OCTAVE, MAX_BLOCK_SIZE, THREAD_COUNT);
+		BINS_PER_OCTAVE, MAX_BLOCK_SIZE, options);
 
-	spectrumAnalyzer.addListener([&x11](auto, auto left, auto) {
+	spectrumAnalyzer.addListener([](auto, auto left, auto) {
 /*
 		std::cout << "[Info] Dominant Frequency: "
 			<< (int)left->getMaxFrequency() << "Hz\t\t"
 			<< (int)right->getMaxFrequency() << "Hz" << std::endl;
 */
 		std::cout << "[Info] Average energy: " << (int)left->getAverageEnergyDB() << "dB" << std::endl;
-
-		x_drawSpectrum(&x11, left);
 	});
 
+	//The renderer pulls snapshots itself, listeners never touch X11
+	Renderer_t renderer;
+	x_initRenderer(&renderer, &x11);
+
+	renderer.running = true;
+	renderer.thread = std::thread(x_renderRoutine, &renderer, x11.win,
+		&spectrumAnalyzer);
+
 	//Start stream
 	audioDevice->startStream();
 
@@ -89,7 +148,34 @@ int main() {
 
 	audioDevice->stopStream();
 
+	renderer.running = false;
+	renderer.thread.join();
+
+	//Where the motion-to-photon budget went
+	const char* stageNames[SpectrumAnalyzer::LATENCY_STAGE_COUNT] = {"capture",
+		"queue", "fft", "reorder", "listeners", "total"};
+
+	for(unsigned int i = 0; i < SpectrumAnalyzer::LATENCY_STAGE_COUNT; ++i) {
+		auto summary = spectrumAnalyzer.getLatency(
+			(SpectrumAnalyzer::LatencyStage)i);
+
+		std::cout << "[Info] Latency " << stageNames[i] << ": p50 "
+			<< summary.p50 / 1e6 << "ms, p99 " << summary.p99 / 1e6 << "ms, max "
+			<< summary.max / 1e6 << "ms" << std::endl;
+	}
+
+	auto draw = renderer.drawTime.getSummary(),
+		interval = renderer.frameInterval.getSummary();
+
+	std::cout << "[Info] Render: " << draw.count << " frames, draw p50 "
+		<< draw.p50 / 1e6 << "ms, p99 " << draw.p99 / 1e6 << "ms, max "
+		<< draw.max / 1e6 << "ms" << std::endl;
+	std::cout << "[Info] Render interval: p50 " << interval.p50 / 1e6
+		<< "ms, p99 " << interval.p99 / 1e6 << "ms, max " << interval.max / 1e6
+		<< "ms, " << renderer.lateFrames << " frames skipped" << std::endl;
+
 	//Close X11
+	x_closeRenderer(&renderer);
 	x_close(&x11);
 
 	return 0;
@@ -129,55 +215,112 @@ void x_close(X11_t* x11) {
 	XCloseDisplay(x11->dis);
 }
 
-void x_drawSpectrum(X11_t* x11, std::shared_ptr<Spectrum> spectrum) {
-	if(!displayMutex.try_lock())
-		return;
-	
-	static std::unique_ptr<Spectrum> prevSpec;
+void x_initRenderer(Renderer_t* renderer, X11_t* x11) {
+	//Every frame covers the whole window, so the server has nothing to
+	//clear on expose
+	XSetWindowBackgroundPixmap(x11->dis, x11->win, None);
+
+	//The window has to exist on the server before another connection can
+	//refer to it
+	XSync(x11->dis, False);
+
+	renderer->dis = XOpenDisplay((char*)0);
+
+	int screen = DefaultScreen(renderer->dis);
+
+	renderer->black = BlackPixel(renderer->dis, screen);
+	renderer->white = WhitePixel(renderer->dis, screen);
+
+	renderer->buffer = XCreatePixmap(renderer->dis, x11->win, WIN_WIDTH,
+		WIN_HEIGHT, DefaultDepth(renderer->dis, screen));
+
+	renderer->gc = XCreateGC(renderer->dis, renderer->buffer, 0, 0);
+
+	renderer->lateFrames = 0;
+}
+
+void x_closeRenderer(Renderer_t* renderer) {
+	XFreeGC(renderer->dis, renderer->gc);
+	XFreePixmap(renderer->dis, renderer->buffer);
+	XCloseDisplay(renderer->dis);
+}
+
+void x_renderRoutine(Renderer_t* renderer, Window win,
+	SpectrumAnalyzer* spectrumAnalyzer) {
+
+	auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>(1. / RENDER_RATE));
+	auto nextFrame = std::chrono::steady_clock::now();
+	Timestamp lastStart = 0;
+
+	while(renderer->running) {
+		std::this_thread::sleep_until(nextFrame);
+
+		Timestamp start = getTimestamp();
+
+		if(lastStart) {
+			renderer->frameInterval.record(lastStart, start);
+		}
+
+		lastStart = start;
+
+		//Latest snapshot, never modified while held
+		x_drawSpectrum(renderer, win, *spectrumAnalyzer->getLeftSpectrum(),
+			PEAK_DECAY / RENDER_RATE);
+
+		renderer->drawTime.record(start, getTimestamp());
+
+		//Fixed rate, if a frame overran skip to the next period rather than
+		//rush to catch up
+		nextFrame += period;
+
+		auto now = std::chrono::steady_clock::now();
+
+		if(now >= nextFrame) {
+			auto missed = (now - nextFrame) / period + 1;
+
+			renderer->lateFrames += missed;
+			nextFrame += missed * period;
+		}
+	}
+}
+
+void x_drawSpectrum(Renderer_t* renderer, Window win, const Spectrum& spectrum,
+	double peakDecay) {
 
 	unsigned int width = WIN_WIDTH, height = WIN_HEIGHT, border = 10,
 		maxBarHeight = height - 4*border, maxWidth = width - 4*border;
 	double dbMin = -60., dbMax = 0.;
 
-/*
-	XGetGeometry(x11->dis, x11->win, &w, &i, &i, &width, &height,
-		&u, &u);
-*/
-	auto binBegin = spectrum->begin();
-	auto binEnd = spectrum->end();
+	int binCount = spectrum.getBinCount();
+
+	if(binCount == 0) {
+		return;
+	}
+
+	std::vector<double> &levelDB = renderer->levelDB, &peakDB = renderer->peakDB;
 
-	int binCount = binEnd - binBegin;
+	//Display rate, the fast conversion is plenty accurate
+	levelDB.resize(binCount);
+	spectrum.getEnergiesDB(levelDB.data(), Spectrum::DbMode::Fast);
 
-	if(!prevSpec) {
-		prevSpec = std::make_unique<Spectrum>(*spectrum.get());
+	if(peakDB.empty()) {
+		peakDB = levelDB;
 	}
 
-	//Clear screen
-	XClearWindow(x11->dis, x11->win);
+	renderer->bars.resize(binCount);
 
-	XDrawRectangle(x11->dis, x11->win, x11->gc, border, border, width-2*border,
-		height - 2*border);
-/*
-	double avg = spectrum->getAverageEnergyDB() - dbMin;
-	if(avg < 0)
-		avg = 0;
-*/
 	for(int i = 0; i < binCount; ++i) {
-		//double db = (binBegin + i)->getEnergyDB();
-		double curDB = (spectrum->begin()+i)->getEnergyDB(),
-			db = (prevSpec->begin()+i)->getEnergyDB();
-
-			
+		double curDB = levelDB[i], db = peakDB[i];
 
 		if(curDB > db) {
 			db = curDB;
 		}
 		else {
-			db = std::max(curDB, db - 0.75);
+			db = std::max(curDB, db - peakDecay);
 		}
 
-
-		(prevSpec->begin()+i)->setEnergyDB(db);
+		peakDB[i] = db;
 
 		if(db < dbMin)
 			db = dbMin;
@@ -193,21 +336,38 @@ void x_drawSpectrum(X11_t* x11, std::shared_ptr<Spectrum> spectrum) {
 		int x = i * maxWidth / binCount + 2*border,
 			y = height - 2*border - barHeight;
 
-		XFillRectangle(x11->dis, x11->win, x11->gc, x, y, barWidth, barHeight);
+		renderer->bars[i] = {(short)x, (short)y, (unsigned short)barWidth,
+			(unsigned short)barHeight};
 	}
 
+	Display *dis = renderer->dis;
+	Drawable buffer = renderer->buffer;
+	GC gc = renderer->gc;
+
+	//Clear the back buffer
+	XSetForeground(dis, gc, renderer->black);
+	XFillRectangle(dis, buffer, gc, 0, 0, width, height);
+
+	XSetForeground(dis, gc, renderer->white);
+
+	XDrawRectangle(dis, buffer, gc, border, border, width-2*border,
+		height - 2*border);
+
+	//Every bar in one request
+	XFillRectangles(dis, buffer, gc, renderer->bars.data(), binCount);
+
 	//Draw average line
-	double avg = (spectrum->getAverageEnergyDB() - dbMin);
+	double avg = (spectrum.getAverageEnergyDB() - dbMin);
 	double avgY = maxBarHeight * avg / (dbMax - dbMin);
 	avgY = height -2*border - avgY;
 	if(avgY < 1)
 		avgY = 1;
-	XDrawLine(x11->dis, x11->win, x11->gc, 2*border, avgY, width - 3*border, avgY);
-
-	XFlush(x11->dis);
+	if(!(avgY <= height - 2*border)) //Also the silent snapshot before any audio
+		avgY = height - 2*border;
+	XDrawLine(dis, buffer, gc, 2*border, avgY, width - 3*border, avgY);
 
-	//Delay
-	//std::this_thread::sleep_for(std::chrono::milliseconds(75));
+	//Show the finished frame
+	XCopyArea(dis, buffer, win, gc, 0, 0, width, height, 0, 0);
 
-	displayMutex.unlock();
+	XFlush(dis);
 }
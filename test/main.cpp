@@ -6,7 +6,7 @@
 #include <fftw3.h>
 
 #define SAMPLE_RATE		48000
-#define 
+#define BLOCK_SIZE		4096
 
 //FFTW stuff
 fftw_complex *in, *out;
@@ -57,7 +57,7 @@ int main() {
 	inputParams.hostApiSpecificStreamInfo = NULL;
 
 	//Open stream
-	retval = Pa_OpenStream(&inputStream, &inputParams, NULL, 48000, 4096,
+	retval = Pa_OpenStream(&inputStream, &inputParams, NULL, SAMPLE_RATE, BLOCK_SIZE,
 		paNoFlag, &paCallback, NULL);
 
 	if(retval) {
@@ -84,7 +84,7 @@ int main() {
 	//Wait
 	std::cin.get();
 
-	Pa_StopStream(&inputStream);
+	Pa_StopStream(inputStream);
 
 	//Close PortAudio
 	Pa_Terminate();
@@ -0,0 +1,780 @@
+//Microbenchmarks for the per-sample and per-frame hot paths
+//Results are printed as CSV (default) or JSON so runs can be compared
+//across releases and machines
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#include <boost/signals2.hpp>
+
+#include "AnalysisExecutor.hpp"
+#include "FftEngine.hpp"
+#include "FramePool.hpp"
+#include "SampleKernels.hpp"
+#include "SharedSpectrum.hpp"
+#include "SpectrogramHistory.hpp"
+#include "SpectrumPlayer.hpp"
+#include "SpectrumRecorder.hpp"
+#include "Spectrum.hpp"
+#include "SpectrumAnalyzer.hpp"
+#include "SyntheticSource.hpp"
+
+#define SAMPLE_RATE	48000
+#define CHUNK_SIZE	512
+
+#define FSTART	32.7032			//C1
+#define FEND		16744.0384	//C10
+
+//Needs a block size above 16384 at 3 bins per octave
+#define PIPELINE_FSTART	8.
+
+//Timed samples per benchmark, the median is reported
+#define SAMPLE_COUNT	5
+
+struct Result {
+	std::string name, variant;
+	unsigned int size;
+	uint64_t iterations;
+	double nsMedian, nsMin;
+
+	//Items (samples, bins, calls) processed per operation
+	double itemsPerOp;
+};
+
+//Keeps the compiler from optimizing away work whose result is unused
+static void escape(const void* p) {
+	asm volatile("" : : "g"(p) : "memory");
+}
+
+class Bench
+{
+public:
+	Bench(double _minTime, const std::string& _filter)
+		:	minTime{_minTime}
+		,	filter{_filter} {
+	}
+
+	//Benchmarks run from here on belong to group
+	void setGroup(const std::string& _group) {
+		group = _group;
+	}
+
+	//Time op() until each sample covers at least minTime seconds. Skipped
+	//unless the benchmark or its group name starts with the filter
+	void run(const std::string& name, const std::string& variant,
+		unsigned int size, double itemsPerOp, std::function<void()> op) {
+
+		if(!filter.empty() && name.find(filter) != 0 &&
+			group.find(filter) != 0) {
+			return;
+		}
+
+		typedef std::chrono::steady_clock Clock;
+
+		//Find a batch size that takes long enough to time reliably
+		uint64_t batch = 1;
+
+		while(true) {
+			auto start = Clock::now();
+
+			for(uint64_t i = 0; i < batch; ++i) {
+				op();
+			}
+
+			double elapsed = std::chrono::duration<double>(Clock::now() - start)
+				.count();
+
+			if(elapsed >= minTime / SAMPLE_COUNT || batch >= (1ULL << 40)) {
+				break;
+			}
+
+			batch *= (elapsed > 0.) ? std::min(100., std::max(2.,
+				1.2 * minTime / SAMPLE_COUNT / elapsed)) : 100.;
+		}
+
+		std::vector<double> samples;
+
+		for(int s = 0; s < SAMPLE_COUNT; ++s) {
+			auto start = Clock::now();
+
+			for(uint64_t i = 0; i < batch; ++i) {
+				op();
+			}
+
+			samples.push_back(std::chrono::duration<double, std::nano>(
+				Clock::now() - start).count() / batch);
+		}
+
+		std::sort(samples.begin(), samples.end());
+
+		results.push_back({name, variant, size, batch * SAMPLE_COUNT,
+			samples[SAMPLE_COUNT/2], samples[0], itemsPerOp});
+
+		std::cerr << name << " " << variant << " " << size << ": "
+			<< samples[SAMPLE_COUNT/2] << " ns" << std::endl;
+	}
+
+	void printCsv(std::ostream& out) const {
+		out << "name,variant,size,iterations,ns_per_op_median,ns_per_op_min,"
+			"items_per_second\n";
+
+		for(auto& r : results) {
+			out << r.name << ',' << r.variant << ',' << r.size << ','
+				<< r.iterations << ',' << r.nsMedian << ',' << r.nsMin << ','
+				<< r.itemsPerOp * 1e9 / r.nsMedian << '\n';
+		}
+	}
+
+	void printJson(std::ostream& out) const {
+		out << "{\n  \"context\": {"
+			<< "\"isa\": \"" << SampleKernels::getIsaName(SampleKernels::get().isa)
+			<< "\", \"sample_type\": \""
+			<< (sizeof(AnalysisSample) == sizeof(float) ? "float" : "double")
+			<< "\", \"threads\": " << std::thread::hardware_concurrency()
+			<< ", \"compiler\": \"" << __VERSION__ << "\"},\n"
+			<< "  \"results\": [\n";
+
+		for(size_t i = 0; i < results.size(); ++i) {
+			auto& r = results[i];
+
+			out << "    {\"name\": \"" << r.name << "\", \"variant\": \""
+				<< r.variant << "\", \"size\": " << r.size
+				<< ", \"iterations\": " << r.iterations
+				<< ", \"ns_per_op_median\": " << r.nsMedian
+				<< ", \"ns_per_op_min\": " << r.nsMin
+				<< ", \"items_per_second\": " << r.itemsPerOp * 1e9 / r.nsMedian
+				<< "}" << (i + 1 < results.size() ? "," : "") << '\n';
+		}
+
+		out << "  ]\n}\n";
+	}
+
+	bool isEmpty() const {
+		return results.empty();
+	}
+
+private:
+	double minTime;
+	std::string filter, group;
+	std::vector<Result> results;
+};
+
+static std::vector<int16_t> makeNoise(size_t count, uint32_t seed) {
+	std::vector<int16_t> samples(count);
+
+	for(auto& sample : samples) {
+		seed = seed * 1664525 + 1013904223;
+		sample = (int16_t)(seed >> 16);
+	}
+
+	return samples;
+}
+
+static void benchKernels(Bench& bench) {
+	for(auto isa : {SampleKernels::Isa::Scalar, SampleKernels::Isa::SSE2,
+		SampleKernels::Isa::AVX2, SampleKernels::Isa::NEON}) {
+
+		if(!SampleKernels::isSupported(isa)) {
+			continue;
+		}
+
+		auto kernels = SampleKernels::forIsa(isa);
+		std::string name = SampleKernels::getIsaName(isa);
+
+		for(unsigned int size : {512U, 4096U}) {
+			auto interleaved = makeNoise(2*size, 1);
+			auto left = makeNoise(size, 2), right = makeNoise(size, 3);
+			auto window = BasicFftEngine<double>::makeWindow(size);
+			auto windowF = BasicFftEngine<float>::makeWindow(size);
+			std::vector<double> out(2*size);
+			std::vector<float> outF(2*size);
+
+			bench.run("deinterleave", name, size, size, [&]() {
+					kernels.deinterleave(interleaved.data(), left.data(), right.data(),
+						size);
+					escape(left.data());
+				});
+
+			bench.run("window_double", name, size, size, [&]() {
+					kernels.applyWindow(left.data(), window.data(), out.data(), size);
+					escape(out.data());
+				});
+
+			bench.run("window_float", name, size, size, [&]() {
+					kernels.applyWindow(left.data(), windowF.data(), outF.data(), size);
+					escape(outF.data());
+				});
+
+			bench.run("window_packed_double", name, size, size, [&]() {
+					kernels.applyWindowPacked(left.data(), right.data(), window.data(),
+						out.data(), size);
+					escape(out.data());
+				});
+
+			bench.run("window_packed_float", name, size, size, [&]() {
+					kernels.applyWindowPacked(left.data(), right.data(), windowF.data(),
+						outF.data(), size);
+					escape(outF.data());
+				});
+
+			//Spectrum energies
+			double sum;
+			size_t minIndex, maxIndex;
+
+			bench.run("energy_stats", name, size, size, [&]() {
+					kernels.stats(window.data(), size, &sum, &minIndex, &maxIndex);
+					escape(&sum);
+				});
+
+			bench.run("energy_scale", name, size, size, [&]() {
+					kernels.scale(out.data(), 1., size);
+					escape(out.data());
+				});
+		}
+	}
+}
+
+//The body of SpectrumAnalyzer::fftRoutine for one block: window, FFT,
+//magnitudes, bin accumulation and stats for both channels
+static void benchFrame(Bench& bench, double binsPerOctave) {
+	Spectrum layout(FSTART, FEND, binsPerOctave);
+
+	for(unsigned int size = 512; size <= 16384; size *= 2) {
+		auto leftSamples = makeNoise(size, 4), rightSamples = makeNoise(size, 5);
+		auto window = FftEngine::makeWindow(size);
+
+		unsigned int mapStart;
+		auto binMap = layout.mapFftBins(SAMPLE_RATE, size, mapStart);
+
+		for(auto mode : {FftEngine::Mode::RealToComplex,
+			FftEngine::Mode::PackedStereo}) {
+
+			FftEngine engine(size, mode);
+			Spectrum left(layout), right(layout);
+
+			std::string variant = (mode == FftEngine::Mode::RealToComplex) ?
+				"r2c" : "packed";
+
+			bench.run("fft", variant, size, size, [&]() {
+					engine.execute(leftSamples.data(), rightSamples.data(),
+						window.data());
+					escape(engine.getLeftMagnitudes());
+				});
+
+			bench.run("fft_routine", variant, size, size, [&]() {
+					engine.execute(leftSamples.data(), rightSamples.data(),
+						window.data());
+
+					left.clear();
+					left.accumulate(binMap.data(), engine.getLeftMagnitudes() + mapStart,
+						binMap.size());
+					right.clear();
+					right.accumulate(binMap.data(), engine.getRightMagnitudes() + mapStart,
+						binMap.size());
+
+					left.updateStats();
+					right.updateStats();
+					escape(&left);
+					escape(&right);
+				});
+		}
+	}
+}
+
+//Multichannel blocks through one batched plan, against a separate single
+//channel engine per channel
+static void benchChannels(Bench& bench) {
+	unsigned int size = 4096;
+	auto window = FftEngine::makeWindow(size);
+
+	for(unsigned int channelCount : {2U, 8U, 32U}) {
+		std::vector<std::vector<int16_t>> samples;
+		std::vector<const int16_t*> channels;
+
+		for(unsigned int channel = 0; channel < channelCount; ++channel) {
+			samples.push_back(makeNoise(size, 10 + channel));
+		}
+		for(auto& channel : samples) {
+			channels.push_back(channel.data());
+		}
+
+		std::string suffix = "_" + std::to_string(channelCount) + "ch";
+
+		for(auto mode : {FftEngine::Mode::RealToComplex,
+			FftEngine::Mode::PackedStereo}) {
+
+			FftEngine engine(size, mode, channelCount);
+
+			std::string variant = (mode == FftEngine::Mode::RealToComplex) ?
+				"r2c" : "packed";
+
+			bench.run("fft_batch", variant + suffix, size, size*channelCount,
+				[&]() {
+					engine.execute(channels.data(), window.data());
+					escape(engine.getMagnitudes(channelCount - 1));
+				});
+		}
+
+		std::vector<std::unique_ptr<FftEngine>> engines;
+
+		for(unsigned int channel = 0; channel < channelCount; ++channel) {
+			engines.push_back(std::make_unique<FftEngine>(size,
+				FftEngine::Mode::RealToComplex, 1));
+		}
+
+		bench.run("fft_batch", "single" + suffix, size, size*channelCount,
+			[&]() {
+				for(unsigned int channel = 0; channel < channelCount; ++channel) {
+					engines[channel]->execute(&channels[channel], window.data());
+					escape(engines[channel]->getMagnitudes(0));
+				}
+			});
+	}
+}
+
+static void benchSpectrum(Bench& bench, double binsPerOctave) {
+	Spectrum spectrum(FSTART, FEND, binsPerOctave);
+	unsigned int bins = spectrum.getBinCount();
+	unsigned int size = 4096;
+
+	//Sized by bin count, lookups map every FFT bin of a 4096 block
+	unsigned int mapStart;
+	auto binMap = spectrum.mapFftBins(SAMPLE_RATE, size, mapStart);
+
+	std::vector<double> frequencies;
+
+	for(unsigned int i = 0; i < binMap.size(); ++i) {
+		frequencies.push_back((double)SAMPLE_RATE * (mapStart + i) / size);
+	}
+
+	//Per FFT bin lookup of the frequency bin, the original fftRoutine way
+	bench.run("bin_lookup", "get", bins, frequencies.size(), [&]() {
+			for(double f : frequencies) {
+				spectrum.get(f).addEnergy(1.);
+			}
+			escape(&spectrum);
+		});
+
+	bench.run("bin_lookup", "table", bins, binMap.size(), [&]() {
+			for(auto index : binMap) {
+				spectrum.getByIndex(index).addEnergy(1.);
+			}
+			escape(&spectrum);
+		});
+
+	auto magnitudes = makeNoise(bins, 6);
+
+	for(unsigned int i = 0; i < bins; ++i) {
+		spectrum.getByIndex(i).setEnergy(1. + std::abs(magnitudes[i]));
+	}
+
+	bench.run("update_stats", "", bins, bins, [&]() {
+			spectrum.updateStats();
+			escape(&spectrum);
+		});
+
+	std::vector<double> db(bins);
+
+	bench.run("to_db", "per_bin", bins, bins, [&]() {
+			for(unsigned int i = 0; i < bins; ++i) {
+				db[i] = spectrum.getByIndex(i).getEnergyDB();
+			}
+			escape(db.data());
+		});
+
+	bench.run("to_db", "exact", bins, bins, [&]() {
+			spectrum.getEnergiesDB(db.data(), Spectrum::DbMode::Exact);
+			escape(db.data());
+		});
+
+	bench.run("to_db", "fast", bins, bins, [&]() {
+			spectrum.getEnergiesDB(db.data(), Spectrum::DbMode::Fast);
+			escape(db.data());
+		});
+
+	//Back again, as for peak decay
+	bench.run("from_db", "exact", bins, bins, [&]() {
+			spectrum.setEnergiesDB(db.data(), Spectrum::DbMode::Exact);
+			escape(&spectrum);
+		});
+
+	bench.run("from_db", "fast", bins, bins, [&]() {
+			spectrum.setEnergiesDB(db.data(), Spectrum::DbMode::Fast);
+			escape(&spectrum);
+		});
+}
+
+//Spectrogram rows: appending a stereo frame, then a zoomed out view of a
+//full history
+static void benchSpectrogram(Bench& bench, double binsPerOctave) {
+	Spectrum layout(FSTART, FEND, binsPerOctave);
+	SpectrumFrame frame(layout, 2, 0);
+	size_t bins = layout.getBinCount(), rows = 1024;
+
+	auto magnitudes = makeNoise(bins, 7);
+
+	for(auto& spectrum : frame.channels) {
+		for(size_t i = 0; i < bins; ++i) {
+			spectrum.getEnergies()[i] = 1e-3 * (1. + std::abs(magnitudes[i]));
+		}
+	}
+
+	for(auto format : {SpectrogramHistory::Format::Float,
+		SpectrogramHistory::Format::DecibelInt16}) {
+
+		SpectrogramHistory history(rows, 2, bins, format);
+		std::string variant = (format == SpectrogramHistory::Format::Float) ?
+			"float" : "int16_db";
+
+		bench.run("spectrogram_append", variant, bins, 2*bins, [&]() {
+				history.append(frame);
+				escape(&history);
+			});
+
+		//Full, whether or not the append benchmark ran
+		while(history.getWriteIndex() < rows) {
+			history.append(frame);
+		}
+
+		std::vector<float> outF(rows * history.getRowStride());
+		std::vector<int16_t> outDB(rows * history.getRowStride());
+
+		bench.run("spectrogram_decimate", variant + "_max_8x", bins,
+			rows * history.getRowStride(), [&]() {
+				uint64_t start = history.getOldestIndex();
+
+				if(format == SpectrogramHistory::Format::Float) {
+					history.decimate(start, rows, 8,
+						SpectrogramHistory::Reduction::Max, outF.data());
+				}
+				else {
+					history.decimate(start, rows, 8,
+						SpectrogramHistory::Reduction::Max, outDB.data());
+				}
+				escape(outF.data());
+				escape(outDB.data());
+			});
+	}
+}
+
+//Shared memory publication, and a reader copying the newest frame out
+static void benchSharedSpectrum(Bench& bench, double binsPerOctave) {
+	Spectrum layout(FSTART, FEND, binsPerOctave);
+	SpectrumFrame frame(layout, 2, 0);
+	size_t bins = layout.getBinCount();
+
+	std::string name = "/SpectrumAnalyzerBench" + std::to_string(getpid());
+	SharedSpectrumPublisher publisher(name, layout, 2, 48000, 512);
+	SharedSpectrumReader reader(name);
+
+	bench.run("shared_publish", "", bins, 2*bins, [&]() {
+			publisher.publish(frame);
+			escape(&publisher);
+		});
+
+	std::vector<double> energies(2*bins);
+
+	bench.run("shared_read", "latest", bins, 2*bins, [&]() {
+			reader.read(reader.getWriteIndex() - 1, energies.data());
+			escape(energies.data());
+		});
+}
+
+//Quantizing and encoding a frame into a recording (written to a temporary
+//file), then decoding it back
+static void benchRecording(Bench& bench, double binsPerOctave) {
+	Spectrum layout(FSTART, FEND, binsPerOctave);
+	SpectrumFrame frame(layout, 2, 0);
+	size_t bins = layout.getBinCount();
+
+	std::string path = "/tmp/SpectrumAnalyzerBench" + std::to_string(getpid()) +
+		".spr";
+
+	//Slowly changing spectrums, within a few percent of each other like
+	//consecutive frames
+	std::vector<std::vector<double>> energies(16);
+
+	for(size_t n = 0; n < energies.size(); ++n) {
+		auto noise = makeNoise(bins, 11 + n);
+
+		for(size_t i = 0; i < bins; ++i) {
+			energies[n].push_back(1e-3 * (1. + 0.05 * noise[i] / 32768.));
+		}
+	}
+
+	for(auto encoding : {RecordingEncoding::Raw, RecordingEncoding::Delta}) {
+		std::string variant = (encoding == RecordingEncoding::Raw) ?
+			"raw" : "delta";
+		{
+			SpectrumRecorder recorder(path, layout, 2, 48000, 512, encoding);
+			size_t next = 0;
+
+			bench.run("record", variant, bins, 2*bins, [&]() {
+					for(auto& spectrum : frame.channels) {
+						std::copy(energies[next].begin(), energies[next].end(),
+							spectrum.getEnergies());
+					}
+
+					next = (next + 1) % energies.size();
+					frame.sequence++;
+					recorder.record(frame);
+				});
+		}
+
+		//Replay a fixed recording, the one above may not exist (filtered out)
+		//and its length depends on the timing
+		{
+			SpectrumRecorder recorder(path, layout, 2, 48000, 512, encoding);
+
+			for(unsigned int n = 0; n < 1024; ++n) {
+				for(auto& spectrum : frame.channels) {
+					std::copy(energies[n % energies.size()].begin(),
+						energies[n % energies.size()].end(), spectrum.getEnergies());
+				}
+
+				frame.sequence = n;
+				recorder.record(frame);
+			}
+		}
+
+		SpectrumPlayer player(path);
+		uint64_t next = 0;
+
+		bench.run("replay_decode", variant, bins, 2*bins, [&]() {
+				player.readFrame(next, frame);
+				next = (next + 1) % player.getFrameCount();
+				escape(&frame);
+			});
+	}
+
+	std::remove(path.c_str());
+}
+
+//Signal invocation as done by SpectrumAnalyzer::deliverFrame
+static void benchListeners(Bench& bench) {
+	Spectrum layout(FSTART, FEND, 3);
+	FramePool pool(layout, 4);
+
+	SpectrumFrame *frame = pool.acquire();
+	pool.publish(frame);
+
+	for(unsigned int listeners : {0U, 1U, 4U}) {
+		boost::signals2::signal<void(SpectrumAnalyzer*,
+			std::shared_ptr<Spectrum>, std::shared_ptr<Spectrum>)> signal;
+
+		double sink = 0;
+
+		for(unsigned int i = 0; i < listeners; ++i) {
+			signal.connect([&sink](SpectrumAnalyzer*, std::shared_ptr<Spectrum> left,
+				std::shared_ptr<Spectrum>) {
+					sink += left->getByIndex(0).getEnergy();
+				});
+		}
+
+		bench.run("listener_dispatch", "", listeners, 1, [&]() {
+				auto snapshot = pool.share(frame);
+
+				signal(nullptr, std::shared_ptr<Spectrum>(snapshot, &frame->left),
+					std::shared_ptr<Spectrum>(snapshot, &frame->right));
+				escape(&sink);
+			});
+	}
+}
+
+//End to end: synthetic audio through a single worker analyzer (single
+//block, multirate and sliding DFT), then four analyzers sharing the process wide
+//executor, nothing dropped
+//Every block is kept, the source waits for the workers
+static SpectrumAnalyzer::Options pipelineOptions(unsigned int threadCount,
+	SpectrumAnalyzer::AnalysisEngine analysisEngine) {
+
+	SpectrumAnalyzer::Options options;
+
+	options.threadCount = threadCount;
+	options.queueDepth = 4;
+	options.overloadPolicy = SpectrumAnalyzer::OverloadPolicy::Block;
+	options.analysisEngine = analysisEngine;
+
+	return options;
+}
+
+static void benchPipeline(Bench& bench) {
+	for(unsigned int size = 512; size <= 16384; size *= 2) {
+		//One second of audio per operation
+		bench.run("pipeline", "1thread", size, SAMPLE_RATE, [&]() {
+				auto source = std::make_shared<SyntheticSource>(SAMPLE_RATE,
+					CHUNK_SIZE, ThreadedSource::Pacing::Free, SAMPLE_RATE);
+				source->addTone(1000., 0.5);
+				source->addNoise(0.01);
+
+				//fStart low enough that the optimal block size is at least size,
+				//so maxBlockSize picks it
+				SpectrumAnalyzer analyzer(source, PIPELINE_FSTART, FEND, 3, size,
+					pipelineOptions(1, SpectrumAnalyzer::AnalysisEngine::SingleBlock));
+
+				source->startStream();
+				source->waitForEnd();
+				analyzer.waitForIdle();
+			});
+
+		//The same resolution from a small FFT per octave, maxBlockSize caps the
+		//octave FFT instead
+		bench.run("pipeline", "multirate", size, SAMPLE_RATE, [&]() {
+				auto source = std::make_shared<SyntheticSource>(SAMPLE_RATE,
+					CHUNK_SIZE, ThreadedSource::Pacing::Free, SAMPLE_RATE);
+				source->addTone(1000., 0.5);
+				source->addNoise(0.01);
+
+				SpectrumAnalyzer analyzer(source, PIPELINE_FSTART, FEND, 3, size,
+					pipelineOptions(1, SpectrumAnalyzer::AnalysisEngine::Multirate));
+
+				source->startStream();
+				source->waitForEnd();
+				analyzer.waitForIdle();
+			});
+
+		//Every bin kept current per sample, maxBlockSize caps the windows
+		bench.run("pipeline", "sliding", size, SAMPLE_RATE, [&]() {
+				auto source = std::make_shared<SyntheticSource>(SAMPLE_RATE,
+					CHUNK_SIZE, ThreadedSource::Pacing::Free, SAMPLE_RATE);
+				source->addTone(1000., 0.5);
+				source->addNoise(0.01);
+
+				SpectrumAnalyzer analyzer(source, PIPELINE_FSTART, FEND, 3, size,
+					pipelineOptions(1, SpectrumAnalyzer::AnalysisEngine::SlidingDft));
+
+				source->startStream();
+				source->waitForEnd();
+				analyzer.waitForIdle();
+			});
+
+		//Several analyzers at once on the process wide executor
+		bench.run("pipeline", "shared_4x", size, 4*SAMPLE_RATE, [&]() {
+				std::vector<std::shared_ptr<SyntheticSource>> sources;
+				std::vector<std::unique_ptr<SpectrumAnalyzer>> analyzers;
+
+				for(unsigned int i = 0; i < 4; ++i) {
+					sources.push_back(std::make_shared<SyntheticSource>(SAMPLE_RATE,
+						CHUNK_SIZE, ThreadedSource::Pacing::Free, SAMPLE_RATE, i + 1));
+					sources.back()->addTone(1000. * (i + 1), 0.5);
+					sources.back()->addNoise(0.01);
+
+					SpectrumAnalyzer::Options options = pipelineOptions(2,
+						SpectrumAnalyzer::AnalysisEngine::SingleBlock);
+
+					options.executor = AnalysisExecutor::getShared();
+
+					analyzers.push_back(std::make_unique<SpectrumAnalyzer>(
+						sources.back(), PIPELINE_FSTART, FEND, 3, size, options));
+				}
+
+				for(auto& source : sources) {
+					source->startStream();
+				}
+				for(unsigned int i = 0; i < 4; ++i) {
+					sources[i]->waitForEnd();
+					analyzers[i]->waitForIdle();
+				}
+			});
+	}
+}
+
+static void printUsage(const char* name) {
+	std::cout << "Usage: " << name << " [-f csv|json] [-t seconds] [filter]\n"
+		"Runs benchmarks whose name, or group name, starts with filter (all\n"
+		"by default). Groups are kernels, fft, spectrum, listeners and\n"
+		"pipeline\n"
+		"  -f  Output format (default csv)\n"
+		"  -t  Minimum time per benchmark (default 0.5)\n";
+}
+
+int main(int argc, char* argv[]) {
+	std::string format = "csv", filter;
+	double minTime = 0.5;
+
+	for(int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+
+		if(arg == "-f" && i + 1 < argc) {
+			format = argv[++i];
+		}
+		else if(arg == "-t" && i + 1 < argc) {
+			minTime = std::atof(argv[++i]);
+		}
+		else if(arg[0] != '-') {
+			filter = arg;
+		}
+		else {
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(format != "csv" && format != "json") {
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	Bench bench(minTime, filter);
+
+	//Spectrum construction logs every bin, keep stdout for the results
+	std::streambuf *stdoutBuffer = std::cout.rdbuf(std::cerr.rdbuf());
+
+	struct Group {
+		const char* name;
+		std::function<void()> run;
+	} groups[] = {
+		{"kernels", [&]() { benchKernels(bench); }},
+		{"fft", [&]() { benchFrame(bench, 3); benchChannels(bench); }},
+		{"spectrum", [&]() {
+				benchSpectrum(bench, 3);
+				benchSpectrum(bench, 24);
+				benchSpectrogram(bench, 3);
+				benchSpectrogram(bench, 24);
+				benchSharedSpectrum(bench, 3);
+				benchSharedSpectrum(bench, 24);
+				benchRecording(bench, 3);
+				benchRecording(bench, 24);
+			}},
+		{"listeners", [&]() { benchListeners(bench); }},
+		{"pipeline", [&]() { benchPipeline(bench); }}
+	};
+
+	//Benchmark names do not share their group's name, so every group is
+	//set up and Bench::run skips what does not match
+	for(auto& group : groups) {
+		bench.setGroup(group.name);
+		group.run();
+	}
+
+	std::cout.rdbuf(stdoutBuffer);
+
+	if(bench.isEmpty()) {
+		std::cerr << "[Error] No benchmark matches " << filter << std::endl;
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	if(format == "json") {
+		bench.printJson(std::cout);
+	}
+	else {
+		bench.printCsv(std::cout);
+	}
+
+	return 0;
+}
@@ -0,0 +1,249 @@
+//Runs a WAV or raw PCM file through SpectrumAnalyzer as fast as the worker
+//threads allow and writes the spectrum of every block to a text file, or
+//to a binary recording (see SpectrumRecorder)
+
+#include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "FileSource.hpp"
+#include "SpectrumAnalyzer.hpp"
+#include "SpectrumRecorder.hpp"
+
+#define CHUNK_SIZE		512
+#define MAX_BLOCK_SIZE	4096
+
+#define FSTART	32.7032			//C1
+#define FEND		16744.0384	//C10
+#define BINS_PER_OCTAVE	3
+
+static void printUsage(const char* name) {
+	std::cout << "Usage: " << name << " [options] <input> <output>\n"
+		"Writes one line per block: the time of its window center in seconds,\n"
+		"then the energy in dB of every bin of each channel in turn. Stereo\n"
+		"columns are named L<freq> and R<freq>, others C<channel>_<freq>\n"
+		"\n"
+		"  -r <rate>      Input is raw 16 bit little endian PCM at rate Hz\n"
+		"  -c <channels>  Channels in raw input (default 2)\n"
+		"  -b <size>      Maximum FFT block size (default " << MAX_BLOCK_SIZE
+			<< ")\n"
+		"  -h <samples>   Hop size (default " << CHUNK_SIZE << ")\n"
+		"  -t <threads>   Worker threads (default all cores)\n"
+		"  -m             Multirate analysis, a small FFT per octave (-b caps\n"
+		"                 its size)\n"
+		"  -s             Sliding DFT analysis, every bin updated per sample\n"
+		"                 (-b caps the window size)\n"
+		"  -B             Write a binary recording (see SpectrumRecorder)\n"
+		"                 instead of text\n";
+}
+
+int main(int argc, char* argv[]) {
+	unsigned int rawRate = 0, rawChannels = 2, maxBlockSize = MAX_BLOCK_SIZE,
+		hopSize = CHUNK_SIZE, threadCount = std::thread::hardware_concurrency();
+	auto analysisEngine = SpectrumAnalyzer::AnalysisEngine::SingleBlock;
+	bool binary = false;
+	std::vector<std::string> paths;
+
+	for(int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+
+		if(arg == "-m") {
+			analysisEngine = SpectrumAnalyzer::AnalysisEngine::Multirate;
+		}
+		else if(arg == "-s") {
+			analysisEngine = SpectrumAnalyzer::AnalysisEngine::SlidingDft;
+		}
+		else if(arg == "-B") {
+			binary = true;
+		}
+		else if(arg.size() == 2 && arg[0] == '-' && i + 1 < argc) {
+			unsigned int value = std::strtoul(argv[++i], nullptr, 10);
+
+			switch(arg[1]) {
+				case 'r': rawRate = value; break;
+				case 'c': rawChannels = value; break;
+				case 'b': maxBlockSize = value; break;
+				case 'h': hopSize = value; break;
+				case 't': threadCount = value; break;
+
+				default:
+					printUsage(argv[0]);
+					return 1;
+			}
+		}
+		else {
+			paths.push_back(arg);
+		}
+	}
+
+	if(paths.size() != 2 || hopSize == 0) {
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	if(threadCount == 0) {
+		threadCount = 1;
+	}
+
+	std::shared_ptr<FileSource> source;
+
+	try {
+		if(rawRate) {
+			source = std::make_shared<FileSource>(paths[0], CHUNK_SIZE, rawRate,
+				rawChannels);
+		}
+		else {
+			source = std::make_shared<FileSource>(paths[0], CHUNK_SIZE);
+		}
+	}
+	catch(const Exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	//Every block is kept, Block makes the file wait for the workers
+	SpectrumAnalyzer::Options options;
+
+	options.threadCount = threadCount;
+	options.hopSize = hopSize;
+	options.queueDepth = 2*threadCount;
+	options.overloadPolicy = SpectrumAnalyzer::OverloadPolicy::Block;
+	options.analysisEngine = analysisEngine;
+
+	SpectrumAnalyzer spectrumAnalyzer(source, FSTART, FEND, BINS_PER_OCTAVE,
+		maxBlockSize, options);
+
+	unsigned int blockSize = spectrumAnalyzer.getBlockSize();
+	double windowCenter = spectrumAnalyzer.getWindowCenter();
+	double sampleRate = source->getSampleRate();
+	unsigned int channelCount = source->getChannelCount();
+
+	std::ofstream output;
+	std::unique_ptr<SpectrumRecorder> recorder;
+	Spectrum layout(FSTART, FEND, BINS_PER_OCTAVE);
+
+	if(binary) {
+		try {
+			recorder = std::make_unique<SpectrumRecorder>(paths[1], layout,
+				channelCount, sampleRate, spectrumAnalyzer.getHopSize());
+		}
+		catch(const Exception& e) {
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+	}
+	else {
+		output.open(paths[1]);
+
+		if(!output) {
+			std::cerr << "Failed to open " << paths[1] << std::endl;
+			return 1;
+		}
+
+		//Header
+		output << "time";
+
+		for(unsigned int channel = 0; channel < channelCount; ++channel) {
+			std::string prefix = (channelCount == 2) ? (channel ? "R" : "L") :
+				"C" + std::to_string(channel) + "_";
+
+			for(auto& bin : layout) {
+				output << '\t' << prefix << bin.getFreqCenter();
+			}
+		}
+
+		output << '\n';
+	}
+
+	//Listeners are called in block order, one at a time
+	uint64_t frameCount = 0;
+	std::string line;
+
+	spectrumAnalyzer.addFrameListener([&](SpectrumAnalyzer*,
+		std::shared_ptr<SpectrumFrame> frame) {
+
+		++frameCount;
+
+		if(recorder) {
+			recorder->record(*frame);
+			return;
+		}
+
+		char field[32];
+
+		//From the sequence number, so starved or overwritten frames do not
+		//shift the ones after them
+		std::snprintf(field, sizeof(field), "%.6f",
+			(windowCenter + (double)frame->sequence*hopSize) / sampleRate);
+		line = field;
+
+		for(auto& spectrum : frame->channels) {
+			for(auto& bin : spectrum) {
+				std::snprintf(field, sizeof(field), "\t%.2f", bin.getEnergyDB());
+				line += field;
+			}
+		}
+
+		line += '\n';
+		output.write(line.data(), line.size());
+	});
+
+	auto startTime = std::chrono::steady_clock::now();
+
+	source->startStream();
+	source->waitForEnd();
+
+	spectrumAnalyzer.waitForIdle();
+
+	double elapsed = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - startTime).count();
+
+	if(recorder) {
+		recorder->close();
+
+		uint64_t recorded = recorder->getFrameCount();
+
+		std::cout << "[Info] Recorded " << recorded << " frames, "
+			<< recorder->getSize() << " bytes, "
+			<< (double)recorder->getSize() / std::max(recorded, (uint64_t)1)
+			<< " per frame" << std::endl;
+
+		if(recorder->getDroppedFrameCount()) {
+			std::cout << "[Warning] " << recorder->getDroppedFrameCount()
+				<< " frames not recorded, the disk fell behind" << std::endl;
+		}
+	}
+	else {
+		output.close();
+	}
+
+	std::cout << "[Info] Analyzed " << source->getDuration() << "s of audio in "
+		<< elapsed << "s (" << source->getDuration() / elapsed
+		<< "x real time) on " << threadCount << " threads" << std::endl;
+
+	std::cout << "[Info] " << frameCount << " frames of " << blockSize
+		<< " samples, hop " << hopSize << ", "
+		<< frameCount / elapsed << " frames/s" << std::endl;
+
+	uint64_t lost = spectrumAnalyzer.getStarvedFrameCount() +
+		spectrumAnalyzer.getOverwrittenFrameCount();
+
+	if(lost) {
+		std::cout << "[Warning] " << lost << " frames lost" << std::endl;
+	}
+
+	//The recording is incomplete, close() has said so
+	if(recorder && recorder->hasFailed()) {
+		return 1;
+	}
+
+	return 0;
+}
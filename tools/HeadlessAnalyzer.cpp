@@ -0,0 +1,519 @@
+//Runs SpectrumAnalyzer without a display, configured from the command line
+//and/or a config file, and reports throughput periodically: frames/s,
+//worker utilization, queue depth and everything dropped along the way.
+//For sizing deployments without recompiling for each configuration
+
+#include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+
+#include "AudioDevice.hpp"
+#include "FileSource.hpp"
+#include "SpectrumAnalyzer.hpp"
+#include "SpectrumRecorder.hpp"
+#include "SyntheticSource.hpp"
+
+static std::atomic<bool> interrupted{false};
+
+static void onSignal(int) {
+	interrupted = true;
+}
+
+//Every setting, with its default
+static std::map<std::string, std::string> defaultSettings() {
+	return {
+		{"source", "device"},
+		{"input", ""},
+		{"rate", "48000"},
+		{"channels", "2"},
+		{"chunk", "512"},
+		{"pacing", "clocked"},
+		{"block", "4096"},
+		{"hop", "0"},
+		{"threads", std::to_string(std::max(std::thread::hardware_concurrency(),
+			1U))},
+		{"queue", std::to_string(SpectrumAnalyzer::DEFAULT_QUEUE_DEPTH)},
+		{"policy", "drop-oldest"},
+		{"engine", "single"},
+		{"fft", "packed"},
+		{"fstart", "32.7032"},
+		{"fend", "16744.0384"},
+		{"bpo", "3"},
+		{"duration", "0"},
+		{"interval", "1"},
+		{"report", "text"},
+		{"output", ""},
+		{"shm", ""},
+		{"record", ""},
+		{"spectrogram", "0"}
+	};
+}
+
+static void printUsage(const char* name) {
+	std::cout << "Usage: " << name << " [-c <config>] [--<setting> <value>]...\n"
+		"Settings come from the defaults, then the config file (one\n"
+		"'setting = value' per line, # starts a comment), then the command\n"
+		"line (--setting value or --setting=value)\n"
+		"\n"
+		"  source       device, file or synthetic (a tone sweep over noise)\n"
+		"  input        File to analyze, WAV or raw 16 bit PCM (with rate and\n"
+		"               channels) when it does not end in .wav\n"
+		"  rate         Sample rate, Hz (device, synthetic and raw files)\n"
+		"  channels     Channel count (device, synthetic and raw files)\n"
+		"  chunk        Samples per audio chunk\n"
+		"  pacing       clocked (real time) or free (as fast as possible), for\n"
+		"               file and synthetic sources\n"
+		"  block        Maximum FFT block size\n"
+		"  hop          Samples between blocks, 0 for one per chunk\n"
+		"  threads      Worker threads\n"
+		"  queue        Job queue depth\n"
+		"  policy       drop-oldest, drop-newest, coalesce or block\n"
+		"  engine       single, multirate or sliding\n"
+		"  fft          packed or real\n"
+		"  fstart, fend, bpo\n"
+		"               Bin layout: first and last frequency, bins per octave\n"
+		"  duration     Seconds to run, 0 until the input ends (or Ctrl-C)\n"
+		"  interval     Seconds between reports\n"
+		"  report       text, csv or json (one object per line)\n"
+		"  output       Report file, stdout by default (log messages always\n"
+		"               go to stderr)\n"
+		"  shm          Also publish frames to this shared memory segment\n"
+		"  record       Also record frames to this file (see SpectrumRecorder)\n"
+		"  spectrogram  Also keep this many frames of spectrogram history\n";
+}
+
+static bool parseConfig(const std::string& path,
+	std::map<std::string, std::string>& settings) {
+
+	std::ifstream file(path);
+
+	if(!file) {
+		std::cerr << "Failed to open " << path << std::endl;
+		return false;
+	}
+
+	std::string line;
+	unsigned int lineNumber = 0;
+
+	while(std::getline(file, line)) {
+		++lineNumber;
+
+		line = line.substr(0, line.find('#'));
+
+		auto trim = [](const std::string& s) {
+			size_t first = s.find_first_not_of(" \t\r"),
+				last = s.find_last_not_of(" \t\r");
+
+			return (first == std::string::npos) ? std::string() :
+				s.substr(first, last - first + 1);
+		};
+
+		if(trim(line).empty()) {
+			continue;
+		}
+
+		size_t equals = line.find('=');
+		std::string key = trim(line.substr(0, equals));
+
+		if(equals == std::string::npos || !settings.count(key)) {
+			std::cerr << path << ":" << lineNumber << ": Unknown setting '"
+				<< trim(line) << "'" << std::endl;
+			return false;
+		}
+
+		settings[key] = trim(line.substr(equals + 1));
+	}
+
+	return true;
+}
+
+//Counters at one report, the report shows the change since the last one
+struct Counters {
+	std::chrono::steady_clock::time_point time;
+	uint64_t frames, busyTime, overruns, dropped, coalesced, starved,
+		overwritten;
+};
+
+static Counters readCounters(SpectrumAnalyzer& analyzer,
+	const std::atomic<uint64_t>& frames) {
+
+	return {std::chrono::steady_clock::now(), frames, analyzer.getBusyTime(),
+		analyzer.getOverrunCount(), analyzer.getDroppedFrameCount(),
+		analyzer.getCoalescedFrameCount(), analyzer.getStarvedFrameCount(),
+		analyzer.getOverwrittenFrameCount()};
+}
+
+static void report(std::ostream& out, const std::string& format,
+	double elapsed, const Counters& last, const Counters& now,
+	SpectrumAnalyzer& analyzer) {
+
+	double seconds = std::chrono::duration<double>(now.time - last.time).count();
+	double framesPerSecond = (now.frames - last.frames) / seconds;
+	double utilization = (now.busyTime - last.busyTime) /
+		(seconds * 1e9 * analyzer.getWorkerCount());
+
+	auto latency = analyzer.getLatency(SpectrumAnalyzer::LatencyStage::Total);
+
+	//Latency over this interval only
+	analyzer.resetLatency();
+
+	unsigned int queueDepth = analyzer.getQueueDepth();
+	uint64_t overruns = now.overruns - last.overruns,
+		dropped = now.dropped - last.dropped,
+		coalesced = now.coalesced - last.coalesced,
+		starved = now.starved - last.starved,
+		overwritten = now.overwritten - last.overwritten;
+
+	char line[512];
+
+	if(format == "csv") {
+		std::snprintf(line, sizeof(line), "%.3f,%.2f,%.4f,%u,%llu,%llu,%llu,%llu,"
+			"%llu,%.3f,%.3f", elapsed, framesPerSecond, utilization, queueDepth,
+			(unsigned long long)overruns, (unsigned long long)dropped,
+			(unsigned long long)coalesced, (unsigned long long)starved,
+			(unsigned long long)overwritten, latency.p50 / 1e6, latency.p99 / 1e6);
+	}
+	else if(format == "json") {
+		std::snprintf(line, sizeof(line), "{\"time\": %.3f, "
+			"\"frames_per_s\": %.2f, \"utilization\": %.4f, \"queue_depth\": %u, "
+			"\"overruns\": %llu, \"dropped\": %llu, \"coalesced\": %llu, "
+			"\"starved\": %llu, \"overwritten\": %llu, \"latency_p50_ms\": %.3f, "
+			"\"latency_p99_ms\": %.3f}", elapsed, framesPerSecond, utilization,
+			queueDepth, (unsigned long long)overruns, (unsigned long long)dropped,
+			(unsigned long long)coalesced, (unsigned long long)starved,
+			(unsigned long long)overwritten, latency.p50 / 1e6, latency.p99 / 1e6);
+	}
+	else {
+		std::snprintf(line, sizeof(line), "[Info] %.1fs: %.1f frames/s, "
+			"workers %.1f%% busy, queue %u, overruns %llu, dropped %llu, "
+			"coalesced %llu, starved %llu, overwritten %llu, latency p50 %.2fms "
+			"p99 %.2fms", elapsed, framesPerSecond, 100. * utilization,
+			queueDepth, (unsigned long long)overruns, (unsigned long long)dropped,
+			(unsigned long long)coalesced, (unsigned long long)starved,
+			(unsigned long long)overwritten, latency.p50 / 1e6, latency.p99 / 1e6);
+	}
+
+	out << line << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	auto settings = defaultSettings();
+	std::map<std::string, std::string> overrides;
+
+	for(int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+
+		if(arg == "-c" && i + 1 < argc) {
+			if(!parseConfig(argv[++i], settings)) {
+				return 1;
+			}
+		}
+		else if(arg.compare(0, 2, "--") == 0) {
+			std::string key = arg.substr(2), value;
+			size_t equals = key.find('=');
+
+			if(equals != std::string::npos) {
+				value = key.substr(equals + 1);
+				key = key.substr(0, equals);
+			}
+			else if(i + 1 < argc) {
+				value = argv[++i];
+			}
+			else {
+				printUsage(argv[0]);
+				return 1;
+			}
+
+			if(!settings.count(key)) {
+				std::cerr << "Unknown setting '" << key << "'" << std::endl;
+				return 1;
+			}
+
+			overrides[key] = value;
+		}
+		else {
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	//The command line wins over the config file, wherever -c appears
+	for(auto& setting : overrides) {
+		settings[setting.first] = setting.second;
+	}
+
+	//Numeric settings, checked up front so a typo can't turn into a zero
+	//sized source or an out of range conversion
+	enum class Range {
+		Count,			//Whole number > 0
+		Whole,			//Whole number >= 0
+		Positive,		//> 0
+		NonNegative	//>= 0
+	};
+	const std::map<std::string, Range> ranges = {
+		{"rate", Range::Count},
+		{"channels", Range::Count},
+		{"chunk", Range::Count},
+		{"block", Range::Count},
+		{"hop", Range::Whole},
+		{"threads", Range::Count},
+		{"queue", Range::Count},
+		{"fstart", Range::Positive},
+		{"fend", Range::Positive},
+		{"bpo", Range::Positive},
+		{"duration", Range::NonNegative},
+		{"interval", Range::Positive},
+		{"spectrogram", Range::Whole}
+	};
+	std::map<std::string, double> numbers;
+
+	for(auto& range : ranges) {
+		const std::string& text = settings[range.first];
+		char *end;
+		double value = std::strtod(text.c_str(), &end);
+		bool whole = (range.second == Range::Count ||
+			range.second == Range::Whole);
+		bool zeroAllowed = (range.second == Range::Whole ||
+			range.second == Range::NonNegative);
+
+		//Whole numbers must fit the unsigned ints they end up in
+		if(text.empty() || *end != '\0' || !std::isfinite(value) ||
+			value < 0. || (value == 0. && !zeroAllowed) ||
+			(whole && (value != std::floor(value) || value > UINT_MAX))) {
+
+			std::cerr << "Bad value '" << text << "' for " << range.first
+				<< std::endl;
+			printUsage(argv[0]);
+			return 1;
+		}
+
+		numbers[range.first] = value;
+	}
+
+	auto number = [&numbers](const std::string& key) {
+		return numbers.at(key);
+	};
+
+	//Library log messages go to stderr, leaving stdout for the reports
+	std::streambuf *stdoutBuffer = std::cout.rdbuf(std::cerr.rdbuf());
+	std::ostream stdoutStream(stdoutBuffer);
+	std::ofstream outputFile;
+
+	if(!settings["output"].empty()) {
+		outputFile.open(settings["output"]);
+
+		if(!outputFile) {
+			std::cerr << "Failed to open " << settings["output"] << std::endl;
+			return 1;
+		}
+	}
+
+	std::ostream& out = outputFile.is_open() ? outputFile : stdoutStream;
+
+	unsigned int sampleRate = number("rate"), channelCount = number("channels"),
+		chunkSize = number("chunk");
+	auto pacing = (settings["pacing"] == "free") ? ThreadedSource::Pacing::Free :
+		ThreadedSource::Pacing::Clocked;
+
+	std::shared_ptr<AudioSource> source;
+	std::shared_ptr<ThreadedSource> threadedSource;
+
+	try {
+		if(settings["source"] == "file") {
+			const std::string& input = settings["input"];
+
+			if(input.size() >= 4 && input.compare(input.size() - 4, 4, ".wav") == 0) {
+				threadedSource = std::make_shared<FileSource>(input, chunkSize, pacing);
+			}
+			else {
+				threadedSource = std::make_shared<FileSource>(input, chunkSize,
+					sampleRate, channelCount, pacing);
+			}
+		}
+		else if(settings["source"] == "synthetic") {
+			auto synthetic = std::make_shared<SyntheticSource>(sampleRate,
+				chunkSize, pacing, 0, 1, channelCount);
+
+			synthetic->addSweep(number("fstart"), number("fend"), 10., 0.25);
+			synthetic->addNoise(0.01);
+
+			threadedSource = synthetic;
+		}
+		else if(settings["source"] == "device") {
+			source = std::make_shared<AudioDevice>(AudioDevice::DEFAULT_DEVICE,
+				sampleRate, chunkSize, AudioDevice::DEFAULT_RING_SIZE, channelCount);
+		}
+		else {
+			std::cerr << "Unknown source '" << settings["source"] << "'"
+				<< std::endl;
+			return 1;
+		}
+	}
+	catch(const Exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	if(threadedSource) {
+		source = threadedSource;
+	}
+
+	std::map<std::string, SpectrumAnalyzer::OverloadPolicy> policies = {
+		{"drop-oldest", SpectrumAnalyzer::OverloadPolicy::DropOldest},
+		{"drop-newest", SpectrumAnalyzer::OverloadPolicy::DropNewest},
+		{"coalesce", SpectrumAnalyzer::OverloadPolicy::CoalesceLatest},
+		{"block", SpectrumAnalyzer::OverloadPolicy::Block}
+	};
+	std::map<std::string, SpectrumAnalyzer::AnalysisEngine> engines = {
+		{"single", SpectrumAnalyzer::AnalysisEngine::SingleBlock},
+		{"multirate", SpectrumAnalyzer::AnalysisEngine::Multirate},
+		{"sliding", SpectrumAnalyzer::AnalysisEngine::SlidingDft}
+	};
+	std::map<std::string, FftEngine::Mode> fftModes = {
+		{"packed", FftEngine::Mode::PackedStereo},
+		{"real", FftEngine::Mode::RealToComplex}
+	};
+
+	if(!policies.count(settings["policy"]) || !engines.count(settings["engine"])
+		|| !fftModes.count(settings["fft"])) {
+		std::cerr << "Unknown policy, engine or fft mode" << std::endl;
+		return 1;
+	}
+
+	std::unique_ptr<SpectrumAnalyzer> analyzer;
+	std::unique_ptr<SpectrumRecorder> recorder;
+
+	try {
+		SpectrumAnalyzer::Options options;
+
+		options.threadCount = number("threads");
+		options.fftMode = fftModes[settings["fft"]];
+		options.hopSize = number("hop");
+		options.queueDepth = number("queue");
+		options.overloadPolicy = policies[settings["policy"]];
+		options.analysisEngine = engines[settings["engine"]];
+		options.spectrogramFrames = number("spectrogram");
+		options.sharedMemoryName = settings["shm"];
+
+		analyzer = std::make_unique<SpectrumAnalyzer>(source, number("fstart"),
+			number("fend"), number("bpo"), number("block"), options);
+
+		if(!settings["record"].empty()) {
+			Spectrum layout(number("fstart"), number("fend"), number("bpo"));
+
+			recorder = std::make_unique<SpectrumRecorder>(settings["record"],
+				layout, source->getChannelCount(), source->getSampleRate(),
+				analyzer->getHopSize());
+		}
+	}
+	catch(const Exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	std::atomic<uint64_t> frameCount{0};
+
+	analyzer->addFrameListener([&](SpectrumAnalyzer*,
+		std::shared_ptr<SpectrumFrame> frame) {
+
+		frameCount.fetch_add(1, std::memory_order_relaxed);
+
+		if(recorder) {
+			recorder->record(*frame);
+		}
+	});
+
+	if(settings["report"] == "csv") {
+		out << "time,frames_per_s,utilization,queue_depth,overruns,dropped,"
+			"coalesced,starved,overwritten,latency_p50_ms,latency_p99_ms"
+			<< std::endl;
+	}
+
+	std::signal(SIGINT, onSignal);
+	std::signal(SIGTERM, onSignal);
+
+	double duration = number("duration"),
+		interval = std::max(number("interval"), 0.01);
+
+	auto startTime = std::chrono::steady_clock::now();
+	Counters last = readCounters(*analyzer, frameCount), first = last;
+	double nextReport = interval;
+
+	source->startStream();
+
+	while(true) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+		double elapsed = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - startTime).count();
+		bool done = interrupted || !source->isRunning() ||
+			(duration > 0 && elapsed >= duration);
+
+		if(done) {
+			source->stopStream();
+
+			if(!interrupted) {
+				//Count every frame of the input
+				analyzer->waitForIdle();
+			}
+		}
+
+		if(elapsed >= nextReport || done) {
+			Counters now = readCounters(*analyzer, frameCount);
+
+			report(out, settings["report"], elapsed, last, now, *analyzer);
+
+			last = now;
+
+			while(nextReport <= elapsed) {
+				nextReport += interval;
+			}
+		}
+
+		if(done) {
+			break;
+		}
+	}
+
+	if(recorder) {
+		recorder->close();
+	}
+
+	//Whole run, on stderr so it never mixes with csv/json reports
+	double seconds = std::chrono::duration<double>(last.time - first.time).count();
+
+	std::cerr << "[Info] " << last.frames << " frames in " << seconds << "s ("
+		<< last.frames / seconds << " frames/s) on " << analyzer->getWorkerCount()
+		<< " workers, " << 100. * last.busyTime /
+			(seconds * 1e9 * analyzer->getWorkerCount()) << "% busy, "
+		<< last.overruns << " overruns, " << last.dropped + last.coalesced +
+			last.starved + last.overwritten << " frames lost" << std::endl;
+
+	if(recorder) {
+		std::cerr << "[Info] Recorded " << recorder->getFrameCount()
+			<< " frames, " << recorder->getSize() << " bytes, "
+			<< recorder->getDroppedFrameCount()
+			<< " not recorded as the disk fell behind" << std::endl;
+	}
+
+	std::cout.rdbuf(stdoutBuffer);
+
+	//The recording is incomplete, close() has said so
+	if(recorder && recorder->hasFailed()) {
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,163 @@
+//Runs the single and double precision FFT engines on the same synthetic
+//input and reports how far the float results are from the double results
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <cstdint>
+
+#include "FftEngine.hpp"
+#include "Spectrum.hpp"
+
+#define SAMPLE_RATE	48000
+
+#define FSTART	32.7032			//C1
+#define FEND		16744.0384	//C10
+#define BINS_PER_OCTAVE	3
+
+//Magnitudes below this are ignored (-140dB re full scale)
+#define MAGNITUDE_FLOOR	1e-7
+
+struct TestSignal {
+	const char* name;
+	std::vector<int16_t> left, right;
+};
+
+struct ErrorStats {
+	double maxDB, meanDB;
+};
+
+static std::vector<TestSignal> makeSignals(unsigned int size);
+template<typename T>
+static ErrorStats compare(const T* single, const double* reference,
+	size_t count);
+
+int main() {
+	//Bin layout shared by every size
+	Spectrum layout(FSTART, FEND, BINS_PER_OCTAVE);
+
+	std::cout << "size\tmode\tsignal\tfft max dB\tfft mean dB"
+		"\tspectrum max dB\tspectrum mean dB" << std::endl;
+
+	for(unsigned int size = 512; size <= 16384; size *= 2) {
+		auto signals = makeSignals(size);
+
+		unsigned int mapStart;
+		auto binMap = layout.mapFftBins(SAMPLE_RATE, size, mapStart);
+
+		auto windowF = BasicFftEngine<float>::makeWindow(size);
+		auto windowD = BasicFftEngine<double>::makeWindow(size);
+
+		for(auto mode : {FftEngineBase::Mode::RealToComplex,
+			FftEngineBase::Mode::PackedStereo}) {
+
+			BasicFftEngine<float> engineF(size, mode);
+			BasicFftEngine<double> engineD(size, mode);
+
+			for(auto& signal : signals) {
+				engineF.execute(signal.left.data(), signal.right.data(),
+					windowF.data());
+				engineD.execute(signal.left.data(), signal.right.data(),
+					windowD.data());
+
+				//Raw FFT bins, both channels
+				ErrorStats fftLeft = compare(engineF.getLeftMagnitudes(),
+					engineD.getLeftMagnitudes(), size/2);
+				ErrorStats fftRight = compare(engineF.getRightMagnitudes(),
+					engineD.getRightMagnitudes(), size/2);
+
+				//Log frequency bins, as listeners see them
+				Spectrum spectrumF(layout), spectrumD(layout);
+
+				spectrumF.accumulate(binMap.data(),
+					engineF.getLeftMagnitudes() + mapStart, binMap.size());
+				spectrumD.accumulate(binMap.data(),
+					engineD.getLeftMagnitudes() + mapStart, binMap.size());
+
+				ErrorStats bins = compare(spectrumF.getEnergies(),
+					spectrumD.getEnergies(), spectrumD.getBinCount());
+
+				std::cout << size << '\t'
+					<< (mode == FftEngineBase::Mode::RealToComplex ? "r2c" : "packed")
+					<< '\t' << signal.name << std::scientific << std::setprecision(2)
+					<< '\t' << std::max(fftLeft.maxDB, fftRight.maxDB)
+					<< '\t' << (fftLeft.meanDB + fftRight.meanDB) / 2
+					<< '\t' << bins.maxDB << '\t' << bins.meanDB
+					<< std::defaultfloat << std::endl;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static std::vector<TestSignal> makeSignals(unsigned int size) {
+	std::vector<TestSignal> signals;
+	const double pi = 3.141592653589793;
+
+	//Full scale tone with low level tones next to it, the float
+	//pipeline's dynamic range is most visible on the quiet ones
+	TestSignal tones{"tones", {}, {}};
+
+	//Noise, fixed seed so runs are comparable
+	TestSignal noise{"noise", {}, {}};
+	std::mt19937 rng(1234);
+	std::normal_distribution<double> gaussian(0., 3000.);
+
+	//Exponential sweep across the analyzed range
+	TestSignal sweep{"sweep", {}, {}};
+
+	for(unsigned int i = 0; i < size; ++i) {
+		double t = (double)i / SAMPLE_RATE;
+
+		double tone = 16000. * std::sin(2*pi*1000.*t) +
+			160. * std::sin(2*pi*60.*t) + 1.6 * std::sin(2*pi*10000.*t);
+		tones.left.push_back((int16_t)std::lround(tone));
+		tones.right.push_back((int16_t)std::lround(tone / 100.));
+
+		noise.left.push_back((int16_t)std::lround(
+			std::max(-32767., std::min(32767., gaussian(rng)))));
+		noise.right.push_back((int16_t)std::lround(gaussian(rng) / 100.));
+
+		double duration = (double)size / SAMPLE_RATE;
+		double k = std::log(FEND / FSTART);
+		double phase = 2*pi*FSTART*duration / k * (std::exp(k * t / duration) - 1.);
+		sweep.left.push_back((int16_t)std::lround(16000. * std::sin(phase)));
+		sweep.right.push_back((int16_t)std::lround(16000. * std::cos(phase)));
+	}
+
+	signals.push_back(tones);
+	signals.push_back(noise);
+	signals.push_back(sweep);
+
+	return signals;
+}
+
+template<typename T>
+static ErrorStats compare(const T* single, const double* reference,
+	size_t count) {
+
+	ErrorStats stats{0., 0.};
+	size_t compared = 0;
+
+	for(size_t i = 0; i < count; ++i) {
+		if(reference[i] < MAGNITUDE_FLOOR) {
+			continue;
+		}
+
+		double errorDB = std::abs(20. * std::log10(
+			std::max((double)single[i], 1e-30) / reference[i]));
+
+		stats.maxDB = std::max(stats.maxDB, errorDB);
+		stats.meanDB += errorDB;
+		++compared;
+	}
+
+	if(compared > 0) {
+		stats.meanDB /= compared;
+	}
+
+	return stats;
+}